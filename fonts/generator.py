@@ -164,43 +164,98 @@ class Font16x8(FontBase):
         return f'{__class__.__name__}({bitmap})'
 
 
-if __name__ == '__main__':
-    import string
-
-    # font6x4 = {}
-    # with open('tom-thumb.bdf', 'r') as f:
-    #     while True:
-    #         line = f.readline()
-    #         if not line:
-    #             break
-    #         if line.startswith('STARTCHAR'):
-    #             line = f.readline()
-    #             encoding = int(line.split()[1])
-    #             line = f.readline()
-    #             swidth = tuple(map(int, line.split()[1:]))
-    #             line = f.readline()
-    #             dwidth = tuple(map(int, line.split()[1:]))
-    #             line = f.readline()
-    #             bbx = tuple(map(int, line.split()[1:]))
-    #             f.readline()  # Skip BITMAP line
-    #             bitmap = []
-    #             while True:
-    #                 line = f.readline()
-    #                 if line.startswith('ENDCHAR'):
-    #                     break
-    #                 bitmap.append(int(line.strip(), 16))
-    #             font6x4[chr(encoding)] = Font6x4(swidth, dwidth, bbx, bitmap)
-
-    # with open('font_6x4.txt', 'w', encoding='utf-8') as f:
-    #     for k, v in font6x4.items():
-    #         if k not in string.printable:
-    #             continue
-    #         f.write("'" + (k if k not in ("'", "\\") else f'\\{k}') + f"': {v},\n")
-    #     print(f'Generated font_6x4.txt for {len(font6x4)} characters')
+def c_char(k: int) -> str:
+    ks = chr(k)
+    return "'" + (ks if ks not in ("'", "\\") else f'\\{ks}') + "'"
+
+
+def write_planar_font(path: str, name: str, header: List[str], glyphs: dict, pages: int, space_width: int,
+                      first: int = 0x20, last: int = 0x7E):
+    """
+    Writes a font as page-planar glyph data: glyph[page][column] with a fixed
+    stride (the widest glyph) and a width table, so the C side can hand out a
+    pointer to a glyph instead of copying it.
+    glyphs maps characters to a list of pages, each a list of column bytes.
+    """
+    glyphs = dict(glyphs)
+    glyphs[' '] = [[0] * space_width for _ in range(pages)]
+    stride = max(len(glyphs[chr(k)][0]) for k in range(first, last + 1))
+    prefix = ' ' * 4
+    with open(path, 'w', encoding='utf-8') as f:
+        for line in header:
+            f.write(line + '\n')
+        f.write(f'// Layout: [glyph][page][column], {pages} page(s), stride {stride}\n')
+        f.write('\n')
+        f.write('#include <stdint.h>\n')
+        f.write('\n')
+        f.write('#include "font.h"\n')
+        f.write('\n')
+        f.write('#define BEGIN(x) {\n')
+        f.write('#define END(x) }\n')
+        f.write('\n')
+
+        f.write(f'static const uint8_t {name}_glyphs[{last - first + 1}][{pages}][{stride}] = {{\n')
+        for k in range(first, last + 1):
+            page_columns = glyphs[chr(k)]
+            assert len(page_columns) == pages, f'Glyph {k:#x} has {len(page_columns)} pages, expected {pages}'
+            rows = ', '.join('{' + ', '.join(f'0x{x:02x}' for x in page) + '}' for page in page_columns)
+            f.write(prefix + f'BEGIN({c_char(k)}) {rows} END({c_char(k)}),\n')
+        f.write('};\n')
+        f.write('\n')
+
+        f.write(f'static const uint8_t {name}_widths[{last - first + 1}] = {{\n')
+        for k in range(first, last + 1):
+            f.write(prefix + f'{len(glyphs[chr(k)][0])},   // {c_char(k)}\n')
+        f.write('};\n')
+        f.write('\n')
+
+        f.write(f'const FontFace {name} = {{\n')
+        f.write(prefix + f'.pages = {pages},\n')
+        f.write(prefix + f'.stride = {stride},\n')
+        f.write(prefix + f'.first = 0x{first:02X},\n')
+        f.write(prefix + f'.count = {last - first + 1},\n')
+        f.write(prefix + f'.glyphs = &{name}_glyphs[0][0][0],\n')
+        f.write(prefix + f'.widths = {name}_widths,\n')
+        f.write('};\n')
+    print(f'Generated {path} for {len(glyphs)} characters')
+
+
+def load_bdf(path: str) -> dict:
+    """
+    Reads a BDF font (tom-thumb) into {character: Font6x4}.
+    """
+    font6x4 = {}
+    with open(path, 'r') as f:
+        while True:
+            line = f.readline()
+            if not line:
+                break
+            if line.startswith('STARTCHAR'):
+                line = f.readline()
+                encoding = int(line.split()[1])
+                line = f.readline()
+                swidth = tuple(map(int, line.split()[1:]))
+                line = f.readline()
+                dwidth = tuple(map(int, line.split()[1:]))
+                line = f.readline()
+                bbx = tuple(map(int, line.split()[1:]))
+                f.readline()  # Skip BITMAP line
+                bitmap = []
+                while True:
+                    line = f.readline()
+                    if line.startswith('ENDCHAR'):
+                        break
+                    bitmap.append(int(line.strip(), 16))
+                font6x4[chr(encoding)] = Font6x4(swidth, dwidth, bbx, bitmap)
+    return font6x4
 
 
+def load_pxf(path: str) -> dict:
+    """
+    Reads a PixelForge font (Pixelated Elegance) into {character: Font8x9}.
+    """
     font8x9 = {}
-    with open('Pixelated Elegance v0.3-7344.pxf', 'r') as f:
+    with open(path, 'r') as f:
         num_glyphs = 0
         while True:
             line = f.readline()
@@ -231,65 +286,15 @@ if __name__ == '__main__':
                     x, y = map(int, pair.split())
                     pixels.append((x, y))
                 font8x9[chr(encoding)] = Font8x9(advance, auto_update_advance, auto_advance_amount, pixels)
+    return font8x9
 
-    with open('font_8x9.c', 'w', encoding='utf-8') as f:
-        index_map = {0x21: 0}
-        f.write('// Font data for Pixelated Elegance v0.3-7344\n')
-        f.write('// Generated by generator.py\n')
-        f.write('// Font data: 95 printable ASCII characters (0x21–0x7E)\n')
-        f.write('// Address map: 0x21–0x7E\n')
-        f.write('// Author: Himanshu\n')
-        f.write('// License: CC0 1.0 Universal (CC0 1.0) Public Domain Dedication\n')
-        f.write('// https://www.fontspace.com/pixelated-elegance-font-f126145\n')
-        f.write('\n')
-        f.write('#include <stdint.h>\n')
-        f.write('#include <string.h>\n')
-        f.write('\n')
-        f.write('#define BEGIN(x)\n')
-        f.write('#define END(x)\n')
-        f.write('\n')
-
-        prefix = ' ' * 4
-
-        f.write('static const uint8_t font_8x9_columns_blob[] = {\n')
-        for k in range(0x21, 0x7F):
-            columns = font8x9[chr(k)].get_columns()
-            index_map[k + 1] = index_map[k] + len(columns)
-            ks = chr(k)
-            ks = "'" + (ks if ks not in ("'", "\\") else f'\\{ks}') + "'"
-            f.write(prefix + f'BEGIN({ks}) ')
-            f.write(', '.join(map(lambda x: f'0x{x:02x}', columns)))
-            f.write(f' END({ks}),\n')
-        f.write('};\n')
-        f.write('\n')
-
-        f.write('static const uint16_t font_8x9_index_map[] = {\n')
-        for k in range(0x21, 0x7F):
-            ks = chr(k)
-            ks = "'" + (ks if ks not in ("'", "\\") else f'\\{ks}') + "'"
-            f.write(prefix + f'BEGIN({ks}) ')
-            f.write(f'{index_map[k]}')
-            f.write(f' END({ks}),\n')
-        f.write(prefix + 'sizeof(font_8x9_columns_blob) / sizeof(font_8x9_columns_blob[0])\n')
-        f.write('};\n')
-        f.write('\n')
-
-        f.write('int16_t font_8x9_get_columns(uint8_t character, uint8_t *buf) {\n')
-        f.write('    if (character < 0x21 || character > 0x7E)\n')
-        f.write('        return -1;\n')
-        f.write('    character -= 0x21;\n')
-        f.write('    int16_t len = font_8x9_index_map[character + 1] - font_8x9_index_map[character];\n')
-        f.write('    if (len < 0)\n')
-        f.write('        return -1;\n')
-        f.write('    for (int8_t i = 0; i < len; i++)\n')
-        f.write('        buf[i] = (font_8x9_columns_blob + font_8x9_index_map[character])[i];\n')
-        f.write('    return len;\n')
-        f.write('}\n')
-        # f.write('\n')
-        print(f'Generated font_8x9.c for {len(font8x9)} characters')
 
+def load_mem(path: str) -> dict:
+    """
+    Reads a $readmemb font (Bizcat) into {character: Font16x8}.
+    """
     font16x8 = {}
-    with open('font_bizcat8x16.mem', 'r') as f:
+    with open(path, 'r') as f:
         f.readline()  # Skip first line
         for line in f:
             if line.startswith('// 0x'):
@@ -303,48 +308,125 @@ if __name__ == '__main__':
                 font16x8[char] = Font16x8(bitmap)
             else:
                 print(f'Unexpected line: {line.strip()}')
+    return font16x8
 
-    with open('font_16x8.c', 'w', encoding='utf-8') as f:
-        index_map = {0x21: 0}
-        f.write('// Font data for Bizcat 16 × 8 font\n')
-        f.write('// Generated by generator.py\n')
-        f.write('// Font data: 95 printable ASCII characters (0x21–0x7E)\n')
-        f.write('// Author: Himanshu\n')
-        f.write('// License: CC0 1.0 Universal (CC0 1.0) Public Domain Dedication\n')
-        f.write('// https://github.com/tomwaitsfornoman/lawrie-nes_ecp5/blob/master/osd/font_bizcat8x16.mem\n')
-        f.write('\n')
-        f.write('#include <stdint.h>\n')
-        f.write('#include <string.h>\n')
-        f.write('\n')
-        f.write('#define BEGIN(x) {\n')
-        f.write('#define END(x) }\n')
-        f.write('\n')
 
-        prefix = ' ' * 4
-
-        f.write('static const uint16_t font_16x8_columns[0x7E - 0x20][8] = {\n')
-        for k in range(0x21, 0x7F):
-            columns = font16x8[chr(k)].get_columns()
-            index_map[k + 1] = index_map[k] + sum(map(len, columns))
-            ks = chr(k)
-            ks = "'" + (ks if ks not in ("'", "\\") else f'\\{ks}') + "'"
-            f.write(prefix + f'BEGIN({ks}) ')
-            f.write(', '.join(f'0x{column[1]:02x}{column[0]:02x}' for column in columns))
-            f.write(f' END({ks}),\n')
-        f.write('};\n')
-        f.write('\n')
+FONT_PACK_MAGIC = b'SFPK'
+FONT_PACK_VERSION = 1
+FONT_PACK_BLOCK = 128           # code points per lookup block
+FONT_PACK_BLOCKS = 0x10000 // FONT_PACK_BLOCK
+
+
+def write_font_pack(path: str, fonts: List[tuple]):
+    """
+    Writes a binary font pack for fontpack_open (see include/fontpack.h).
+    fonts is a list of (name, pages, space_width, {code point: [page columns]}).
+    All integers are little-endian and every table is 4-byte aligned, so the
+    C side uses the mapped file in place.
+
+    Header:      magic[4], version u16, font count u16, file size u32, reserved u32
+    Font entry:  name[16], pages u8, stride u8, reserved u16, glyph count u32,
+                 glyphs, widths, blocks, index offsets u32, range count u32, ranges offset u32
+    glyphs:      [glyph][page][stride] column bytes
+    widths:      [glyph] u8
+    blocks:      [FONT_PACK_BLOCKS] u16, index slot of each 128 code point block or 0xFFFF
+    index:       [slot][128] u16, glyph of each code point or 0xFFFF
+    ranges:      [range] (first u32, last u32), contiguous code point runs
+    """
+    import struct
+
+    header_size = 16
+    entry_size = 48
+    blobs = []
+    entries = []
+    offset = header_size + entry_size * len(fonts)
+
+    def add(blob: bytes) -> int:
+        nonlocal offset
+        start = offset
+        blob += bytes(-len(blob) % 4)
+        blobs.append(blob)
+        offset += len(blob)
+        return start
+
+    for name, pages, space_width, glyphs in fonts:
+        glyphs = dict(glyphs)
+        glyphs.setdefault(0x20, [[0] * space_width for _ in range(pages)])
+        codes = sorted(c for c in glyphs if c < 0x10000)
+        stride = max(len(glyphs[c][0]) for c in codes)
+        data = bytearray()
+        widths = bytearray()
+        for c in codes:
+            assert len(glyphs[c]) == pages, f'{name}: glyph {c:#x} has {len(glyphs[c])} pages, expected {pages}'
+            for page in glyphs[c]:
+                data += bytes(page) + bytes(stride - len(page))
+            widths.append(len(glyphs[c][0]))
+        blocks = [0xFFFF] * FONT_PACK_BLOCKS
+        index = []
+        for g, c in enumerate(codes):
+            block = c // FONT_PACK_BLOCK
+            if blocks[block] == 0xFFFF:
+                blocks[block] = len(index) // FONT_PACK_BLOCK
+                index += [0xFFFF] * FONT_PACK_BLOCK
+            index[blocks[block] * FONT_PACK_BLOCK + c % FONT_PACK_BLOCK] = g
+        ranges = []
+        for c in codes:
+            if ranges and ranges[-1][1] == c - 1:
+                ranges[-1][1] = c
+            else:
+                ranges.append([c, c])
+        glyphs_offset = add(bytes(data))
+        widths_offset = add(bytes(widths))
+        blocks_offset = add(struct.pack(f'<{len(blocks)}H', *blocks))
+        index_offset = add(struct.pack(f'<{len(index)}H', *index))
+        ranges_offset = add(b''.join(struct.pack('<II', *r) for r in ranges))
+        entries.append(struct.pack('<16sBBHIIIIIII', name.encode()[:15], pages, stride, 0, len(codes),
+                                   glyphs_offset, widths_offset, blocks_offset, index_offset,
+                                   len(ranges), ranges_offset))
+        print(f'Packed {name}: {len(codes)} glyphs in {len(ranges)} ranges')
+
+    with open(path, 'wb') as f:
+        f.write(struct.pack('<4sHHII', FONT_PACK_MAGIC, FONT_PACK_VERSION, len(fonts), offset, 0))
+        for entry in entries:
+            f.write(entry)
+        for blob in blobs:
+            f.write(blob)
+    print(f'Generated {path} ({offset} bytes, {len(fonts)} fonts)')
+
+
+if __name__ == '__main__':
+    import sys
+
+    font8x9 = load_pxf('Pixelated Elegance v0.3-7344.pxf')
+    write_planar_font('font_8x9.c', 'font_8x9', [
+            '// Font data for Pixelated Elegance v0.3-7344',
+            '// Generated by generator.py',
+            '// Font data: 95 printable ASCII characters (0x20–0x7E)',
+            '// Author: Himanshu',
+            '// License: CC0 1.0 Universal (CC0 1.0) Public Domain Dedication',
+            '// https://www.fontspace.com/pixelated-elegance-font-f126145',
+        ],
+        {k: [v.get_columns()] for k, v in font8x9.items()}, pages=1, space_width=4)
+
+    font16x8 = load_mem('font_bizcat8x16.mem')
+    write_planar_font('font_16x8.c', 'font_16x8', [
+            '// Font data for Bizcat 16 × 8 font',
+            '// Generated by generator.py',
+            '// Font data: 95 printable ASCII characters (0x20–0x7E)',
+            '// Author: Himanshu',
+            '// License: CC0 1.0 Universal (CC0 1.0) Public Domain Dedication',
+            '// https://github.com/tomwaitsfornoman/lawrie-nes_ecp5/blob/master/osd/font_bizcat8x16.mem',
+        ],
+        {k: [list(page) for page in zip(*v.get_columns())] for k, v in font16x8.items()}, pages=2, space_width=8)
 
-        f.write('int8_t font_16x8_get_columns(uint8_t character, uint16_t *buf) {\n')
-        f.write('    if (character < 0x21 || character > 0x7E)\n')
-        f.write('        return -1;\n')
-        f.write('    character -= 0x21;\n')
-        f.write('    int8_t len = 8;\n')
-        f.write('    if (len < 0)\n')
-        f.write('        return -1;\n')
-        f.write('    for (int8_t i = 0; i < len; i++)\n')
-        f.write('        buf[i] = font_16x8_columns[character][i];\n')
-        f.write('    return len;\n')
-        f.write('}\n')
-        print(f'Generated font_16x8.c for {len(font16x8)} characters')
+    if len(sys.argv) > 2 and sys.argv[1] == 'pack':
+        # Bizcat codes above 0x7E are not Unicode, so only ASCII goes in the pack
+        font6x4 = load_bdf('tom-thumb.bdf')
+        write_font_pack(sys.argv[2], [
+            ('pixelated', 1, 4, {ord(k): [v.get_columns()] for k, v in font8x9.items()}),
+            ('bizcat', 2, 8, {ord(k): [list(page) for page in zip(*v.get_columns())]
+                              for k, v in font16x8.items() if 0x20 < ord(k) < 0x7F}),
+            ('tom-thumb', 1, 4, {ord(k): [v.get_columns()] for k, v in font6x4.items()}),
+        ])
 
     print('Done.')
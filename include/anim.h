@@ -0,0 +1,26 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "layout.h"
+
+// Delta-encoded animations built by `tools/anim.py`. The file is memory-mapped
+// and played in place: every frame is a list of changed page/column runs
+// (RLE-compressed), decoded straight into the tile and sent as one window per
+// run. Keyframes redraw the whole frame and make seeking cheap.
+
+typedef void * AnimPtr;
+
+AnimPtr anim_open(const char *path);
+void anim_close(AnimPtr anim);
+
+uint32_t anim_get_num_frames(AnimPtr anim);
+uint8_t anim_get_width(AnimPtr anim);
+uint8_t anim_get_height(AnimPtr anim);      // pages
+uint16_t anim_get_delay_ms(AnimPtr anim, uint32_t frame);
+
+// Shows `frame` in the tile's top-left corner. The frame after the one last
+// shown costs its delta; any other frame is rebuilt from the nearest keyframe.
+int8_t anim_show_frame(AnimPtr anim, LayoutPtr layout, uint8_t tile, uint32_t frame);
+// Plays the animation `loops` times (0: forever), paced by the frame delays
+int8_t anim_play(AnimPtr anim, LayoutPtr layout, uint8_t tile, uint32_t loops);
@@ -0,0 +1,37 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "layout.h"
+#include "font.h"
+
+// Pixel-addressed drawing into a tile. Coordinates are in pixels relative to
+// the tile's top-left corner and may be negative or run past the tile; whatever
+// falls outside is clipped. Bitmaps are page-planar like fonts: `width` column
+// bytes per 8-pixel page, bit 0 on top.
+
+typedef enum {
+    BLIT_OR = 0,        // set the source's 1 bits
+    BLIT_SET = 1,       // replace the covered pixels with the source
+    BLIT_XOR = 2,       // invert where the source is 1
+    BLIT_CLEAR = 3,     // clear where the source is 1
+} BlitOp;
+
+// Cache of glyphs pre-shifted to a pixel offset within the page, shared by any
+// number of layouts and faces. Direct-mapped: the characters drawn most often
+// stay resident.
+typedef void * GlyphCachePtr;
+
+#define GLYPH_CACHE_MAX_COLUMNS 24
+
+GlyphCachePtr glyph_cache_create(uint16_t entries);
+void glyph_cache_free(GlyphCachePtr cache);
+void glyph_cache_clear(GlyphCachePtr cache);
+
+int8_t layout_set_glyph_cache(LayoutPtr layout, GlyphCachePtr cache);
+
+int8_t layout_blit(LayoutPtr layout, uint8_t tile, int16_t x, int16_t y,
+                   const uint8_t *bitmap, uint8_t width, uint8_t height, BlitOp op);
+int8_t layout_draw_text(LayoutPtr layout, uint8_t tile, int16_t x, int16_t y,
+                        const uint8_t *text, size_t len, const FontFace *face, BlitOp op);
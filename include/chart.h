@@ -0,0 +1,33 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "layout.h"
+
+// Strip chart for a tile: a ring buffer of samples, one column each, drawn as
+// a connected line (sparkline) or as bars. A new sample redraws only the
+// columns it affects. In sweep mode it overwrites the oldest sample in place,
+// ahead of a blank cursor column. In scroll mode the chart rolls left: the
+// controller's content scroll moves the panel's copy of the tile, so a flush
+// sends one column. Push and flush a scrolling chart no faster than the panel
+// refreshes; two samples between flushes resend the tile.
+
+typedef void * ChartPtr;
+
+typedef enum {
+    CHART_SCROLL = 0,       // newest sample at the right edge
+    CHART_SWEEP = 1,        // newest sample at a cursor that wraps around
+} ChartMode;
+
+typedef enum {
+    CHART_LINE = 0,
+    CHART_BARS = 1,
+} ChartStyle;
+
+ChartPtr chart_create(LayoutPtr layout, uint8_t tile, ChartMode mode, ChartStyle style, int32_t min, int32_t max);
+void chart_free(ChartPtr chart);
+
+int8_t chart_push(ChartPtr chart, int32_t value);
+// Rescales the chart, redrawing the whole tile
+int8_t chart_set_range(ChartPtr chart, int32_t min, int32_t max);
+int8_t chart_clear(ChartPtr chart);
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "layout.h"
+
+// Layered compositor: stacks 1bpp layers (and sprites on them) into a target
+// layout, recomposing only the rectangles that changed since the last pass.
+//
+// A layer is an ordinary layout created with layout_create(NULL) and drawn with
+// the usual calls (print, blit, gfx); its tiles' dirty boxes tell the compositor
+// what to recompose. Layers are never flushed themselves - the target is.
+// Layers of a rotated target must be turned the same way (portrait or
+// landscape). Sprite coordinates are panel pixels, as the target is rotated.
+
+typedef void * CompositorPtr;
+
+#define COMPOSE_MAX_LAYERS  4
+#define COMPOSE_MAX_SPRITES 8
+#define COMPOSE_MAX_RECTS   8
+
+typedef enum {
+    COMPOSE_COPY = 0,       // layer replaces what is below
+    COMPOSE_OR = 1,
+    COMPOSE_AND = 2,
+    COMPOSE_XOR = 3,
+    COMPOSE_ANDNOT = 4,     // layer's 1 bits clear what is below
+} ComposeOp;
+
+CompositorPtr compositor_create(LayoutPtr target);
+void compositor_free(CompositorPtr comp);
+
+int8_t compositor_add_layer(CompositorPtr comp, LayoutPtr layer, ComposeOp op);
+int8_t compositor_set_layer_op(CompositorPtr comp, uint8_t layer, ComposeOp op);
+int8_t compositor_set_layer_visible(CompositorPtr comp, uint8_t layer, bool visible);
+
+// `mask` selects the sprite's opaque pixels; NULL makes its 0 bits transparent.
+// Both are page-planar, `width` bytes per page. Sprites start hidden.
+int8_t compositor_add_sprite(CompositorPtr comp, uint8_t layer, const uint8_t *bitmap, const uint8_t *mask,
+                             uint8_t width, uint8_t height);
+int8_t compositor_set_sprite_bitmap(CompositorPtr comp, uint8_t sprite, const uint8_t *bitmap, const uint8_t *mask);
+int8_t compositor_move_sprite(CompositorPtr comp, uint8_t sprite, int16_t x, int16_t y);
+int8_t compositor_show_sprite(CompositorPtr comp, uint8_t sprite, bool visible);
+
+int8_t compositor_invalidate(CompositorPtr comp);
+int8_t compositor_compose(CompositorPtr comp);
@@ -0,0 +1,28 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "layout.h"
+#include "font.h"
+
+// Character-cell text mode for a tile. The console keeps a grid of cells (one
+// code point each, `stride` columns wide) and renders only the cells that
+// changed, when the layout is flushed. Rows live in a ring buffer, so scrolling
+// moves no data; a console covering the whole panel scrolls with the display
+// start line instead of re-sending its rows.
+
+typedef void * ConsolePtr;
+
+ConsolePtr console_create(LayoutPtr layout, uint8_t tile, const FontFace *face);
+void console_free(ConsolePtr console);
+
+uint8_t console_get_rows(ConsolePtr console);
+uint8_t console_get_columns(ConsolePtr console);
+
+int8_t console_put(ConsolePtr console, uint8_t row, uint8_t column, const uint8_t *text, size_t len);
+int8_t console_write(ConsolePtr console, const uint8_t *text, size_t len);
+int8_t console_set_cursor(ConsolePtr console, uint8_t row, uint8_t column);
+int8_t console_scroll(ConsolePtr console, uint8_t lines);
+int8_t console_clear(ConsolePtr console);
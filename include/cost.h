@@ -0,0 +1,43 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "layout.h"
+
+// Wire-time cost model: turns the transfers a flush would make into bus time,
+// so tile layouts and bus speeds can be compared without hardware.
+
+#define BUS_SPEED_I2C_STANDARD      100000
+#define BUS_SPEED_I2C_FAST          400000
+#define BUS_SPEED_I2C_FAST_PLUS     1000000
+
+#define COST_DIRTY_TILES    0x00000000      // tiles currently marked dirty
+#define COST_ALL_TILES      0xFFFFFFFF
+
+typedef enum {
+    BUS_I2C = 0,
+    BUS_SPI = 1,
+} BusType;
+
+typedef struct {
+    BusType type;
+    uint32_t clock_hz;          // SCL / SCLK frequency
+    uint32_t overhead_ns;       // fixed cost of each transaction in the transport (driver call, USB frame, ...)
+} BusConfig;
+
+typedef struct {
+    uint32_t transactions;
+    uint32_t command_bytes;
+    uint32_t data_bytes;
+    uint32_t framing_bytes;     // address and control bytes added by the transport
+    uint64_t bits;              // bus clock periods, including ACK, START and STOP
+    uint64_t time_ns;
+} WireCost;
+
+void cost_reset(WireCost *cost);
+int8_t cost_add_transfer(const BusConfig *bus, bool command, size_t len, WireCost *cost);
+
+int8_t cost_layout_flush(LayoutPtr layout, const BusConfig *bus, uint32_t tiles, WireCost *cost);
+double cost_layout_max_fps(LayoutPtr layout, const BusConfig *bus, uint32_t tiles);
@@ -0,0 +1,30 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "layout.h"
+
+// Conversion of 8-bit grayscale (0 black, 255 white) to panel pixels. Rows are
+// pushed one at a time and written out to the tile every 8 rows, so only the
+// error rows and one band of packed pixels are held in memory.
+
+typedef enum {
+    DITHER_THRESHOLD = 0,
+    DITHER_BAYER = 1,               // 8x8 ordered
+    DITHER_FLOYD_STEINBERG = 2,
+    DITHER_ATKINSON = 3,
+} DitherMethod;
+
+typedef void * DitherPtr;
+
+// The image's top-left pixel lands at tile pixel (x, y); rows below the tile are skipped
+DitherPtr dither_create(LayoutPtr layout, uint8_t tile, int16_t x, int16_t y, uint16_t width, DitherMethod method);
+void dither_free(DitherPtr dither);
+
+int8_t dither_row(DitherPtr dither, const uint8_t *gray);
+// Writes out a partially filled band; call once after the last row
+int8_t dither_flush(DitherPtr dither);
+
+int8_t layout_dither_image(LayoutPtr layout, uint8_t tile, int16_t x, int16_t y, const uint8_t *gray,
+                           uint16_t width, uint16_t height, size_t stride, DitherMethod method);
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "layout.h"
+
+// Effects the controller performs on its own, for a few command bytes instead
+// of a framebuffer transfer.
+//
+// A marquee scrolls the pages of a tile with the controller's horizontal
+// scroll; the whole width of those pages moves, including other tiles on them.
+// It starts with the next layout_flush, after the tile content is sent. The
+// controller cannot take RAM writes while scrolling, so any later flush that
+// sends data stops the marquee, rewrites the scrolled tiles and restarts it
+// from the original position. The SH1106 has no scroll commands, so its
+// panels reject marquees.
+
+typedef enum {
+    MARQUEE_RIGHT = 0,
+    MARQUEE_LEFT = 1,
+} MarqueeDirection;
+
+// Frames per scroll step, as encoded by the controller
+typedef enum {
+    MARQUEE_2_FRAMES = 7,
+    MARQUEE_3_FRAMES = 4,
+    MARQUEE_4_FRAMES = 5,
+    MARQUEE_5_FRAMES = 0,
+    MARQUEE_25_FRAMES = 6,
+    MARQUEE_64_FRAMES = 1,
+    MARQUEE_128_FRAMES = 2,
+    MARQUEE_256_FRAMES = 3,
+} MarqueeSpeed;
+
+int8_t layout_start_marquee(LayoutPtr layout, uint8_t tile, MarqueeDirection direction, MarqueeSpeed speed);
+int8_t layout_stop_marquee(LayoutPtr layout);
+
+// Sent immediately
+int8_t layout_set_contrast(LayoutPtr layout, uint8_t contrast);
+int8_t layout_set_inverted(LayoutPtr layout, bool inverted);
+
+// Ramp the contrast to `target` over `duration_ms`, blocking until done
+int8_t layout_fade_contrast(LayoutPtr layout, uint8_t target, uint16_t duration_ms);
+// Toggles inverse video `count` times per `period_ms`, ending as it started
+int8_t layout_blink(LayoutPtr layout, uint8_t count, uint16_t period_ms);
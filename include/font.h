@@ -0,0 +1,57 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define FONT_BLOCK_SIZE     128                     // code points per lookup block
+#define FONT_BLOCKS         (0x10000 / FONT_BLOCK_SIZE)
+#define FONT_NO_GLYPH       0xFFFF
+#define FONT_UTF8_INVALID   0xFFFFFFFF
+
+// Page-planar glyph storage, as emitted by fonts/generator.py: glyph g, page p
+// starts at glyphs + (g * pages + p) * stride and holds widths[g] column bytes.
+// Compiled-in fonts cover one contiguous range starting at `first`; font packs
+// cover sparse Unicode through a two-level block table instead.
+typedef struct {
+    uint8_t pages;              // glyph height in pages
+    uint8_t stride;             // bytes per glyph page (widest glyph)
+    uint32_t first;             // first character
+    uint32_t count;             // number of glyphs
+    const uint8_t *glyphs;
+    const uint8_t *widths;
+    const uint16_t *blocks;     // [FONT_BLOCKS] index slot per block or FONT_NO_GLYPH, NULL for a single range
+    const uint16_t *index;      // [slot][FONT_BLOCK_SIZE] glyph per code point or FONT_NO_GLYPH
+} FontFace;
+
+extern const FontFace font_8x9;
+extern const FontFace font_16x8;
+
+// Zero-copy lookup: returns the glyph's first page, or NULL if the font has no
+// glyph for `c`. Page p of the glyph is at the returned pointer + p * stride.
+static inline const uint8_t *font_glyph(const FontFace *face, uint32_t c, uint8_t *width) {
+    uint32_t index;
+    if (face->blocks != NULL) {
+        if (c >= 0x10000) {
+            return NULL;
+        }
+        uint16_t slot = face->blocks[c / FONT_BLOCK_SIZE];
+        if (slot == FONT_NO_GLYPH) {
+            return NULL;
+        }
+        index = face->index[(size_t)slot * FONT_BLOCK_SIZE + c % FONT_BLOCK_SIZE];
+        if (index == FONT_NO_GLYPH) {
+            return NULL;
+        }
+    } else {
+        index = c - face->first;
+        if (index >= face->count) {
+            return NULL;
+        }
+    }
+    *width = face->widths[index];
+    return face->glyphs + (size_t)index * face->pages * face->stride;
+}
+
+// Decodes the UTF-8 sequence at text[*pos] and advances *pos past it.
+// Returns FONT_UTF8_INVALID for malformed or truncated sequences.
+uint32_t font_utf8_next(const uint8_t *text, size_t len, size_t *pos);
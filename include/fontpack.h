@@ -0,0 +1,20 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "font.h"
+
+// Runtime-loadable font packs built by `fonts/generator.py pack <file>`. The
+// pack is memory-mapped and used in place; the returned faces stay valid until
+// fontpack_close.
+
+typedef void * FontPackPtr;
+
+FontPackPtr fontpack_open(const char *path);
+void fontpack_close(FontPackPtr pack);
+
+uint16_t fontpack_get_num_fonts(FontPackPtr pack);
+const char *fontpack_get_name(FontPackPtr pack, uint16_t font);
+const FontFace *fontpack_get_face(FontPackPtr pack, uint16_t font);
+const FontFace *fontpack_find_face(FontPackPtr pack, const char *name);
+uint32_t fontpack_get_ranges(FontPackPtr pack, uint16_t font, const uint32_t **ranges);
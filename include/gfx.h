@@ -0,0 +1,33 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "layout.h"
+
+// Graphics primitives drawn into a tile of the layout framebuffer. Coordinates
+// are pixels relative to the tile's top-left corner; anything outside the tile
+// is clipped. Only the columns a primitive touches are flushed. Primitives are
+// not recorded on a deferred tile: each one draws what is pending there first.
+
+typedef enum {
+    GFX_BLACK = 0,
+    GFX_WHITE = 1,
+    GFX_INVERT = 2,
+} GfxColor;
+
+int8_t gfx_pixel(LayoutPtr layout, uint8_t tile, int16_t x, int16_t y, GfxColor color);
+int8_t gfx_hline(LayoutPtr layout, uint8_t tile, int16_t x, int16_t y, int16_t w, GfxColor color);
+int8_t gfx_vline(LayoutPtr layout, uint8_t tile, int16_t x, int16_t y, int16_t h, GfxColor color);
+int8_t gfx_line(LayoutPtr layout, uint8_t tile, int16_t x0, int16_t y0, int16_t x1, int16_t y1, GfxColor color);
+
+int8_t gfx_rect(LayoutPtr layout, uint8_t tile, int16_t x, int16_t y, int16_t w, int16_t h, GfxColor color);
+int8_t gfx_fill_rect(LayoutPtr layout, uint8_t tile, int16_t x, int16_t y, int16_t w, int16_t h, GfxColor color);
+int8_t gfx_round_rect(LayoutPtr layout, uint8_t tile, int16_t x, int16_t y, int16_t w, int16_t h, int16_t r, GfxColor color);
+int8_t gfx_fill_round_rect(LayoutPtr layout, uint8_t tile, int16_t x, int16_t y, int16_t w, int16_t h, int16_t r, GfxColor color);
+int8_t gfx_circle(LayoutPtr layout, uint8_t tile, int16_t cx, int16_t cy, int16_t r, GfxColor color);
+int8_t gfx_fill_circle(LayoutPtr layout, uint8_t tile, int16_t cx, int16_t cy, int16_t r, GfxColor color);
+
+// Fills the rectangle with an 8x8 pattern of column bytes (bit 0 on top),
+// anchored to the tile so adjacent fills line up
+int8_t gfx_fill_pattern(LayoutPtr layout, uint8_t tile, int16_t x, int16_t y, int16_t w, int16_t h,
+                        const uint8_t pattern[8]);
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "layout.h"
+
+// Temporal grayscale for a tile: pixels hold one of GRAY_LEVELS levels, and
+// each frame shows a bitplane in which a pixel of level L is lit in L of
+// GRAY_PHASES frames. Frames must follow each other at a steady, high rate
+// (`gray_step` paces them), and only the columns that differ from the previous
+// bitplane are sent.
+
+#define GRAY_LEVELS 4
+#define GRAY_PHASES 3
+
+typedef void * GrayPtr;
+
+typedef struct {
+    uint32_t frames;
+    uint32_t dropped;           // frame slots skipped because a frame ran late
+    uint32_t jitter_max_us;     // frame start past its slot
+    uint32_t jitter_mean_us;
+    uint32_t flush_max_us;
+    uint32_t flush_mean_us;
+} GrayStats;
+
+GrayPtr gray_create(LayoutPtr layout, uint8_t tile);
+void gray_free(GrayPtr gray);
+
+int8_t gray_clear(GrayPtr gray, uint8_t level);
+int8_t gray_set_pixel(GrayPtr gray, uint8_t x, uint8_t y, uint8_t level);
+// Draws 8-bit grayscale, keeping the top bits of each pixel
+int8_t gray_import(GrayPtr gray, int16_t x, int16_t y, const uint8_t *pixels,
+                   uint16_t width, uint16_t height, size_t stride);
+
+int8_t gray_set_rate(GrayPtr gray, uint16_t fps);
+// Waits for the next frame slot, then flushes the next bitplane
+int8_t gray_step(GrayPtr gray);
+int8_t gray_run(GrayPtr gray, uint32_t frames);
+
+void gray_get_stats(GrayPtr gray, GrayStats *stats);
+void gray_reset_stats(GrayPtr gray);
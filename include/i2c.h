@@ -1,7 +1,13 @@
 #pragma once
 
+#include <stddef.h>
+#include <stdint.h>
 #include <stdbool.h>
 
+// Largest payload `i2c_send` puts in a single transaction; longer writes are
+// split into chunks of this size, each with its own address and control byte.
+#define I2C_MAX_CHUNK 32
+
 bool i2c_init();
 bool i2c_send(uint8_t bus, uint8_t payload_type, const uint8_t *data, size_t len);
 bool i2c_close();
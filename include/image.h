@@ -0,0 +1,32 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "layout.h"
+
+// Import of row-major 1bpp images (PBM, XBM, camera thumbnails, QR modules)
+// into the page format of the panel. Conversion runs 8x8 bit-matrix transposes,
+// vectorized with SSE2 or AVX2 when the CPU has them.
+
+#define IMAGE_LSB_FIRST     0x01    // bit 0 of each byte is the leftmost pixel (XBM); default MSB first (PBM)
+#define IMAGE_INVERT        0x02    // 0 bits are lit
+
+typedef enum {
+    IMAGE_KERNEL_AUTO = 0,
+    IMAGE_KERNEL_PORTABLE = 1,
+    IMAGE_KERNEL_SSE2 = 2,
+    IMAGE_KERNEL_AVX2 = 3,
+} ImageKernel;
+
+// Converts 8 rows of `bytes` bytes each (rows `stride` apart, MSB first) into
+// bytes * 8 page bytes, one per pixel column, bit 0 from the first row
+void image_rows_to_page(const uint8_t *rows, size_t stride, size_t bytes, uint8_t *page);
+
+ImageKernel image_get_kernel(void);
+const char *image_kernel_name(ImageKernel kernel);
+// Forces a kernel; falls back to the best available one if the CPU lacks it
+void image_set_kernel(ImageKernel kernel);
+
+int8_t layout_import_image(LayoutPtr layout, uint8_t tile, int16_t x, int16_t y, const uint8_t *pixels,
+                           uint16_t width, uint16_t height, size_t stride, uint8_t flags);
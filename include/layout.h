@@ -1,9 +1,12 @@
 #pragma once
 
+#include <stddef.h>
 #include <stdint.h>
 #include <stdbool.h>
 
 #include "ssd1306-config.h"
+#include "panel.h"
+#include "font.h"
 
 typedef struct {
     uint8_t page;
@@ -21,11 +24,72 @@ typedef enum {
     FONT_16x8 = 1,
 } FontType;
 
+typedef enum {
+    LAYOUT_OK = 0,
+    LAYOUT_ERR_INVALID = -1,
+    LAYOUT_ERR_FULL = -2,
+    LAYOUT_ERR_OVERLAP = -3,
+    LAYOUT_ERR_INVALID_TILE = -4,
+    LAYOUT_ERR_INVALID_POINT = -5,
+    LAYOUT_ERR_INVALID_DATA = -6,
+    LAYOUT_ERR_FLUSH = -7,
+    LAYOUT_ERR_OTHER = -8,
+} LayoutError;
+
+#define LAYOUT_MAX_SCALE 4
+
+typedef enum {
+    LAYOUT_ROTATE_0 = 0,
+    LAYOUT_ROTATE_90 = 1,       // clockwise
+    LAYOUT_ROTATE_180 = 2,
+    LAYOUT_ROTATE_270 = 3,
+} LayoutRotation;
+
 typedef void * LayoutPtr;
 typedef bool (*write_f)(const uint8_t *data, size_t len);
 
+// Static layouts: layout_init sets a layout up in storage the caller provides,
+// e.g. a static LayoutStorage, and allocates nothing (only layout_set_deferred
+// does, later). The storage reserves LAYOUT_STORAGE_SIZE bytes, fixed by
+// ssd1306-config.h:
+//
+//   pixels  the N_PAGES x N_COLUMNS framebuffer (512 bytes), or with
+//           LAYOUT_TILE_STORE that many bytes, of which each tile takes its
+//           width x pages; the panel outside tiles then costs nothing
+//   view    another N_PAGES x N_COLUMNS with LAYOUT_ROTATION, 1 byte without
+//   tiles   LAYOUT_MAX_TILES x (LAYOUT_TEXT_BYTES + LAYOUT_TILE_OVERHEAD), the
+//           text bytes being 6 a glyph rounded up to a multiple of 8, as the
+//           struct holding them is padded
+//   rest    LAYOUT_FIXED_OVERHEAD
+//
+// The overheads hold the rest of a tile and of the layout with pointers of up
+// to 8 bytes, and the build checks that the sum holds a Layout. With 8 byte
+// pointers the tiles take exactly their share and a Layout is less than 32
+// bytes smaller than the sum; 32-bit targets use less of both overheads. The
+// defaults reserve 512 + 512 + 8 x (384 + 64) + 128 = 4736 bytes. Two 64x16
+// tiles remembering 16 glyphs each, without rotation and with a 256 byte tile
+// store, reserve 256 + 1 + 2 x (96 + 64) + 128 = 705.
+//
+// A tile store cannot be rotated by 90/270 degrees, composited or persisted,
+// as those work on the whole framebuffer.
+#define LAYOUT_TILE_OVERHEAD    64
+#define LAYOUT_FIXED_OVERHEAD   128
+#define LAYOUT_TEXT_BYTES       ((6 * LAYOUT_TEXT_GLYPHS + 7) / 8 * 8)
+#define LAYOUT_PIXEL_BYTES      (LAYOUT_TILE_STORE > 0 ? LAYOUT_TILE_STORE : N_PAGES * N_COLUMNS)
+#define LAYOUT_VIEW_BYTES       (LAYOUT_ROTATION ? N_PAGES * N_COLUMNS : 1)
+#define LAYOUT_STORAGE_SIZE     (LAYOUT_PIXEL_BYTES + LAYOUT_VIEW_BYTES + LAYOUT_FIXED_OVERHEAD \
+                                 + LAYOUT_MAX_TILES * (LAYOUT_TEXT_BYTES + LAYOUT_TILE_OVERHEAD))
+
+typedef union {
+    uint8_t bytes[LAYOUT_STORAGE_SIZE];
+    uint64_t align;
+    void *align_ptr;
+} LayoutStorage;
+
 LayoutPtr layout_create(write_f write);
+LayoutPtr layout_init(LayoutStorage *storage, write_f write);
 void layout_free(LayoutPtr layout);
+int8_t layout_set_panel(LayoutPtr layout, const PanelProfile *panel);
 
 int8_t layout_add_tile(LayoutPtr layout, Point *start, Point *end);
 int8_t layout_edit_tile(LayoutPtr layout, uint8_t tile, Point *tile_point, uint8_t *data, uint8_t len);
@@ -36,5 +100,11 @@ uint8_t layout_get_tile_width(LayoutPtr layout, uint8_t tile);
 uint8_t layout_get_tile_height(LayoutPtr layout, uint8_t tile);
 
 int8_t layout_print(LayoutPtr layout, uint8_t tile, uint8_t *text, uint8_t len, FontType font);
+int8_t layout_print_face(LayoutPtr layout, uint8_t tile, const uint8_t *text, size_t len, const FontFace *face);
+int8_t layout_print_scaled(LayoutPtr layout, uint8_t tile, const uint8_t *text, size_t len, const FontFace *face, uint8_t scale);
+int8_t layout_print_number(LayoutPtr layout, uint8_t tile, int32_t value, uint8_t digits, const FontFace *face);
 int8_t layout_flush(LayoutPtr layout);
+int8_t layout_set_double_buffer(LayoutPtr layout, bool enable);
+int8_t layout_set_deferred(LayoutPtr layout, uint8_t tile, bool enable);
+int8_t layout_set_orientation(LayoutPtr layout, LayoutRotation rotation, bool mirror);
 int8_t layout_clear(LayoutPtr layout, uint8_t fill);
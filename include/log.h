@@ -0,0 +1,89 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+
+#include "ssd1306-config.h"
+
+// Binary trace logger. Call sites only copy a fixed-size record into a
+// lock-free ring buffer; formatting happens later, in log_drain, which can run
+// from a background thread or at exit. Levels above LOG_LEVEL compile to nothing.
+
+#define LOG_LEVEL_NONE      0
+#define LOG_LEVEL_ERROR     1
+#define LOG_LEVEL_WARN      2
+#define LOG_LEVEL_INFO      3
+#define LOG_LEVEL_DEBUG     4
+#define LOG_LEVEL_TRACE     5
+
+#ifndef LOG_LEVEL
+#define LOG_LEVEL LOG_LEVEL_ERROR
+#endif
+
+#ifndef LOG_RING_SIZE
+#define LOG_RING_SIZE 256   // records, power of two
+#endif
+
+#define LOG_PAYLOAD_SIZE 32
+
+typedef enum {
+    LOG_CAT_I2C = 0,
+    LOG_CAT_UDP = 1,
+    LOG_CAT_SSD1306 = 2,
+    LOG_CAT_LAYOUT = 3,
+    LOG_CAT_APP = 4,
+    LOG_CAT_COUNT,
+} LogCategory;
+
+#define LOG_CAT_ALL ((1u << LOG_CAT_COUNT) - 1)
+
+typedef struct {
+    uint32_t seq;               // ring slot sequence, owned by the ring buffer
+    uint32_t timestamp_us;
+    const char *message;        // static string, formatted at drain time
+    int32_t arg;
+    uint8_t level;
+    uint8_t category;
+    uint16_t size;              // original payload length, may exceed LOG_PAYLOAD_SIZE
+    uint8_t payload[LOG_PAYLOAD_SIZE];
+} LogRecord;
+
+void log_set_categories(uint32_t mask);
+void log_set_level(uint8_t level);
+bool log_enabled(uint8_t level, LogCategory category);
+
+void log_write(uint8_t level, LogCategory category, const char *message, int32_t arg, const uint8_t *payload, size_t size);
+size_t log_drain(FILE *out, size_t max_records);
+uint32_t log_dropped();
+
+#if LOG_LEVEL >= LOG_LEVEL_ERROR
+#define LOG_ERROR(cat, msg, arg) log_write(LOG_LEVEL_ERROR, (cat), (msg), (int32_t)(arg), NULL, 0)
+#else
+#define LOG_ERROR(cat, msg, arg) ((void)0)
+#endif
+
+#if LOG_LEVEL >= LOG_LEVEL_WARN
+#define LOG_WARN(cat, msg, arg) log_write(LOG_LEVEL_WARN, (cat), (msg), (int32_t)(arg), NULL, 0)
+#else
+#define LOG_WARN(cat, msg, arg) ((void)0)
+#endif
+
+#if LOG_LEVEL >= LOG_LEVEL_INFO
+#define LOG_INFO(cat, msg, arg) log_write(LOG_LEVEL_INFO, (cat), (msg), (int32_t)(arg), NULL, 0)
+#else
+#define LOG_INFO(cat, msg, arg) ((void)0)
+#endif
+
+#if LOG_LEVEL >= LOG_LEVEL_DEBUG
+#define LOG_DEBUG(cat, msg, arg) log_write(LOG_LEVEL_DEBUG, (cat), (msg), (int32_t)(arg), NULL, 0)
+#else
+#define LOG_DEBUG(cat, msg, arg) ((void)0)
+#endif
+
+#if LOG_LEVEL >= LOG_LEVEL_TRACE
+#define LOG_TRACE_BYTES(cat, msg, arg, data, len) log_write(LOG_LEVEL_TRACE, (cat), (msg), (int32_t)(arg), (data), (len))
+#else
+#define LOG_TRACE_BYTES(cat, msg, arg, data, len) ((void)0)
+#endif
@@ -0,0 +1,24 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+// Thin memory-mapped file wrapper (POSIX mmap / Win32 file mappings).
+
+typedef struct {
+    void *addr;
+    size_t size;
+#ifdef _WIN32
+    void *file;
+    void *mapping;
+#else
+    int fd;
+#endif
+} MapFile;
+
+// size == 0 maps the whole existing file; otherwise the file is created or
+// resized to `size` (writable mappings only).
+bool mapfile_open(MapFile *map, const char *path, size_t size, bool writable);
+bool mapfile_sync(MapFile *map);
+void mapfile_close(MapFile *map);
@@ -0,0 +1,33 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "ssd1306-config.h"
+
+#define PANEL_FLAG_PAGE_ADDRESSING_ONLY 0x01    // no horizontal/vertical addressing (SH1106)
+
+#define PANEL_RAM_PAGES 8                       // GDDRAM pages of the SSD1306 and SH1106, shown or not
+
+typedef struct {
+    const char *name;
+    uint8_t width;              // visible columns
+    uint8_t pages;              // visible pages (height / 8)
+    uint8_t column_offset;      // GDDRAM column of the first visible column
+    uint8_t ram_columns;        // GDDRAM columns of the controller
+    uint8_t multiplex;
+    uint8_t display_offset;
+    uint8_t flags;
+    uint8_t addressing_mode;    // addressing mode the init sequence leaves the controller in
+    uint8_t contrast;           // contrast the init sequence sets
+    const uint8_t *init;        // pre-encoded command stream, sent as one transfer
+    uint8_t init_len;
+} PanelProfile;
+
+extern const PanelProfile panel_128x32;
+extern const PanelProfile panel_128x64;
+extern const PanelProfile panel_72x40;
+extern const PanelProfile panel_sh1106_132x64;
+
+const PanelProfile *panel_find(const char *name);
+bool panel_init(const PanelProfile *profile, bool clear);
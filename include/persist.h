@@ -0,0 +1,18 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "layout.h"
+
+// Warm restart. The layout mirrors what the panel GDDRAM holds, plus its tiles
+// and controller state, into a small memory-mapped state file. A restarted
+// process that finds a matching file adopts it instead of reinitializing and
+// repainting the panel, and from then on flushes only what differs.
+
+#define LAYOUT_STATE_FRESH      0   // new or mismatched file: init and clear the panel as usual
+#define LAYOUT_STATE_ADOPTED    1   // panel still shows the persisted frame: skip init and clear
+
+// Call after layout_set_panel. Tiles are restored from the file only when the
+// layout has none yet.
+int8_t layout_attach_state(LayoutPtr layout, const char *path);
+void layout_detach_state(LayoutPtr layout);
@@ -0,0 +1,31 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "layout.h"
+
+// LRU cache of rendered text: a (font, scale, text) key maps to the column
+// strip the text renders to, so printing a string seen before is a copy.
+// One cache can serve any number of layouts; entries are evicted least
+// recently used first to stay under the memory cap.
+
+typedef void * SpanCachePtr;
+
+typedef struct {
+    uint32_t hits;
+    uint32_t misses;
+    uint32_t evictions;
+    uint32_t entries;
+    size_t bytes;               // held by entries, including their headers
+    size_t max_bytes;
+} SpanCacheStats;
+
+SpanCachePtr span_cache_create(size_t max_bytes);
+void span_cache_free(SpanCachePtr cache);
+// Must be called before a face the cache has seen is freed, e.g. on fontpack_close
+void span_cache_clear(SpanCachePtr cache);
+void span_cache_get_stats(SpanCachePtr cache, SpanCacheStats *stats);
+void span_cache_reset_stats(SpanCachePtr cache);
+
+int8_t layout_set_span_cache(LayoutPtr layout, SpanCachePtr cache);
@@ -5,10 +5,29 @@
 
 #define USE_UDP     false
 
+// Layout memory; layout.h lists what each setting costs
+#define LAYOUT_MAX_TILES    8       // 1 to 32: cost_layout_flush selects tiles with a 32-bit mask
+#define LAYOUT_TEXT_GLYPHS  64      // glyphs a tile remembers so a reprint redraws only what changed (1 to 255)
+#define LAYOUT_ROTATION     true    // false: no 90/270 degree rotation, and no view buffer for it
+#define LAYOUT_TILE_STORE   0       // > 0: keep only the tiles' pixels, in this many bytes, instead of a framebuffer
+
+// Highest log level compiled in (see log.h); LOG_LEVEL_NONE removes all call sites.
+// LOG_LEVEL_TRACE is for debugging: it copies every bus transfer into the ring.
+#ifndef LOG_LEVEL
+#define LOG_LEVEL   LOG_LEVEL_ERROR
+#endif
+#define LOG_RING_SIZE 256
+
 #ifndef __weak
 #ifdef __GNUC__
 #define __weak __attribute__((weak))
 #else
 #define __weak
 #endif
-#endif
\ No newline at end of file
+#endif
+
+#ifndef STATIC_ASSERT
+#define STATIC_ASSERT_CAT_(a, b) a##b
+#define STATIC_ASSERT_CAT(a, b) STATIC_ASSERT_CAT_(a, b)
+#define STATIC_ASSERT(cond, name) typedef char STATIC_ASSERT_CAT(static_assert_##name##_, __LINE__)[(cond) ? 1 : -1]
+#endif
@@ -32,7 +32,38 @@
 #define SSD1306_OPTION_COM_SCAN_DIR_NORMAL          0x0
 #define SSD1306_OPTION_COM_SCAN_DIR_REVERSE         0x8
 
+// Compile-time encoders for command sequences sent with ssd1306_send_commands.
+// Argument masks match the command tables in ssd1306.c.
+#define SSD1306_CMD_SET_CONTRAST(contrast)              0x81, ((contrast) & 0xFF)
+#define SSD1306_CMD_SET_DISPLAY(option)                 (0xA4 | ((option) & 0x0B))
+#define SSD1306_CMD_SCROLL_HORIZONTAL(option, first, interval, last) \
+                                                        (0x26 | ((option) & 0x01)), 0x00, ((first) & 0x07), ((interval) & 0x07), ((last) & 0x07), 0x00, 0xFF
+#define SSD1306_CMD_CONTENT_SCROLL(option, first, last, start, end) \
+                                                        (0x2C | ((option) & 0x01)), 0x00, ((first) & 0x07), 0x01, ((last) & 0x07), ((start) & 0x7F), ((end) & 0x7F)
+#define SSD1306_CMD_DEACTIVATE_SCROLL                   0x2E
+#define SSD1306_CMD_ACTIVATE_SCROLL                     0x2F
+#define SSD1306_CMD_SET_MEMORY_ADDRESSING_MODE(mode)    0x20, ((mode) & 0x03)
+#define SSD1306_CMD_PA_MODE_SET_PAGE_ADDR(page)         (0xB0 | ((page) & 0x07))
+#define SSD1306_CMD_PA_MODE_SET_COLUMN_ADDR_LOW(column) (0x00 | ((column) & 0x0F))
+#define SSD1306_CMD_PA_MODE_SET_COLUMN_ADDR_HIGH(column) (0x10 | (((column) >> 4) & 0x0F))
+#define SSD1306_CMD_HAVA_MODE_SET_PAGE_ADDR(start, end) 0x22, ((start) & 0x07), ((end) & 0x07)
+#define SSD1306_CMD_HAVA_MODE_SET_COLUMN_ADDR(start, end) 0x21, ((start) & 0x7F), ((end) & 0x7F)
+#define SSD1306_CMD_SET_START_LINE(line)                (0x40 | ((line) & 0x3F))
+#define SSD1306_CMD_SET_SEGMENT_REMAP(option)           (0xA0 | ((option) & 0x01))
+#define SSD1306_CMD_SET_MULTIPLEX(multiplex)            0xA8, ((multiplex) & 0x3F)
+#define SSD1306_CMD_SET_COM_OUTPUT_SCAN_DIR(option)     (0xC0 | ((option) & 0x08))
+#define SSD1306_CMD_SET_DISPLAY_OFFSET(offset)          0xD3, ((offset) & 0x3F)
+#define SSD1306_CMD_SET_COM_PINS(pins)                  0xDA, ((((pins) & 0x03) << 4) | 0x02)
+#define SSD1306_CMD_SET_DISPLAY_CLOCK_DIV_RATIO(ratio)  0xD5, ((ratio) & 0xFF)
+#define SSD1306_CMD_SET_PRECHARGE_PERIOD(period)        0xD9, ((period) & 0xFF)
+#define SSD1306_CMD_SET_VCOM_DESELECT_LEVEL(level)      0xDB, (((level) & 0x07) << 4)
+#define SSD1306_CMD_CHARGE_PUMP(pump)                   0x8D, ((((pump) & 0x01) << 2) | 0x10)
+
+// SH1106 has a DC-DC converter control (ADh) in place of the charge pump
+#define SH1106_CMD_DCDC(on)                             0xAD, (0x8A | ((on) & 0x01))
+
 bool ssd1306_send_data(const uint8_t *data, size_t len);
+bool ssd1306_send_commands(const uint8_t *cmds, size_t len);
 
 // # Fundamental commands
 bool ssd1306_set_contrast(uint8_t contrast);
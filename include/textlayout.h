@@ -0,0 +1,46 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "layout.h"
+#include "font.h"
+
+// Text layout: measures text from the font width tables and breaks it into
+// lines before anything is drawn, so a tile is rendered once at the final
+// positions. Lines are a whole number of glyph heights tall.
+
+#define TEXT_MAX_LINES 8
+
+typedef enum {
+    TEXT_ALIGN_LEFT = 0,
+    TEXT_ALIGN_CENTER = 1,
+    TEXT_ALIGN_RIGHT = 2,
+} TextAlign;
+
+#define TEXT_WRAP       0x01    // break lines at spaces (else only at '\n')
+#define TEXT_ELLIPSIS   0x02    // end truncated lines with an ellipsis
+
+typedef struct {
+    uint16_t start;             // byte offsets into the text, end exclusive
+    uint16_t end;
+    uint8_t x;                  // first column after alignment
+    uint8_t width;              // columns, including the ellipsis
+    bool ellipsis;
+} TextLine;
+
+typedef struct {
+    uint8_t num_lines;
+    bool truncated;             // text did not fit: lines were cut or dropped
+    TextLine lines[TEXT_MAX_LINES];
+} TextLayout;
+
+int8_t text_measure(const FontFace *face, uint8_t scale, const uint8_t *text, size_t len, uint16_t *width);
+int8_t text_layout(const FontFace *face, uint8_t scale, const uint8_t *text, size_t len,
+                   uint8_t width, uint8_t max_lines, TextAlign align, uint8_t flags, TextLayout *out);
+
+int8_t layout_render_text(LayoutPtr layout, uint8_t tile, const uint8_t *text, size_t len,
+                          const TextLayout *lines, const FontFace *face, uint8_t scale);
+int8_t layout_print_text(LayoutPtr layout, uint8_t tile, const uint8_t *text, size_t len,
+                         const FontFace *face, uint8_t scale, TextAlign align, uint8_t flags);
@@ -0,0 +1,7 @@
+#pragma once
+
+#include <stdint.h>
+
+// Monotonic clock in microseconds, used for log timestamps and frame pacing.
+uint64_t timing_now_us();
+void timing_sleep_until_us(uint64_t deadline_us);
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "layout.h"
+#include "font.h"
+#include "textlayout.h"
+
+// Retained widgets drawn into a tile. A tree hangs off a root container that
+// covers the tile; each widget keeps its properties and its box in tile
+// pixels. Changing a property that shows invalidates the widget's box, and
+// widget_render redraws the invalidated regions once, in z-order (parents
+// below their children, later siblings above earlier ones). Only the bytes
+// that actually changed are marked for the next layout_flush.
+//
+// Positions are pixels relative to the parent. Containers draw nothing; moving
+// or hiding one moves or hides everything in it. Icon bitmaps are page-planar
+// like blit bitmaps and are not copied; call widget_invalidate after changing
+// one in place.
+
+#define WIDGET_MAX_TEXT     32      // label text bytes
+#define WIDGET_MAX_DAMAGE   8       // invalidated regions kept apart, more are merged
+
+typedef void * WidgetPtr;
+
+typedef enum {
+    WIDGET_CONTAINER = 0,
+    WIDGET_LABEL = 1,
+    WIDGET_NUMBER = 2,
+    WIDGET_PROGRESS = 3,
+    WIDGET_ICON = 4,
+} WidgetType;
+
+WidgetPtr widget_create_root(LayoutPtr layout, uint8_t tile);
+WidgetPtr widget_create_container(WidgetPtr parent, int16_t x, int16_t y, uint8_t width, uint8_t height);
+WidgetPtr widget_create_label(WidgetPtr parent, int16_t x, int16_t y, uint8_t width, uint8_t height,
+                              const FontFace *face, TextAlign align);
+// Shows a number right-aligned in a field of `digits` characters
+WidgetPtr widget_create_number(WidgetPtr parent, int16_t x, int16_t y, uint8_t width, uint8_t height,
+                               const FontFace *face, uint8_t digits);
+WidgetPtr widget_create_progress(WidgetPtr parent, int16_t x, int16_t y, uint8_t width, uint8_t height,
+                                 int32_t min, int32_t max);
+WidgetPtr widget_create_icon(WidgetPtr parent, int16_t x, int16_t y, const uint8_t *bitmap,
+                             uint8_t width, uint8_t height);
+// Frees the widget and everything in it; freeing the root frees the tree
+void widget_free(WidgetPtr widget);
+
+WidgetType widget_get_type(WidgetPtr widget);
+int8_t widget_set_text(WidgetPtr widget, const uint8_t *text, size_t len);
+int8_t widget_set_value(WidgetPtr widget, int32_t value);
+int8_t widget_set_bitmap(WidgetPtr widget, const uint8_t *bitmap);
+int8_t widget_set_visible(WidgetPtr widget, bool visible);
+int8_t widget_move(WidgetPtr widget, int16_t x, int16_t y);
+int8_t widget_invalidate(WidgetPtr widget);
+
+// Redraws what the tree invalidated since the last pass; takes any widget of the tree
+int8_t widget_render(WidgetPtr widget);
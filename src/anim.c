@@ -0,0 +1,280 @@
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include "anim.h"
+#include "layout.h"
+#include "layout-internal.h"
+#include "mapfile.h"
+#include "timing.h"
+#include "log.h"
+
+#define ANIM_MAGIC              "SANM"
+#define ANIM_VERSION            1
+#define ANIM_HEADER_SIZE        16
+#define ANIM_INDEX_ENTRY_SIZE   8
+#define ANIM_FLAG_KEYFRAME      0x01
+#define ANIM_END_OF_FRAME       0xFF
+#define ANIM_NO_FRAME           UINT32_MAX
+
+// File layout, little-endian:
+//   header  magic[4] version:u16 pages:u8 columns:u8 num_frames:u32 index_offset:u32
+//   index   per frame: offset:u32 delay_ms:u16 flags:u8 reserved:u8
+//   frame   runs of page:u8 column:u8 width:u8 + RLE data, ended by page 0xFF
+//   RLE     control c < 0x80: c + 1 literal bytes follow;
+//           c >= 0x80: the next byte repeats c - 0x7E times
+
+typedef struct {
+    MapFile map;
+    const uint8_t *base;
+    const uint8_t *index;
+    uint32_t num_frames;
+    uint8_t pages;
+    uint8_t columns;
+    const Tile *tile;           // where `shown` is on screen
+    uint32_t shown;
+} Anim;
+
+typedef struct {
+    uint8_t page;
+    uint8_t column;
+    uint8_t width;
+} AnimRun;
+
+static uint16_t an_u16(const uint8_t *p) {
+    return (uint16_t)(p[0] | (p[1] << 8));
+}
+
+static uint32_t an_u32(const uint8_t *p) {
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static inline const uint8_t *an_entry(Anim *anim, uint32_t frame) {
+    return anim->index + (size_t)frame * ANIM_INDEX_ENTRY_SIZE;
+}
+
+AnimPtr anim_open(const char *path) {
+    MapFile map;
+    if (!mapfile_open(&map, path, 0, false)) {
+        errno = ENOENT;
+        LOG_ERROR(LOG_CAT_APP, "Failed to map animation", errno);
+        return NULL;
+    }
+    const uint8_t *base = (const uint8_t *)map.addr;
+    uint32_t num_frames = map.size >= ANIM_HEADER_SIZE ? an_u32(base + 8) : 0;
+    uint32_t index = map.size >= ANIM_HEADER_SIZE ? an_u32(base + 12) : 0;
+    if (map.size < ANIM_HEADER_SIZE || memcmp(base, ANIM_MAGIC, 4) != 0 || an_u16(base + 4) != ANIM_VERSION
+            || base[6] == 0 || base[7] == 0 || num_frames == 0 || index > map.size
+            || (map.size - index) / ANIM_INDEX_ENTRY_SIZE < num_frames) {
+        errno = EINVAL;
+        LOG_ERROR(LOG_CAT_APP, "Not an animation", errno);
+        mapfile_close(&map);
+        return NULL;
+    }
+    Anim *anim = calloc(1, sizeof(Anim));
+    if (anim == NULL) {
+        errno = ENOMEM;
+        LOG_ERROR(LOG_CAT_APP, "Failed to allocate memory for animation", errno);
+        mapfile_close(&map);
+        return NULL;
+    }
+    anim->map = map;
+    anim->base = base;
+    anim->index = base + index;
+    anim->num_frames = num_frames;
+    anim->pages = base[6];
+    anim->columns = base[7];
+    anim->shown = ANIM_NO_FRAME;
+    for (uint32_t i = 0; i < num_frames; i++) {
+        if (an_u32(an_entry(anim, i)) >= map.size) {
+            errno = EINVAL;
+            LOG_ERROR(LOG_CAT_APP, "Corrupt animation index", i);
+            anim_close(anim);
+            return NULL;
+        }
+    }
+    if (!(an_entry(anim, 0)[6] & ANIM_FLAG_KEYFRAME)) {
+        errno = EINVAL;
+        LOG_ERROR(LOG_CAT_APP, "Animation does not start with a keyframe", errno);
+        anim_close(anim);
+        return NULL;
+    }
+    return anim;
+}
+
+void anim_close(AnimPtr anim_) {
+    Anim *anim = (Anim *)anim_;
+    if (anim != NULL) {
+        mapfile_close(&anim->map);
+        free(anim);
+    }
+}
+
+uint32_t anim_get_num_frames(AnimPtr anim) {
+    return anim != NULL ? ((Anim *)anim)->num_frames : 0;
+}
+
+uint8_t anim_get_width(AnimPtr anim) {
+    return anim != NULL ? ((Anim *)anim)->columns : 0;
+}
+
+uint8_t anim_get_height(AnimPtr anim) {
+    return anim != NULL ? ((Anim *)anim)->pages : 0;
+}
+
+uint16_t anim_get_delay_ms(AnimPtr anim_, uint32_t frame) {
+    Anim *anim = (Anim *)anim_;
+    if (anim == NULL || frame >= anim->num_frames) {
+        return 0;
+    }
+    return an_u16(an_entry(anim, frame) + 4);
+}
+
+// Decodes the next run of a frame record into the tile. Returns false at the
+// end of the record; sets *ok = false on a malformed one.
+static bool an_next_run(Anim *anim, Layout *layout, Tile *tile, const uint8_t **pos, AnimRun *run, bool *ok) {
+    const uint8_t *p = *pos;
+    const uint8_t *end = anim->base + anim->map.size;
+    *ok = p < end;
+    if (!*ok || *p == ANIM_END_OF_FRAME) {
+        return false;
+    }
+    if (end - p < 3 || p[0] >= anim->pages || p[2] == 0 || p[1] + p[2] > anim->columns) {
+        *ok = false;
+        return false;
+    }
+    run->page = p[0];
+    run->column = p[1];
+    run->width = p[2];
+    p += 3;
+    uint8_t *dst = lt_tile_row(layout, tile, run->page) + run->column;
+    uint8_t n = 0;
+    while (n < run->width) {
+        if (p >= end) {
+            *ok = false;
+            return false;
+        }
+        uint8_t c = *p++;
+        uint8_t count = c < 0x80 ? c + 1 : c - 0x7E;
+        if (count > run->width - n || end - p < (c < 0x80 ? count : 1)) {
+            *ok = false;
+            return false;
+        }
+        if (c < 0x80) {
+            memcpy(dst + n, p, count);
+            p += count;
+        } else {
+            memset(dst + n, *p++, count);
+        }
+        n += count;
+    }
+    *pos = p;
+    return true;
+}
+
+static bool an_apply(Anim *anim, Layout *layout, Tile *tile, uint32_t frame, FlushVisitor *visitor) {
+    const uint8_t *pos = anim->base + an_u32(an_entry(anim, frame));
+    AnimRun run;
+    bool ok;
+    while (an_next_run(anim, layout, tile, &pos, &run, &ok)) {
+        if (visitor != NULL) {
+            Point start = {tile->start.page + run.page, tile->start.column + run.column};
+            Point end = {start.page, (uint8_t)(start.column + run.width - 1)};
+            if (!lt_plan_window(layout, &start, &end, visitor)) {
+                errno = EIO;
+                return false;
+            }
+        }
+    }
+    if (!ok) {
+        errno = EINVAL;
+        LOG_ERROR(LOG_CAT_APP, "Corrupt animation frame", frame);
+    }
+    return ok;
+}
+
+int8_t anim_show_frame(AnimPtr anim_, LayoutPtr layout_, uint8_t tile, uint32_t frame) {
+    Anim *anim = (Anim *)anim_;
+    Layout *layout = (Layout *)layout_;
+    if (anim == NULL || layout == NULL || frame >= anim->num_frames) {
+        errno = EINVAL;
+        LOG_ERROR(LOG_CAT_LAYOUT, "Invalid animation frame", frame);
+        return LAYOUT_ERR_INVALID;
+    }
+    if (tile >= layout->num_tiles) {
+        errno = EINVAL;
+        LOG_ERROR(LOG_CAT_LAYOUT, "Invalid tile index", errno);
+        return LAYOUT_ERR_INVALID_TILE;
+    }
+    Tile *t = &layout->tiles[tile];
+    if (tile_get_height(t) < anim->pages || tile_get_width(t) < anim->columns) {
+        errno = EINVAL;
+        LOG_ERROR(LOG_CAT_LAYOUT, "Animation larger than the tile", tile);
+        return LAYOUT_ERR_INVALID_TILE;
+    }
+    bool next = anim->tile == t && anim->shown != ANIM_NO_FRAME && frame == anim->shown + 1;
+    anim->shown = ANIM_NO_FRAME;
+    // RAM writes are forbidden while the controller scrolls: a scroll running
+    // or wanted takes layout_flush, which stops it first. A tile with a prepare
+    // hook (a console) takes it too, so the hook sees the tile marked.
+    if (next && !tile_isdirty(t) && !lt_defer_pending(t) && t->prepare == NULL
+        && layout->state == NULL && !layout->double_buffer && !layout->transposed
+        && layout->segment_remap == layout->controller.segment_remap
+        && !layout->scroll.active && !layout->controller.scroll.active) {
+        // The panel shows the previous frame: send the delta's runs as they decode
+        FlushVisitor visitor;
+        lt_panel_visitor(layout, &visitor);
+        bool ok = an_apply(anim, layout, t, frame, &visitor);
+        layout->controller.addressing = ok ? visitor.addressing : LT_ADDRESSING_UNKNOWN;
+        if (!ok) {
+            tile_setdirty(t, true);
+            return errno == EIO ? LAYOUT_ERR_FLUSH : LAYOUT_ERR_INVALID_DATA;
+        }
+        t->text.face = NULL;
+    } else {
+        uint32_t from = frame;
+        if (!next) {
+            while (from > 0 && !(an_entry(anim, from)[6] & ANIM_FLAG_KEYFRAME)) {
+                from--;
+            }
+        }
+        for (uint32_t i = from; i <= frame; i++) {
+            if (!an_apply(anim, layout, t, i, NULL)) {
+                tile_setdirty(t, true);
+                return LAYOUT_ERR_INVALID_DATA;
+            }
+        }
+        tile_mark_rect(t, 0, anim->pages - 1, 0, anim->columns - 1);
+        int8_t ret = layout_flush(layout);
+        if (ret != LAYOUT_OK) {
+            return ret;
+        }
+    }
+    anim->tile = t;
+    anim->shown = frame;
+    return LAYOUT_OK;
+}
+
+int8_t anim_play(AnimPtr anim_, LayoutPtr layout, uint8_t tile, uint32_t loops) {
+    Anim *anim = (Anim *)anim_;
+    if (anim == NULL) {
+        errno = EINVAL;
+        LOG_ERROR(LOG_CAT_LAYOUT, "Animation is NULL", errno);
+        return LAYOUT_ERR_INVALID;
+    }
+    uint64_t deadline = timing_now_us();
+    for (uint32_t loop = 0; loops == 0 || loop < loops; loop++) {
+        for (uint32_t frame = 0; frame < anim->num_frames; frame++) {
+            int8_t ret = anim_show_frame(anim, layout, tile, frame);
+            if (ret != LAYOUT_OK) {
+                return ret;
+            }
+            deadline += (uint64_t)anim_get_delay_ms(anim, frame) * 1000;
+            timing_sleep_until_us(deadline);
+        }
+    }
+    return LAYOUT_OK;
+}
@@ -0,0 +1,287 @@
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include "blit.h"
+#include "layout.h"
+#include "layout-internal.h"
+#include "font.h"
+#include "log.h"
+
+// A glyph shifted down by `shift` pixels covers pages + 1 destination pages.
+// planes[q] is what goes into destination page q, mask[q] the bits it covers.
+typedef struct {
+    const FontFace *face;           // NULL: empty slot
+    uint32_t c;
+    uint8_t shift;
+    uint8_t width;
+    uint8_t mask[9];
+    uint8_t planes[9][GLYPH_CACHE_MAX_COLUMNS];
+} GlyphCacheEntry;
+
+struct GlyphCache {
+    uint16_t num_entries;
+    GlyphCacheEntry entries[];
+};
+
+#define LT_OP_OR(d, s, m)       (d) |= (s)
+#define LT_OP_SET(d, s, m)      (d) = (uint8_t)(((d) & ~(m)) | (s))
+#define LT_OP_XOR(d, s, m)      (d) ^= (s)
+#define LT_OP_CLEAR(d, s, m)    (d) &= (uint8_t)~(s)
+
+// One source page byte shifted into a 16-bit word spans the two destination
+// pages it lands on; the low byte goes to `lo`, the high byte to `hi`.
+#define LT_BLIT_ROW(OP)                                                     \
+    for (uint8_t i = 0; i < n; i++) {                                       \
+        uint16_t s = (uint16_t)(src[i] & mask) << shift;                    \
+        if (lo != NULL) {                                                   \
+            OP(lo[i], (uint8_t)s, (uint8_t)m);                              \
+        }                                                                   \
+        if (hi != NULL) {                                                   \
+            OP(hi[i], (uint8_t)(s >> 8), (uint8_t)(m >> 8));                \
+        }                                                                   \
+    }
+
+static void lt_blit_row(uint8_t *lo, uint8_t *hi, const uint8_t *src, uint8_t n,
+                        uint8_t mask, uint8_t shift, BlitOp op) {
+    uint16_t m = (uint16_t)mask << shift;
+    switch (op) {
+        case BLIT_OR:
+            LT_BLIT_ROW(LT_OP_OR);
+            break;
+        case BLIT_SET:
+            LT_BLIT_ROW(LT_OP_SET);
+            break;
+        case BLIT_XOR:
+            LT_BLIT_ROW(LT_OP_XOR);
+            break;
+        case BLIT_CLEAR:
+            LT_BLIT_ROW(LT_OP_CLEAR);
+            break;
+    }
+}
+
+// Splits a pixel row into the page it falls in and the offset within it,
+// rounding towards minus infinity so rows above the tile clip correctly.
+static inline int16_t lt_page_of(int16_t y, uint8_t *shift) {
+    int16_t page = y >= 0 ? y / 8 : -((7 - y) / 8);
+    *shift = (uint8_t)(y - page * 8);
+    return page;
+}
+
+static inline uint8_t *lt_dest_row(Layout *layout, Tile *t, int16_t page, int16_t column) {
+    if (page < 0 || page >= tile_get_height(t)) {
+        return NULL;
+    }
+    return lt_tile_row(layout, t, (uint8_t)page) + column;
+}
+
+// Draws columns [c0, c1) of a page-planar bitmap whose column 0 lands at tile
+// column x and whose top row lands at tile row y.
+static void lt_blit(Layout *layout, Tile *t, int16_t x, int16_t y, const uint8_t *src, size_t stride,
+                    uint8_t c0, uint8_t c1, uint8_t height, BlitOp op) {
+    uint8_t shift;
+    int16_t page0 = lt_page_of(y, &shift);
+    uint8_t pages = (height + 7) / 8;
+    for (uint8_t p = 0; p < pages; p++) {
+        uint8_t mask = p == pages - 1 && height % 8 ? (uint8_t)((1u << (height % 8)) - 1) : 0xFF;
+        uint8_t *lo = lt_dest_row(layout, t, page0 + p, x + c0);
+        uint8_t *hi = shift ? lt_dest_row(layout, t, page0 + p + 1, x + c0) : NULL;
+        if (lo != NULL || hi != NULL) {
+            lt_blit_row(lo, hi, src + p * stride + c0, c1 - c0, mask, shift, op);
+        }
+    }
+}
+
+// Clips the columns of a `width` wide bitmap at tile column x; false if nothing is left
+static bool lt_clip_columns(Tile *t, int16_t x, uint8_t width, uint8_t *c0, uint8_t *c1) {
+    int16_t w = tile_get_width(t);
+    int16_t from = x < 0 ? -x : 0;
+    int16_t to = x + width > w ? w - x : width;
+    if (from >= to) {
+        return false;
+    }
+    *c0 = (uint8_t)from;
+    *c1 = (uint8_t)to;
+    return true;
+}
+
+static GlyphCacheEntry *lt_cache_lookup(struct GlyphCache *cache, const FontFace *face, uint32_t c,
+                                        const uint8_t *glyph, uint8_t width, uint8_t shift) {
+    if (width > GLYPH_CACHE_MAX_COLUMNS || face->pages > 8) {
+        return NULL;
+    }
+    uint32_t hash = (c * 8 + shift) * 2654435761u ^ (uint32_t)((uintptr_t)face >> 4);
+    GlyphCacheEntry *e = &cache->entries[hash % cache->num_entries];
+    if (e->face == face && e->c == c && e->shift == shift) {
+        return e;
+    }
+    e->face = face;
+    e->c = c;
+    e->shift = shift;
+    e->width = width;
+    memset(e->planes, 0, sizeof(e->planes));
+    for (uint8_t q = 0; q <= face->pages; q++) {
+        e->mask[q] = 0xFF;
+    }
+    e->mask[0] = (uint8_t)(0xFF << shift);
+    e->mask[face->pages] = (uint8_t)(0xFF >> (8 - shift));
+    for (uint8_t p = 0; p < face->pages; p++) {
+        lt_blit_row(e->planes[p], e->planes[p + 1], glyph + p * face->stride, width, 0xFF, shift, BLIT_OR);
+    }
+    return e;
+}
+
+GlyphCachePtr glyph_cache_create(uint16_t entries) {
+    if (entries == 0) {
+        errno = EINVAL;
+        LOG_ERROR(LOG_CAT_LAYOUT, "Glyph cache needs at least one entry", errno);
+        return NULL;
+    }
+    struct GlyphCache *cache = calloc(1, sizeof(struct GlyphCache) + entries * sizeof(GlyphCacheEntry));
+    if (cache == NULL) {
+        errno = ENOMEM;
+        LOG_ERROR(LOG_CAT_LAYOUT, "Failed to allocate memory for glyph cache", errno);
+        return NULL;
+    }
+    cache->num_entries = entries;
+    return cache;
+}
+
+void glyph_cache_free(GlyphCachePtr cache) {
+    free(cache);
+}
+
+// Must be called before a face the cache has seen is freed, e.g. on fontpack_close
+void glyph_cache_clear(GlyphCachePtr cache_) {
+    struct GlyphCache *cache = (struct GlyphCache *)cache_;
+    if (cache != NULL) {
+        for (uint16_t i = 0; i < cache->num_entries; i++) {
+            cache->entries[i].face = NULL;
+        }
+    }
+}
+
+int8_t layout_set_glyph_cache(LayoutPtr layout_, GlyphCachePtr cache) {
+    Layout *layout = (Layout *)layout_;
+    if (layout == NULL) {
+        errno = EINVAL;
+        LOG_ERROR(LOG_CAT_LAYOUT, "Layout is NULL", errno);
+        return LAYOUT_ERR_INVALID;
+    }
+    layout->glyph_cache = (struct GlyphCache *)cache;
+    return LAYOUT_OK;
+}
+
+// Records text or a bitmap covering `width` x `height` pixels at x, y for a
+// deferred tile. False when it has to be drawn now.
+static bool lt_defer_draw(Layout *layout, Tile *t, LtDeferKind kind, int16_t x, int16_t y, int32_t width,
+                          uint8_t height, const uint8_t *data, size_t len, const FontFace *face, BlitOp op) {
+    int32_t w = tile_get_width(t);
+    int32_t h = tile_get_height(t) * 8;
+    TileDeferOp e = {
+        .kind = kind, .arg = op, .opaque = op == BLIT_SET, .x = x, .y = y,
+        .width = kind == LT_DEFER_BLIT ? (uint8_t)width : 0, .height = height, .face = face,
+        .x0 = (int16_t)(x > 0 ? x : 0), .y0 = (int16_t)(y > 0 ? y : 0),
+        .x1 = (int16_t)(x + width < w ? x + width : w), .y1 = (int16_t)(y + height < h ? y + height : h),
+    };
+    return lt_defer_add(layout, t, &e, data, len);
+}
+
+int8_t layout_blit(LayoutPtr layout_, uint8_t tile, int16_t x, int16_t y,
+                   const uint8_t *bitmap, uint8_t width, uint8_t height, BlitOp op) {
+    Layout *layout = (Layout *)layout_;
+    if (layout == NULL || bitmap == NULL) {
+        errno = EINVAL;
+        LOG_ERROR(LOG_CAT_LAYOUT, "Layout or bitmap is NULL", errno);
+        return LAYOUT_ERR_INVALID;
+    }
+    if (tile >= layout->num_tiles) {
+        errno = EINVAL;
+        LOG_ERROR(LOG_CAT_LAYOUT, "Invalid tile index", errno);
+        return LAYOUT_ERR_INVALID_TILE;
+    }
+    Tile *t = &layout->tiles[tile];
+    if (lt_defer_active(t) && lt_defer_draw(layout, t, LT_DEFER_BLIT, x, y, width, height,
+                                            bitmap, (size_t)width * ((height + 7) / 8), NULL, op)) {
+        return LAYOUT_OK;
+    }
+    uint8_t c0, c1;
+    if (lt_clip_columns(t, x, width, &c0, &c1)) {
+        lt_blit(layout, t, x, y, bitmap, width, c0, c1, height, op);
+        tile_mark_columns(t, (uint8_t)(x + c0), (uint8_t)(x + c1 - 1));
+    }
+    return LAYOUT_OK;
+}
+
+// Draws a single line of text with its top row at pixel y. Unlike layout_print
+// nothing wraps and the rest of the tile is left alone.
+int8_t layout_draw_text(LayoutPtr layout_, uint8_t tile, int16_t x, int16_t y,
+                        const uint8_t *text, size_t len, const FontFace *face, BlitOp op) {
+    Layout *layout = (Layout *)layout_;
+    if (layout == NULL || face == NULL) {
+        errno = EINVAL;
+        LOG_ERROR(LOG_CAT_LAYOUT, "Layout or font is NULL", errno);
+        return LAYOUT_ERR_INVALID;
+    }
+    if (tile >= layout->num_tiles) {
+        errno = EINVAL;
+        LOG_ERROR(LOG_CAT_LAYOUT, "Invalid tile index", errno);
+        return LAYOUT_ERR_INVALID_TILE;
+    }
+    Tile *t = &layout->tiles[tile];
+    if (lt_defer_active(t)) {
+        int32_t width = 0;
+        size_t i = 0;
+        while (i < len && x + width < tile_get_width(t)) {
+            uint8_t glen = 0;
+            uint32_t c = font_utf8_next(text, len, &i);
+            if (c == FONT_UTF8_INVALID || font_glyph(face, c, &glen) == NULL) {
+                errno = EINVAL;
+                LOG_ERROR(LOG_CAT_LAYOUT, "Invalid character", c);
+                return LAYOUT_ERR_INVALID_DATA;
+            }
+            width += glen;
+        }
+        if (lt_defer_draw(layout, t, LT_DEFER_TEXT, x, y, width, face->pages * 8, text, len, face, op)) {
+            return LAYOUT_OK;
+        }
+    }
+    uint8_t shift;
+    int16_t page0 = lt_page_of(y, &shift);
+    size_t i = 0;
+    while (i < len && x < tile_get_width(t)) {
+        uint8_t glen = 0;
+        uint32_t c = font_utf8_next(text, len, &i);
+        const uint8_t *glyph = c == FONT_UTF8_INVALID ? NULL : font_glyph(face, c, &glen);
+        if (glyph == NULL) {
+            errno = EINVAL;
+            LOG_ERROR(LOG_CAT_LAYOUT, "Invalid character", c);
+            return LAYOUT_ERR_INVALID_DATA;
+        }
+        uint8_t c0, c1;
+        if (lt_clip_columns(t, x, glen, &c0, &c1)) {
+            GlyphCacheEntry *e = NULL;
+            if (shift != 0 && layout->glyph_cache != NULL) {
+                e = lt_cache_lookup(layout->glyph_cache, face, c, glyph, glen, shift);
+            }
+            if (e != NULL) {
+                // Pre-shifted: every destination page is a straight masked copy
+                for (uint8_t q = 0; q <= face->pages; q++) {
+                    uint8_t *row = lt_dest_row(layout, t, page0 + q, x + c0);
+                    if (row != NULL) {
+                        lt_blit_row(row, NULL, e->planes[q] + c0, c1 - c0, e->mask[q], 0, op);
+                    }
+                }
+            } else {
+                lt_blit(layout, t, x, y, glyph, face->stride, c0, c1, face->pages * 8, op);
+            }
+            tile_mark_columns(t, (uint8_t)(x + c0), (uint8_t)(x + c1 - 1));
+        }
+        x += glen;
+    }
+    return LAYOUT_OK;
+}
@@ -0,0 +1,201 @@
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include "chart.h"
+#include "layout.h"
+#include "layout-internal.h"
+#include "log.h"
+
+#define CHART_NO_SAMPLE (-1)
+
+typedef struct {
+    Layout *layout;
+    Tile *tile;
+    ChartMode mode;
+    ChartStyle style;
+    int32_t min;
+    int32_t max;
+    uint8_t width;
+    uint16_t rows;              // tile height in pixels
+    uint32_t count;             // samples pushed
+    int32_t *samples;           // ring, sample n at n % width
+} Chart;
+
+// Pixel row of a value, 0 at the top
+static uint16_t ch_row(Chart *ch, int32_t value) {
+    if (value <= ch->min) {
+        return ch->rows - 1;
+    }
+    if (value >= ch->max) {
+        return 0;
+    }
+    return (uint16_t)(ch->rows - 1 - ((int64_t)value - ch->min) * (ch->rows - 1) / ((int64_t)ch->max - ch->min));
+}
+
+// Oldest sample on screen; sweep mode keeps a column free for the cursor
+static int64_t ch_first(Chart *ch) {
+    uint32_t shown = ch->mode == CHART_SWEEP ? ch->width - 1u : ch->width;
+    return ch->count > shown ? (int64_t)ch->count - shown : 0;
+}
+
+// Draws sample `n` into tile column `column`, or blanks the column when the
+// sample is not on screen. A line joins each sample to the one before it.
+static void ch_draw(Chart *ch, uint8_t column, int64_t n) {
+    int top = 1;
+    int bottom = 0;
+    int64_t first = ch_first(ch);
+    if (n >= first && n < (int64_t)ch->count) {
+        top = bottom = ch_row(ch, ch->samples[n % ch->width]);
+        if (ch->style == CHART_BARS) {
+            bottom = ch->rows - 1;
+        } else if (n > first) {
+            int prev = ch_row(ch, ch->samples[(n - 1) % ch->width]);
+            if (prev < top) top = prev;
+            if (prev > bottom) bottom = prev;
+        }
+    }
+    for (uint8_t page = 0; page < ch->rows / 8; page++) {
+        int lo = top > page * 8 ? top : page * 8;
+        int hi = bottom < page * 8 + 7 ? bottom : page * 8 + 7;
+        uint8_t bits = 0;
+        if (lo <= hi) {
+            bits = (uint8_t)((0xFF << (lo - page * 8)) & (0xFF >> (page * 8 + 7 - hi)));
+        }
+        lt_tile_row(ch->layout, ch->tile, page)[column] = bits;
+    }
+}
+
+static void ch_redraw(Chart *ch) {
+    for (uint8_t column = 0; column < ch->width; column++) {
+        ch_draw(ch, column, CHART_NO_SAMPLE);
+    }
+    for (int64_t n = ch_first(ch); n < (int64_t)ch->count; n++) {
+        uint8_t column = ch->mode == CHART_SWEEP ? n % ch->width : (uint8_t)(n + ch->width - ch->count);
+        ch_draw(ch, column, n);
+    }
+    tile_setdirty(ch->tile, true);
+}
+
+ChartPtr chart_create(LayoutPtr layout_, uint8_t tile, ChartMode mode, ChartStyle style, int32_t min, int32_t max) {
+    Layout *layout = (Layout *)layout_;
+    if (layout == NULL || mode > CHART_SWEEP || style > CHART_BARS || min >= max) {
+        errno = EINVAL;
+        LOG_ERROR(LOG_CAT_LAYOUT, "Invalid chart arguments", errno);
+        return NULL;
+    }
+    if (tile >= layout->num_tiles) {
+        errno = EINVAL;
+        LOG_ERROR(LOG_CAT_LAYOUT, "Invalid tile index", errno);
+        return NULL;
+    }
+    Tile *t = &layout->tiles[tile];
+    if (tile_get_width(t) < 3) {
+        errno = EINVAL;
+        LOG_ERROR(LOG_CAT_LAYOUT, "Tile too narrow for a chart", tile_get_width(t));
+        return NULL;
+    }
+    Chart *ch = calloc(1, sizeof(Chart));
+    int32_t *samples = malloc(sizeof(int32_t) * tile_get_width(t));
+    if (ch == NULL || samples == NULL) {
+        free(ch);
+        free(samples);
+        errno = ENOMEM;
+        LOG_ERROR(LOG_CAT_LAYOUT, "Failed to allocate memory for chart", errno);
+        return NULL;
+    }
+    ch->layout = layout;
+    ch->tile = t;
+    ch->mode = mode;
+    ch->style = style;
+    ch->min = min;
+    ch->max = max;
+    ch->width = tile_get_width(t);
+    ch->rows = (uint16_t)tile_get_height(t) * 8;
+    ch->count = 0;
+    ch->samples = samples;
+    ch_redraw(ch);
+    return ch;
+}
+
+void chart_free(ChartPtr chart) {
+    Chart *ch = (Chart *)chart;
+    if (ch == NULL) {
+        return;
+    }
+    free(ch->samples);
+    free(ch);
+}
+
+int8_t chart_push(ChartPtr chart, int32_t value) {
+    Chart *ch = (Chart *)chart;
+    if (ch == NULL) {
+        errno = EINVAL;
+        LOG_ERROR(LOG_CAT_LAYOUT, "Chart is NULL", errno);
+        return LAYOUT_ERR_INVALID;
+    }
+    Tile *t = ch->tile;
+    uint8_t w = ch->width;
+    uint32_t n = ch->count++;
+    ch->samples[n % w] = value;
+    if (ch->mode == CHART_SWEEP) {
+        // The sample, the cursor ahead of it, and for lines the oldest sample,
+        // which lost the one it was joined to
+        uint8_t column = n % w;
+        uint8_t last = column + (ch->style == CHART_LINE ? 2 : 1);
+        ch_draw(ch, column, n);
+        ch_draw(ch, (column + 1) % w, CHART_NO_SAMPLE);
+        if (ch->style == CHART_LINE) {
+            ch_draw(ch, (column + 2) % w, (int64_t)n + 2 - w);
+        }
+        if (last < w) {
+            tile_mark_columns(t, column, last);
+        } else {
+            tile_mark_columns(t, 0, w - 1);     // wrapped around
+        }
+        return LAYOUT_OK;
+    }
+    // Only a clean tile can be scrolled on the panel: anything else pending
+    // there would move along with it
+    bool shift = t->shift == 0 && !tile_isdirty(t) && lt_tile_can_shift(ch->layout, t);
+    for (uint8_t page = 0; page < ch->rows / 8; page++) {
+        uint8_t *row = lt_tile_row(ch->layout, t, page);
+        memmove(row, row + 1, w - 1);
+    }
+    ch_draw(ch, w - 1, n);
+    if (shift) {
+        tile_mark_columns(t, w - 1, w - 1);
+        t->shift = 1;
+    } else {
+        tile_setdirty(t, true);
+    }
+    return LAYOUT_OK;
+}
+
+int8_t chart_set_range(ChartPtr chart, int32_t min, int32_t max) {
+    Chart *ch = (Chart *)chart;
+    if (ch == NULL || min >= max) {
+        errno = EINVAL;
+        LOG_ERROR(LOG_CAT_LAYOUT, "Invalid chart range", errno);
+        return LAYOUT_ERR_INVALID;
+    }
+    ch->min = min;
+    ch->max = max;
+    ch_redraw(ch);
+    return LAYOUT_OK;
+}
+
+int8_t chart_clear(ChartPtr chart) {
+    Chart *ch = (Chart *)chart;
+    if (ch == NULL) {
+        errno = EINVAL;
+        LOG_ERROR(LOG_CAT_LAYOUT, "Chart is NULL", errno);
+        return LAYOUT_ERR_INVALID;
+    }
+    ch->count = 0;
+    ch_redraw(ch);
+    return LAYOUT_OK;
+}
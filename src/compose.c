@@ -0,0 +1,407 @@
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include "compose.h"
+#include "layout.h"
+#include "layout-internal.h"
+#include "log.h"
+
+typedef struct {
+    uint8_t page0;
+    uint8_t page1;      // inclusive
+    uint8_t column0;
+    uint8_t column1;    // inclusive
+} ComposeRect;
+
+typedef struct {
+    Layout *layout;
+    ComposeOp op;
+    bool visible;
+} ComposeLayer;
+
+typedef struct {
+    uint8_t layer;
+    bool visible;
+    int16_t x;
+    int16_t y;
+    uint8_t width;
+    uint8_t height;
+    const uint8_t *bitmap;
+    const uint8_t *mask;
+} ComposeSprite;
+
+typedef struct {
+    Layout *target;
+    uint8_t num_layers;
+    ComposeLayer layers[COMPOSE_MAX_LAYERS];
+    uint8_t num_sprites;
+    ComposeSprite sprites[COMPOSE_MAX_SPRITES];
+    uint8_t num_rects;
+    ComposeRect rects[COMPOSE_MAX_RECTS];
+} Compositor;
+
+static uint16_t cp_area(const ComposeRect *r) {
+    return (uint16_t)(r->page1 - r->page0 + 1) * (r->column1 - r->column0 + 1);
+}
+
+static ComposeRect cp_union(const ComposeRect *a, const ComposeRect *b) {
+    return (ComposeRect){
+        .page0 = a->page0 < b->page0 ? a->page0 : b->page0,
+        .page1 = a->page1 > b->page1 ? a->page1 : b->page1,
+        .column0 = a->column0 < b->column0 ? a->column0 : b->column0,
+        .column1 = a->column1 > b->column1 ? a->column1 : b->column1,
+    };
+}
+
+static bool cp_intersects(const ComposeRect *a, const ComposeRect *b) {
+    return a->page0 <= b->page1 && b->page0 <= a->page1 &&
+           a->column0 <= b->column1 && b->column0 <= a->column1;
+}
+
+// Adds a rectangle to the dirty list. Overlapping rectangles are merged; when
+// the list is full the new one joins whichever rectangle grows the least.
+static void cp_add_rect(Compositor *comp, ComposeRect rect) {
+    for (uint8_t i = 0; i < comp->num_rects; i++) {
+        if (cp_intersects(&comp->rects[i], &rect)) {
+            ComposeRect merged = cp_union(&comp->rects[i], &rect);
+            comp->rects[i] = comp->rects[--comp->num_rects];
+            cp_add_rect(comp, merged);
+            return;
+        }
+    }
+    if (comp->num_rects < COMPOSE_MAX_RECTS) {
+        comp->rects[comp->num_rects++] = rect;
+        return;
+    }
+    uint8_t best = 0;
+    uint16_t best_growth = 0xFFFF;
+    for (uint8_t i = 0; i < comp->num_rects; i++) {
+        ComposeRect u = cp_union(&comp->rects[i], &rect);
+        uint16_t growth = cp_area(&u) - cp_area(&comp->rects[i]);
+        if (growth < best_growth) {
+            best = i;
+            best_growth = growth;
+        }
+    }
+    ComposeRect merged = cp_union(&comp->rects[best], &rect);
+    comp->rects[best] = comp->rects[--comp->num_rects];
+    cp_add_rect(comp, merged);
+}
+
+static void cp_invalidate_all(Compositor *comp) {
+    comp->num_rects = 1;
+    comp->rects[0] = (ComposeRect){0, lt_get_pages(comp->target) - 1, 0, lt_get_columns(comp->target) - 1};
+}
+
+// Marks the pages and columns a sprite covers at its current position
+static void cp_add_sprite_rect(Compositor *comp, const ComposeSprite *s) {
+    int16_t x0 = s->x < 0 ? 0 : s->x;
+    int16_t x1 = s->x + s->width - 1;
+    int16_t y0 = s->y < 0 ? 0 : s->y;
+    int16_t y1 = s->y + s->height - 1;
+    int16_t columns = lt_get_columns(comp->target);
+    int16_t rows = lt_get_pages(comp->target) * 8;
+    if (!s->visible || s->width == 0 || s->height == 0 || x1 < 0 || y1 < 0 || x0 >= columns || y0 >= rows) {
+        return;
+    }
+    if (x1 >= columns) x1 = columns - 1;
+    if (y1 >= rows) y1 = rows - 1;
+    cp_add_rect(comp, (ComposeRect){(uint8_t)(y0 / 8), (uint8_t)(y1 / 8), (uint8_t)x0, (uint8_t)x1});
+}
+
+// Picks up what was drawn into a layer since the last pass from its tiles' dirty boxes
+static void cp_collect_layer(Compositor *comp, ComposeLayer *layer) {
+    for (uint8_t i = 0; i < layer->layout->num_tiles; i++) {
+        Tile *t = &layer->layout->tiles[i];
+        if (!tile_isdirty(t)) {
+            continue;
+        }
+        if (layer->visible) {
+            cp_add_rect(comp, (ComposeRect){t->start.page, t->end.page,
+                                            t->start.column + t->dirty_start, t->start.column + t->dirty_end});
+        }
+        tile_setdirty(t, false);
+    }
+}
+
+// Bytes of a sprite plane (bitmap or mask) that land in panel page `page`,
+// columns [c0, c0 + n): the low bits of one sprite page and the high bits of
+// the one above, each shifted as a 16-bit word
+static void cp_sprite_row(const ComposeSprite *s, const uint8_t *src, uint8_t page, uint8_t c0, uint8_t n, uint8_t *out) {
+    int16_t top = s->y >= 0 ? s->y / 8 : -((7 - s->y) / 8);
+    uint8_t shift = (uint8_t)(s->y - top * 8);
+    uint8_t pages = (s->height + 7) / 8;
+    uint8_t last = s->height % 8 ? (uint8_t)((1u << (s->height % 8)) - 1) : 0xFF;
+    int16_t sp = page - top;
+    for (uint8_t i = 0; i < n; i++) {
+        int16_t c = c0 + i - s->x;
+        uint16_t word = 0;
+        if (c >= 0 && c < s->width) {
+            if (sp >= 0 && sp < pages) {
+                word |= (uint16_t)(src[sp * s->width + c] & (sp == pages - 1 ? last : 0xFF)) << shift;
+            }
+            if (shift && sp >= 1 && sp - 1 < pages) {
+                word |= ((uint16_t)(src[(sp - 1) * s->width + c] & (sp - 1 == pages - 1 ? last : 0xFF)) << shift) >> 8;
+            }
+        }
+        out[i] = (uint8_t)word;
+    }
+}
+
+static void cp_blend(uint8_t *dst, const uint8_t *src, uint8_t n, ComposeOp op) {
+    uint64_t d, s;
+    uint8_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        memcpy(&d, dst + i, 8);
+        memcpy(&s, src + i, 8);
+        switch (op) {
+            case COMPOSE_COPY:   d = s; break;
+            case COMPOSE_OR:     d |= s; break;
+            case COMPOSE_AND:    d &= s; break;
+            case COMPOSE_XOR:    d ^= s; break;
+            case COMPOSE_ANDNOT: d &= ~s; break;
+        }
+        memcpy(dst + i, &d, 8);
+    }
+    for (; i < n; i++) {
+        switch (op) {
+            case COMPOSE_COPY:   dst[i] = src[i]; break;
+            case COMPOSE_OR:     dst[i] |= src[i]; break;
+            case COMPOSE_AND:    dst[i] &= src[i]; break;
+            case COMPOSE_XOR:    dst[i] ^= src[i]; break;
+            case COMPOSE_ANDNOT: dst[i] &= (uint8_t)~src[i]; break;
+        }
+    }
+}
+
+static void cp_compose_rect(Compositor *comp, const ComposeRect *r) {
+    uint8_t acc[N_COLUMNS];
+    uint8_t row[N_COLUMNS];
+    uint8_t bits[N_COLUMNS];
+    uint8_t mask[N_COLUMNS];
+    uint8_t n = r->column1 - r->column0 + 1;
+    for (uint8_t page = r->page0; page <= r->page1; page++) {
+        bool first = true;
+        memset(acc, 0, n);
+        for (uint8_t l = 0; l < comp->num_layers; l++) {
+            ComposeLayer *layer = &comp->layers[l];
+            if (!layer->visible) {
+                continue;
+            }
+            memcpy(row, lt_row(layer->layout, page) + r->column0, n);
+            for (uint8_t i = 0; i < comp->num_sprites; i++) {
+                ComposeSprite *s = &comp->sprites[i];
+                if (s->layer != l || !s->visible) {
+                    continue;
+                }
+                cp_sprite_row(s, s->bitmap, page, r->column0, n, bits);
+                cp_sprite_row(s, s->mask != NULL ? s->mask : s->bitmap, page, r->column0, n, mask);
+                for (uint8_t c = 0; c < n; c++) {
+                    row[c] = (uint8_t)((row[c] & ~mask[c]) | (bits[c] & mask[c]));
+                }
+            }
+            cp_blend(acc, row, n, first ? COMPOSE_COPY : layer->op);
+            first = false;
+        }
+        memcpy(lt_row(comp->target, page) + r->column0, acc, n);
+    }
+    for (uint8_t i = 0; i < comp->target->num_tiles; i++) {
+        Tile *t = &comp->target->tiles[i];
+        ComposeRect tr = {t->start.page, t->end.page, t->start.column, t->end.column};
+        if (cp_intersects(&tr, r)) {
+            uint8_t c0 = r->column0 > t->start.column ? r->column0 : t->start.column;
+            uint8_t c1 = r->column1 < t->end.column ? r->column1 : t->end.column;
+            tile_mark_columns(t, c0 - t->start.column, c1 - t->start.column);
+        }
+    }
+}
+
+CompositorPtr compositor_create(LayoutPtr target) {
+    if (target == NULL) {
+        errno = EINVAL;
+        LOG_ERROR(LOG_CAT_LAYOUT, "Target layout is NULL", errno);
+        return NULL;
+    }
+    if (LAYOUT_TILE_STORE > 0) {
+        errno = EINVAL;
+        LOG_ERROR(LOG_CAT_LAYOUT, "Compositing needs a framebuffer", LAYOUT_TILE_STORE);
+        return NULL;
+    }
+    Compositor *comp = calloc(1, sizeof(Compositor));
+    if (comp == NULL) {
+        errno = ENOMEM;
+        LOG_ERROR(LOG_CAT_LAYOUT, "Failed to allocate memory for compositor", errno);
+        return NULL;
+    }
+    comp->target = (Layout *)target;
+    return comp;
+}
+
+void compositor_free(CompositorPtr comp) {
+    free(comp);
+}
+
+int8_t compositor_add_layer(CompositorPtr comp_, LayoutPtr layer, ComposeOp op) {
+    Compositor *comp = (Compositor *)comp_;
+    if (comp == NULL || layer == NULL || layer == comp->target) {
+        errno = EINVAL;
+        LOG_ERROR(LOG_CAT_LAYOUT, "Invalid compositor or layer", errno);
+        return LAYOUT_ERR_INVALID;
+    }
+    if (comp->num_layers >= COMPOSE_MAX_LAYERS) {
+        errno = ENOSPC;
+        LOG_ERROR(LOG_CAT_LAYOUT, "Too many layers", errno);
+        return LAYOUT_ERR_FULL;
+    }
+    comp->layers[comp->num_layers] = (ComposeLayer){(Layout *)layer, op, true};
+    cp_invalidate_all(comp);
+    return comp->num_layers++;
+}
+
+int8_t compositor_set_layer_op(CompositorPtr comp_, uint8_t layer, ComposeOp op) {
+    Compositor *comp = (Compositor *)comp_;
+    if (comp == NULL || layer >= comp->num_layers) {
+        errno = EINVAL;
+        LOG_ERROR(LOG_CAT_LAYOUT, "Invalid layer", errno);
+        return LAYOUT_ERR_INVALID;
+    }
+    if (comp->layers[layer].op != op) {
+        comp->layers[layer].op = op;
+        cp_invalidate_all(comp);
+    }
+    return LAYOUT_OK;
+}
+
+int8_t compositor_set_layer_visible(CompositorPtr comp_, uint8_t layer, bool visible) {
+    Compositor *comp = (Compositor *)comp_;
+    if (comp == NULL || layer >= comp->num_layers) {
+        errno = EINVAL;
+        LOG_ERROR(LOG_CAT_LAYOUT, "Invalid layer", errno);
+        return LAYOUT_ERR_INVALID;
+    }
+    if (comp->layers[layer].visible != visible) {
+        comp->layers[layer].visible = visible;
+        cp_invalidate_all(comp);
+    }
+    return LAYOUT_OK;
+}
+
+int8_t compositor_add_sprite(CompositorPtr comp_, uint8_t layer, const uint8_t *bitmap, const uint8_t *mask,
+                             uint8_t width, uint8_t height) {
+    Compositor *comp = (Compositor *)comp_;
+    if (comp == NULL || layer >= comp->num_layers || bitmap == NULL) {
+        errno = EINVAL;
+        LOG_ERROR(LOG_CAT_LAYOUT, "Invalid layer or sprite bitmap", errno);
+        return LAYOUT_ERR_INVALID;
+    }
+    if (comp->num_sprites >= COMPOSE_MAX_SPRITES) {
+        errno = ENOSPC;
+        LOG_ERROR(LOG_CAT_LAYOUT, "Too many sprites", errno);
+        return LAYOUT_ERR_FULL;
+    }
+    comp->sprites[comp->num_sprites] = (ComposeSprite){
+        .layer = layer,
+        .visible = false,
+        .width = width,
+        .height = height,
+        .bitmap = bitmap,
+        .mask = mask,
+    };
+    return comp->num_sprites++;
+}
+
+static ComposeSprite *cp_get_sprite(Compositor *comp, uint8_t sprite) {
+    if (comp == NULL || sprite >= comp->num_sprites) {
+        errno = EINVAL;
+        LOG_ERROR(LOG_CAT_LAYOUT, "Invalid sprite", errno);
+        return NULL;
+    }
+    return &comp->sprites[sprite];
+}
+
+int8_t compositor_set_sprite_bitmap(CompositorPtr comp_, uint8_t sprite, const uint8_t *bitmap, const uint8_t *mask) {
+    Compositor *comp = (Compositor *)comp_;
+    ComposeSprite *s = cp_get_sprite(comp, sprite);
+    if (s == NULL || bitmap == NULL) {
+        return LAYOUT_ERR_INVALID;
+    }
+    s->bitmap = bitmap;
+    s->mask = mask;
+    cp_add_sprite_rect(comp, s);
+    return LAYOUT_OK;
+}
+
+// Only the old and the new footprint are recomposed
+int8_t compositor_move_sprite(CompositorPtr comp_, uint8_t sprite, int16_t x, int16_t y) {
+    Compositor *comp = (Compositor *)comp_;
+    ComposeSprite *s = cp_get_sprite(comp, sprite);
+    if (s == NULL) {
+        return LAYOUT_ERR_INVALID;
+    }
+    if (s->x == x && s->y == y) {
+        return LAYOUT_OK;
+    }
+    cp_add_sprite_rect(comp, s);
+    s->x = x;
+    s->y = y;
+    cp_add_sprite_rect(comp, s);
+    return LAYOUT_OK;
+}
+
+int8_t compositor_show_sprite(CompositorPtr comp_, uint8_t sprite, bool visible) {
+    Compositor *comp = (Compositor *)comp_;
+    ComposeSprite *s = cp_get_sprite(comp, sprite);
+    if (s == NULL) {
+        return LAYOUT_ERR_INVALID;
+    }
+    if (s->visible != visible) {
+        s->visible = true;
+        cp_add_sprite_rect(comp, s);
+        s->visible = visible;
+    }
+    return LAYOUT_OK;
+}
+
+int8_t compositor_invalidate(CompositorPtr comp_) {
+    Compositor *comp = (Compositor *)comp_;
+    if (comp == NULL) {
+        errno = EINVAL;
+        LOG_ERROR(LOG_CAT_LAYOUT, "Compositor is NULL", errno);
+        return LAYOUT_ERR_INVALID;
+    }
+    cp_invalidate_all(comp);
+    return LAYOUT_OK;
+}
+
+// Recomposes the dirty rectangles into the target and marks the target tiles
+// they touch, ready for layout_flush
+int8_t compositor_compose(CompositorPtr comp_) {
+    Compositor *comp = (Compositor *)comp_;
+    if (comp == NULL) {
+        errno = EINVAL;
+        LOG_ERROR(LOG_CAT_LAYOUT, "Compositor is NULL", errno);
+        return LAYOUT_ERR_INVALID;
+    }
+    for (uint8_t l = 0; l < comp->num_layers; l++) {
+        if (comp->layers[l].layout->transposed != comp->target->transposed) {
+            errno = EINVAL;
+            LOG_ERROR(LOG_CAT_LAYOUT, "Layer is not rotated like the target", l);
+            return LAYOUT_ERR_INVALID;
+        }
+    }
+    // Deferred drawing lands before the dirty boxes are read
+    lt_defer_resolve_all(comp->target);
+    for (uint8_t l = 0; l < comp->num_layers; l++) {
+        lt_defer_resolve_all(comp->layers[l].layout);
+        cp_collect_layer(comp, &comp->layers[l]);
+    }
+    for (uint8_t i = 0; i < comp->num_rects; i++) {
+        cp_compose_rect(comp, &comp->rects[i]);
+    }
+    comp->num_rects = 0;
+    return LAYOUT_OK;
+}
@@ -0,0 +1,345 @@
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include "console.h"
+#include "layout.h"
+#include "layout-internal.h"
+#include "font.h"
+#include "log.h"
+
+#define CONSOLE_BLANK ' '
+
+typedef struct {
+    Layout *layout;
+    Tile *tile;
+    const FontFace *face;
+    uint8_t cell_width;
+    uint8_t rows;
+    uint8_t columns;
+    uint8_t top;                // ring row shown at the top
+    uint8_t cursor_row;
+    uint8_t cursor_column;
+    bool hardware;              // scrolls with the display start line
+    uint32_t *cells;            // [rows][columns], ring rows
+    uint32_t *shown;            // [rows][columns] what the framebuffer holds, by framebuffer row
+    uint8_t *dirty;             // [rows][stride] bit per cell, by framebuffer row
+    uint8_t dirty_stride;
+} Console;
+
+static inline uint8_t cs_ring_row(Console *con, uint8_t row) {
+    return (uint8_t)((con->top + row) % con->rows);
+}
+
+// Framebuffer text row showing visible row `row`: in hardware mode the rows
+// stay put in GDDRAM and the start line moves, otherwise the top row is always
+// framebuffer row 0
+static inline uint8_t cs_fb_row(Console *con, uint8_t row) {
+    return con->hardware ? cs_ring_row(con, row) : row;
+}
+
+// Re-evaluates the dirty bit of the cell at visible (row, column)
+static void cs_update(Console *con, uint8_t row, uint8_t column) {
+    uint8_t fb = cs_fb_row(con, row);
+    size_t i = (size_t)fb * con->columns + column;
+    uint8_t *bits = &con->dirty[fb * con->dirty_stride + column / 8];
+    uint8_t bit = (uint8_t)(1u << (column % 8));
+    if (con->cells[(size_t)cs_ring_row(con, row) * con->columns + column] != con->shown[i]) {
+        *bits |= bit;
+    } else {
+        *bits &= (uint8_t)~bit;
+    }
+}
+
+static void cs_set(Console *con, uint8_t row, uint8_t column, uint32_t c) {
+    con->cells[(size_t)cs_ring_row(con, row) * con->columns + column] = c;
+    cs_update(con, row, column);
+}
+
+// Renders the dirty cells of one framebuffer row and marks the columns they span
+static void cs_render_row(Console *con, uint8_t fb) {
+    Layout *layout = con->layout;
+    Tile *t = con->tile;
+    const FontFace *face = con->face;
+    uint8_t page = fb * face->pages;
+    uint8_t first = 0xFF;
+    uint8_t last = 0;
+    // In hardware mode the cells of framebuffer row fb are ring row fb
+    uint8_t ring = con->hardware ? fb : cs_ring_row(con, fb);
+    for (uint8_t column = 0; column < con->columns; column++) {
+        uint8_t *bits = &con->dirty[fb * con->dirty_stride + column / 8];
+        uint8_t bit = (uint8_t)(1u << (column % 8));
+        if (!(*bits & bit)) {
+            continue;
+        }
+        uint32_t c = con->cells[(size_t)ring * con->columns + column];
+        uint8_t x = column * con->cell_width;
+        for (uint8_t p = 0; p < face->pages; p++) {
+            memset(lt_tile_row(layout, t, page + p) + x, 0, con->cell_width);
+        }
+        uint8_t glen = 0;
+        const uint8_t *glyph = font_glyph(face, c, &glen);
+        if (glyph != NULL && glen > 0) {
+            lt_render_glyph(lt_tile_row(layout, t, page) + x, lt_tile_stride(layout, t), glyph, face, 1, 0,
+                            glen < con->cell_width ? glen : con->cell_width);
+        }
+        con->shown[(size_t)fb * con->columns + column] = c;
+        *bits &= (uint8_t)~bit;
+        if (first == 0xFF) first = column;
+        last = column;
+    }
+    if (first != 0xFF) {
+        tile_mark_rect(t, page, page + face->pages - 1,
+                       first * con->cell_width, (last + 1) * con->cell_width - 1);
+    }
+}
+
+// Forgets what the framebuffer holds, so every cell is drawn on the next flush
+static void cs_invalidate(Console *con) {
+    for (size_t i = 0; i < (size_t)con->rows * con->columns; i++) {
+        con->shown[i] = 0;
+    }
+    memset(con->dirty, 0xFF, (size_t)con->rows * con->dirty_stride);
+}
+
+static void cs_prepare(Layout *layout, Tile *tile, void *ctx) {
+    Console *con = (Console *)ctx;
+    if (tile_isdirty(tile)) {
+        // Only the console draws between flushes without marking the tile, so
+        // something else (a clear, a turn, a print) has drawn over the cells
+        cs_invalidate(con);
+    }
+    for (uint8_t fb = 0; fb < con->rows; fb++) {
+        for (uint8_t i = 0; i < con->dirty_stride; i++) {
+            if (con->dirty[fb * con->dirty_stride + i]) {
+                cs_render_row(con, fb);
+                break;
+            }
+        }
+    }
+    if (con->hardware) {
+        layout->start_line = lt_buffer_line(layout, con->top * con->face->pages);
+    }
+}
+
+static Console *cs_get(ConsolePtr console) {
+    if (console == NULL) {
+        errno = EINVAL;
+        LOG_ERROR(LOG_CAT_LAYOUT, "Console is NULL", errno);
+    }
+    return (Console *)console;
+}
+
+ConsolePtr console_create(LayoutPtr layout_, uint8_t tile, const FontFace *face) {
+    Layout *layout = (Layout *)layout_;
+    if (layout == NULL || face == NULL) {
+        errno = EINVAL;
+        LOG_ERROR(LOG_CAT_LAYOUT, "Layout or font is NULL", errno);
+        return NULL;
+    }
+    if (tile >= layout->num_tiles) {
+        errno = EINVAL;
+        LOG_ERROR(LOG_CAT_LAYOUT, "Invalid tile index", errno);
+        return NULL;
+    }
+    Tile *t = &layout->tiles[tile];
+    if (t->prepare != NULL) {
+        errno = EBUSY;
+        LOG_ERROR(LOG_CAT_LAYOUT, "Tile already has deferred content", errno);
+        return NULL;
+    }
+    uint8_t rows = tile_get_height(t) / face->pages;
+    uint8_t columns = tile_get_width(t) / face->stride;
+    if (rows == 0 || columns == 0) {
+        errno = EINVAL;
+        LOG_ERROR(LOG_CAT_LAYOUT, "Tile too small for a console", errno);
+        return NULL;
+    }
+    Console *con = calloc(1, sizeof(Console));
+    uint8_t stride = (columns + 7) / 8;
+    uint32_t *cells = malloc(2 * sizeof(uint32_t) * rows * columns);
+    uint8_t *dirty = calloc((size_t)rows * stride, 1);
+    if (con == NULL || cells == NULL || dirty == NULL) {
+        free(con);
+        free(cells);
+        free(dirty);
+        errno = ENOMEM;
+        LOG_ERROR(LOG_CAT_LAYOUT, "Failed to allocate memory for console", errno);
+        return NULL;
+    }
+    con->layout = layout;
+    con->tile = t;
+    con->face = face;
+    con->cell_width = face->stride;
+    con->rows = rows;
+    con->columns = columns;
+    con->cells = cells;
+    con->shown = cells + (size_t)rows * columns;
+    con->dirty = dirty;
+    con->dirty_stride = stride;
+    // A whole-panel tile with no leftover pages can wrap through the start line
+    con->hardware = lt_shows_whole_ram(layout) && !layout->transposed && t->start.page == 0 && t->start.column == 0 &&
+                    tile_get_height(t) == LT_RAM_PAGES && t->end.column == lt_get_columns(layout) - 1 &&
+                    rows * face->pages == LT_RAM_PAGES;
+    for (size_t i = 0; i < (size_t)rows * columns; i++) {
+        con->cells[i] = CONSOLE_BLANK;
+    }
+    cs_invalidate(con);
+    t->prepare = cs_prepare;
+    t->prepare_ctx = con;
+    return con;
+}
+
+void console_free(ConsolePtr console) {
+    Console *con = (Console *)console;
+    if (con == NULL) {
+        return;
+    }
+    if (con->tile->prepare_ctx == con) {
+        con->tile->prepare = NULL;
+        con->tile->prepare_ctx = NULL;
+    }
+    free(con->cells);
+    free(con->dirty);
+    free(con);
+}
+
+uint8_t console_get_rows(ConsolePtr console) {
+    Console *con = cs_get(console);
+    return con != NULL ? con->rows : 0;
+}
+
+uint8_t console_get_columns(ConsolePtr console) {
+    Console *con = cs_get(console);
+    return con != NULL ? con->columns : 0;
+}
+
+// Writes text into cells starting at (row, column) without moving the cursor;
+// whatever runs past the end of the row is dropped
+int8_t console_put(ConsolePtr console, uint8_t row, uint8_t column, const uint8_t *text, size_t len) {
+    Console *con = cs_get(console);
+    if (con == NULL) {
+        return LAYOUT_ERR_INVALID;
+    }
+    if (row >= con->rows || column >= con->columns) {
+        errno = EINVAL;
+        LOG_ERROR(LOG_CAT_LAYOUT, "Invalid console cell", errno);
+        return LAYOUT_ERR_INVALID_POINT;
+    }
+    size_t i = 0;
+    while (i < len && column < con->columns) {
+        uint32_t c = font_utf8_next(text, len, &i);
+        if (c == FONT_UTF8_INVALID) {
+            errno = EINVAL;
+            LOG_ERROR(LOG_CAT_LAYOUT, "Invalid character", c);
+            return LAYOUT_ERR_INVALID_DATA;
+        }
+        cs_set(con, row, column++, c);
+    }
+    return LAYOUT_OK;
+}
+
+// Scrolls the text up: the ring moves by a row and the new bottom row is
+// cleared. Only cells whose visible content changes are marked dirty.
+int8_t console_scroll(ConsolePtr console, uint8_t lines) {
+    Console *con = cs_get(console);
+    if (con == NULL) {
+        return LAYOUT_ERR_INVALID;
+    }
+    if (lines > con->rows) {
+        lines = con->rows;
+    }
+    for (uint8_t n = 0; n < lines; n++) {
+        uint32_t *row = &con->cells[(size_t)con->top * con->columns];
+        for (uint8_t column = 0; column < con->columns; column++) {
+            row[column] = CONSOLE_BLANK;
+        }
+        con->top = (uint8_t)((con->top + 1) % con->rows);
+    }
+    if (con->hardware) {
+        // Cleared rows are the only ones whose framebuffer rows change
+        for (uint8_t row = con->rows - lines; row < con->rows; row++) {
+            for (uint8_t column = 0; column < con->columns; column++) {
+                cs_update(con, row, column);
+            }
+        }
+    } else {
+        for (uint8_t row = 0; row < con->rows; row++) {
+            for (uint8_t column = 0; column < con->columns; column++) {
+                cs_update(con, row, column);
+            }
+        }
+    }
+    return LAYOUT_OK;
+}
+
+// Writes at the cursor like a terminal: '\n' starts a new line, '\r' returns
+// to column 0, text wraps at the end of a row and the console scrolls at the
+// bottom
+int8_t console_write(ConsolePtr console, const uint8_t *text, size_t len) {
+    Console *con = cs_get(console);
+    if (con == NULL) {
+        return LAYOUT_ERR_INVALID;
+    }
+    size_t i = 0;
+    while (i < len) {
+        uint32_t c = font_utf8_next(text, len, &i);
+        if (c == FONT_UTF8_INVALID) {
+            errno = EINVAL;
+            LOG_ERROR(LOG_CAT_LAYOUT, "Invalid character", c);
+            return LAYOUT_ERR_INVALID_DATA;
+        }
+        if (c == '\r') {
+            con->cursor_column = 0;
+            continue;
+        }
+        if (c != '\n' && con->cursor_column < con->columns) {
+            cs_set(con, con->cursor_row, con->cursor_column++, c);
+            continue;
+        }
+        // '\n', or a character past the end of the row that wraps to the next
+        con->cursor_column = 0;
+        if (con->cursor_row + 1 < con->rows) {
+            con->cursor_row++;
+        } else {
+            console_scroll(con, 1);
+        }
+        if (c != '\n') {
+            cs_set(con, con->cursor_row, con->cursor_column++, c);
+        }
+    }
+    return LAYOUT_OK;
+}
+
+int8_t console_set_cursor(ConsolePtr console, uint8_t row, uint8_t column) {
+    Console *con = cs_get(console);
+    if (con == NULL) {
+        return LAYOUT_ERR_INVALID;
+    }
+    if (row >= con->rows || column > con->columns) {
+        errno = EINVAL;
+        LOG_ERROR(LOG_CAT_LAYOUT, "Invalid console cell", errno);
+        return LAYOUT_ERR_INVALID_POINT;
+    }
+    con->cursor_row = row;
+    con->cursor_column = column;
+    return LAYOUT_OK;
+}
+
+int8_t console_clear(ConsolePtr console) {
+    Console *con = cs_get(console);
+    if (con == NULL) {
+        return LAYOUT_ERR_INVALID;
+    }
+    for (uint8_t row = 0; row < con->rows; row++) {
+        for (uint8_t column = 0; column < con->columns; column++) {
+            cs_set(con, row, column, CONSOLE_BLANK);
+        }
+    }
+    con->cursor_row = 0;
+    con->cursor_column = 0;
+    return LAYOUT_OK;
+}
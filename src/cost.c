@@ -0,0 +1,137 @@
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <errno.h>
+
+#include "cost.h"
+#include "i2c.h"
+#include "layout.h"
+#include "layout-internal.h"
+#include "log.h"
+
+typedef struct {
+    const BusConfig *bus;
+    WireCost *cost;
+} CostContext;
+
+void cost_reset(WireCost *cost) {
+    cost->transactions = 0;
+    cost->command_bytes = 0;
+    cost->data_bytes = 0;
+    cost->framing_bytes = 0;
+    cost->bits = 0;
+    cost->time_ns = 0;
+}
+
+static void cost_add_transaction(const BusConfig *bus, size_t len, WireCost *cost) {
+    uint64_t bits = 0;
+    if (bus->type == BUS_I2C) {
+        // START + address + control byte, then the payload, then STOP; every byte carries an ACK bit
+        bits = 1 + 9 * (2 + len) + 1;
+        cost->framing_bytes += 2;
+    } else {
+        // D/C is a separate line, so only the payload is clocked out
+        bits = 8 * len;
+    }
+    cost->transactions++;
+    cost->bits += bits;
+    cost->time_ns += bits * 1000000000ULL / bus->clock_hz + bus->overhead_ns;
+}
+
+int8_t cost_add_transfer(const BusConfig *bus, bool command, size_t len, WireCost *cost) {
+    if (bus == NULL || cost == NULL || bus->clock_hz == 0) {
+        errno = EINVAL;
+        LOG_ERROR(LOG_CAT_LAYOUT, "Invalid cost model arguments", errno);
+        return LAYOUT_ERR_INVALID;
+    }
+    if (command) {
+        cost->command_bytes += len;
+    } else {
+        cost->data_bytes += len;
+    }
+    if (bus->type == BUS_I2C) {
+        // Mirrors the chunking done by i2c_send
+        while (len > I2C_MAX_CHUNK) {
+            cost_add_transaction(bus, I2C_MAX_CHUNK, cost);
+            len -= I2C_MAX_CHUNK;
+        }
+    }
+    cost_add_transaction(bus, len, cost);
+    return LAYOUT_OK;
+}
+
+static bool cost_visit_command(void *ctx, const uint8_t *cmds, size_t len) {
+    (void)cmds;
+    CostContext *c = (CostContext *)ctx;
+    cost_add_transfer(c->bus, true, len, c->cost);
+    return true;
+}
+
+static bool cost_visit_data(void *ctx, const uint8_t *data, size_t len) {
+    (void)data;
+    CostContext *c = (CostContext *)ctx;
+    cost_add_transfer(c->bus, false, len, c->cost);
+    return true;
+}
+
+int8_t cost_layout_flush(LayoutPtr layout_, const BusConfig *bus, uint32_t tiles, WireCost *cost) {
+    Layout *layout = (Layout *)layout_;
+    if (layout == NULL || bus == NULL || cost == NULL || bus->clock_hz == 0) {
+        errno = EINVAL;
+        LOG_ERROR(LOG_CAT_LAYOUT, "Invalid cost model arguments", errno);
+        return LAYOUT_ERR_INVALID;
+    }
+    CostContext c = {bus, cost};
+    FlushVisitor visitor = {
+        .command = cost_visit_command,
+        .data = cost_visit_data,
+        .ctx = &c,
+        .addressing = layout->controller.addressing,
+    };
+    cost_reset(cost);
+    lt_prepare_tiles(layout);
+    // A flush stops an active scroll first and rewrites the scrolled tiles in full
+    bool stop = lt_scroll_conflicts(layout);
+    if (stop) {
+        cost_add_transfer(bus, true, 1, cost);
+    }
+    if (!lt_plan_orientation(layout, &visitor)) {
+        return LAYOUT_ERR_OTHER;
+    }
+    bool sent = false;
+    for (int i = 0; i < layout->num_tiles; i++) {
+        Tile tile;
+        lt_pending_tile(layout, &layout->tiles[i], &tile);
+        if (stop && lt_tile_scrolled(layout, &tile)) {
+            tile_setdirty(&tile, true);
+        }
+        bool selected = tiles == COST_DIRTY_TILES ? tile_isdirty(&tile) : (tiles >> i) & 1;
+        if (selected && !lt_plan_tile(layout, &tile, &visitor)) {
+            return LAYOUT_ERR_OTHER;
+        }
+        sent |= selected;
+    }
+    ScrollState scroll = layout->controller.scroll;
+    uint8_t start_line = layout->start_line;
+    if (stop) {
+        layout->controller.scroll.active = 0;
+    }
+    if (layout->double_buffer && sent) {
+        layout->start_line = lt_buffer_line(layout, layout->ram_page);     // the flip
+    }
+    bool ok = lt_plan_controller(layout, &visitor);
+    layout->controller.scroll = scroll;
+    layout->start_line = start_line;
+    return ok ? LAYOUT_OK : LAYOUT_ERR_OTHER;
+}
+
+double cost_layout_max_fps(LayoutPtr layout, const BusConfig *bus, uint32_t tiles) {
+    WireCost cost;
+    if (cost_layout_flush(layout, bus, tiles, &cost) != LAYOUT_OK) {
+        return 0.0;
+    }
+    if (cost.time_ns == 0) {
+        return 0.0;     // nothing to send
+    }
+    return 1e9 / (double)cost.time_ns;
+}
@@ -0,0 +1,133 @@
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include "layout.h"
+#include "layout-internal.h"
+#include "blit.h"
+#include "log.h"
+
+static bool lt_defer_covers(const TileDeferOp *op, const TileDeferOp *e) {
+    return e->x0 >= op->x0 && e->x1 <= op->x1 && e->y0 >= op->y0 && e->y1 <= op->y1;
+}
+
+// Records an op, dropping the ones it paints over; the op's box must already be
+// clipped to the tile. False when it cannot be recorded: pending ops have been
+// rasterized then, and the caller draws it now.
+bool lt_defer_add(Layout *layout, Tile *tile, const TileDeferOp *op, const uint8_t *data, size_t len) {
+    TileDefer *d = tile->defer;
+    if (op->opaque) {
+        uint8_t kept = 0;
+        uint16_t used = 0;
+        for (uint8_t i = 0; i < d->count; i++) {
+            TileDeferOp *e = &d->ops[i];
+            if (lt_defer_covers(op, e)) {
+                continue;
+            }
+            memmove(d->arena + used, d->arena + e->offset, e->len);
+            e->offset = used;
+            used += e->len;
+            d->ops[kept++] = *e;
+        }
+        d->count = kept;
+        d->used = used;
+    }
+    if (d->count == LT_DEFER_MAX_OPS || len > (size_t)(LT_DEFER_ARENA - d->used)) {
+        lt_defer_resolve(layout, tile);
+        if (len > LT_DEFER_ARENA) {
+            return false;
+        }
+    }
+    TileDeferOp *e = &d->ops[d->count++];
+    *e = *op;
+    e->offset = d->used;
+    e->len = (uint16_t)len;
+    if (len > 0) {
+        memcpy(d->arena + d->used, data, len);
+    }
+    d->used += (uint16_t)len;
+    return true;
+}
+
+// Rasterizes the recorded ops in order, through the same calls that recorded them
+void lt_defer_resolve(Layout *layout, Tile *tile) {
+    TileDefer *d = tile->defer;
+    if (d == NULL || d->count == 0 || d->replaying) {
+        return;
+    }
+    uint8_t index = (uint8_t)(tile - layout->tiles);
+    uint8_t count = d->count;
+    d->count = 0;
+    d->replaying = true;
+    for (uint8_t i = 0; i < count; i++) {
+        TileDeferOp *e = &d->ops[i];
+        const uint8_t *data = d->arena + e->offset;
+        switch (e->kind) {
+            case LT_DEFER_PRINT:
+                lt_print(layout, tile, data, e->len, e->face, e->arg);
+                break;
+            case LT_DEFER_CLEAR:
+                layout_clear_tile(layout, index, e->arg);
+                break;
+            case LT_DEFER_TEXT:
+                layout_draw_text(layout, index, e->x, e->y, data, e->len, e->face, (BlitOp)e->arg);
+                break;
+            case LT_DEFER_BLIT:
+                layout_blit(layout, index, e->x, e->y, data, e->width, e->height, (BlitOp)e->arg);
+                break;
+        }
+    }
+    d->replaying = false;
+    d->used = 0;
+}
+
+void lt_defer_resolve_all(Layout *layout) {
+    for (int i = 0; i < layout->num_tiles; i++) {
+        lt_defer_resolve(layout, &layout->tiles[i]);
+    }
+}
+
+// Forgets what is recorded, e.g. when the whole layout is cleared over it
+void lt_defer_drop(Tile *tile) {
+    if (tile->defer != NULL) {
+        tile->defer->count = 0;
+        tile->defer->used = 0;
+    }
+}
+
+// Deferred drawing: prints, clears, layout_draw_text and layout_blit on the
+// tile are checked and recorded instead of drawn. Each one that paints over
+// earlier ones (a print or clear, or an opaque BLIT_SET box) drops them, and
+// what is left is rasterized once, by the next flush or the first other access
+// to the tile's pixels, a gfx_* primitive included: those are not recorded. A
+// print that would fail records nothing. Turning it off draws what is pending.
+int8_t layout_set_deferred(LayoutPtr layout_, uint8_t tile, bool enable) {
+    Layout *layout = (Layout *)layout_;
+    if (layout == NULL) {
+        errno = EINVAL;
+        LOG_ERROR(LOG_CAT_LAYOUT, "Layout is NULL", errno);
+        return LAYOUT_ERR_INVALID;
+    }
+    if (tile >= layout->num_tiles) {
+        errno = EINVAL;
+        LOG_ERROR(LOG_CAT_LAYOUT, "Invalid tile index", errno);
+        return LAYOUT_ERR_INVALID_TILE;
+    }
+    Tile *t = &layout->tiles[tile];
+    if (enable && t->defer == NULL) {
+        t->defer = calloc(1, sizeof(TileDefer));
+        if (t->defer == NULL) {
+            errno = ENOMEM;
+            LOG_ERROR(LOG_CAT_LAYOUT, "Failed to allocate memory for display list", errno);
+            return LAYOUT_ERR_OTHER;
+        }
+    } else if (!enable && t->defer != NULL) {
+        lt_defer_resolve(layout, t);
+        free(t->defer);
+        t->defer = NULL;
+    }
+    return LAYOUT_OK;
+}
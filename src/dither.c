@@ -0,0 +1,264 @@
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include "dither.h"
+#include "image.h"
+#include "layout.h"
+#include "layout-internal.h"
+#include "log.h"
+
+// SSE2 is part of the x86-64 baseline, so unlike the transpose kernels this
+// needs no runtime check
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define DITHER_SSE2 1
+#include <emmintrin.h>
+#else
+#define DITHER_SSE2 0
+#endif
+
+#define DT_PAD 2                    // error row margin for the x - 1 and x + 2 taps
+
+typedef struct {
+    LayoutPtr layout;
+    uint8_t tile;
+    int16_t x;
+    int16_t y;
+    uint16_t width;
+    DitherMethod method;
+    int32_t rows_left;              // rows still landing inside the tile
+    uint16_t row;                   // rows pushed so far
+    uint8_t band_rows;              // rows packed in the current band
+    size_t stride;                  // bytes per packed row
+    uint8_t *bits;                  // [8][stride] packed rows, LSB first
+    int16_t *err_buf;
+    int16_t *err[3];                // error rows for this row and the next two, rotating in err_buf
+} Dither;
+
+static const uint8_t dt_bayer[8][8] = {
+    { 0, 32,  8, 40,  2, 34, 10, 42},
+    {48, 16, 56, 24, 50, 18, 58, 26},
+    {12, 44,  4, 36, 14, 46,  6, 38},
+    {60, 28, 52, 20, 62, 30, 54, 22},
+    { 3, 35, 11, 43,  1, 33,  9, 41},
+    {51, 19, 59, 27, 49, 17, 57, 25},
+    {15, 47,  7, 39, 13, 45,  5, 37},
+    {63, 31, 55, 23, 61, 29, 53, 21},
+};
+
+// A pixel is lit when it is above its threshold
+static void dt_ordered(const uint8_t *gray, uint16_t width, const uint8_t thresholds[8], uint8_t *bits) {
+    uint16_t x = 0;
+#if DITHER_SSE2
+    uint8_t t16[16];
+    for (int i = 0; i < 16; i++) {
+        t16[i] = thresholds[i % 8] ^ 0x80;
+    }
+    __m128i t = _mm_loadu_si128((const __m128i *)t16);
+    __m128i sign = _mm_set1_epi8((char)0x80);
+    for (; x + 16 <= width; x += 16) {
+        __m128i g = _mm_xor_si128(_mm_loadu_si128((const __m128i *)(gray + x)), sign);
+        int m = _mm_movemask_epi8(_mm_cmpgt_epi8(g, t));
+        bits[x / 8] = (uint8_t)m;
+        bits[x / 8 + 1] = (uint8_t)(m >> 8);
+    }
+#endif
+    for (; x < width; x++) {
+        if (gray[x] > thresholds[x % 8]) {
+            bits[x / 8] |= (uint8_t)(1u << (x % 8));
+        }
+    }
+}
+
+// Quantizes a row left to right, carrying the error to the right neighbours.
+// Leaves in `e` the error each pixel hands to the rows below: the full error
+// for Floyd-Steinberg, the 1/8 share for Atkinson.
+static void dt_diffuse_row(const uint8_t *gray, uint16_t width, bool atkinson, int16_t *e, uint8_t *bits) {
+    for (uint16_t x = 0; x < width; x++) {
+        int16_t v = (int16_t)(gray[x] + e[x]);
+        int16_t q = v;
+        if (v >= 128) {
+            bits[x / 8] |= (uint8_t)(1u << (x % 8));
+            q = (int16_t)(v - 255);
+        }
+        if (atkinson) {
+            int16_t d = (int16_t)(q >> 3);
+            e[x] = d;
+            e[x + 1] += d;
+            e[x + 2] += d;
+        } else {
+            e[x] = q;
+            e[x + 1] += (int16_t)((q * 7) >> 4);
+        }
+    }
+    // The carry past the right edge and whatever is left of the margin are not errors of this row
+    e[-1] = 0;
+    e[width] = 0;
+    e[width + 1] = 0;
+}
+
+// Adds this row's errors to the rows below. Every output depends only on the
+// finished row, so this half of the diffusion runs in 8-pixel batches.
+static void dt_spread(const int16_t *e, uint16_t width, bool atkinson, int16_t *next, int16_t *next2) {
+    uint16_t x = 0;
+#if DITHER_SSE2
+    if (atkinson) {
+        for (; x + 8 <= width; x += 8) {
+            __m128i l = _mm_loadu_si128((const __m128i *)(e + x - 1));
+            __m128i c = _mm_loadu_si128((const __m128i *)(e + x));
+            __m128i r = _mm_loadu_si128((const __m128i *)(e + x + 1));
+            __m128i n = _mm_loadu_si128((const __m128i *)(next + x));
+            __m128i n2 = _mm_loadu_si128((const __m128i *)(next2 + x));
+            _mm_storeu_si128((__m128i *)(next + x), _mm_add_epi16(n, _mm_add_epi16(_mm_add_epi16(l, c), r)));
+            _mm_storeu_si128((__m128i *)(next2 + x), _mm_add_epi16(n2, c));
+        }
+    } else {
+        __m128i k3 = _mm_set1_epi16(3);
+        __m128i k5 = _mm_set1_epi16(5);
+        for (; x + 8 <= width; x += 8) {
+            __m128i l = _mm_loadu_si128((const __m128i *)(e + x - 1));
+            __m128i c = _mm_loadu_si128((const __m128i *)(e + x));
+            __m128i r = _mm_loadu_si128((const __m128i *)(e + x + 1));
+            __m128i n = _mm_loadu_si128((const __m128i *)(next + x));
+            __m128i s = _mm_add_epi16(_mm_srai_epi16(_mm_mullo_epi16(r, k3), 4),
+                                      _mm_srai_epi16(_mm_mullo_epi16(c, k5), 4));
+            s = _mm_add_epi16(s, _mm_srai_epi16(l, 4));
+            _mm_storeu_si128((__m128i *)(next + x), _mm_add_epi16(n, s));
+        }
+    }
+#endif
+    for (; x < width; x++) {
+        if (atkinson) {
+            next[x] += (int16_t)(e[x - 1] + e[x] + e[x + 1]);
+            next2[x] += e[x];
+        } else {
+            next[x] += (int16_t)(((e[x + 1] * 3) >> 4) + ((e[x] * 5) >> 4) + (e[x - 1] >> 4));
+        }
+    }
+}
+
+DitherPtr dither_create(LayoutPtr layout_, uint8_t tile, int16_t x, int16_t y, uint16_t width, DitherMethod method) {
+    Layout *layout = (Layout *)layout_;
+    if (layout == NULL || width == 0 || method > DITHER_ATKINSON) {
+        errno = EINVAL;
+        LOG_ERROR(LOG_CAT_LAYOUT, "Invalid dither arguments", errno);
+        return NULL;
+    }
+    if (tile >= layout->num_tiles) {
+        errno = EINVAL;
+        LOG_ERROR(LOG_CAT_LAYOUT, "Invalid tile index", errno);
+        return NULL;
+    }
+    Dither *d = calloc(1, sizeof(Dither));
+    size_t stride = (width + 7) / 8;
+    size_t err_len = (size_t)width + 2 * DT_PAD;
+    uint8_t *bits = calloc(8 * stride, 1);
+    int16_t *err = calloc(3 * err_len, sizeof(int16_t));
+    if (d == NULL || bits == NULL || err == NULL) {
+        free(d);
+        free(bits);
+        free(err);
+        errno = ENOMEM;
+        LOG_ERROR(LOG_CAT_LAYOUT, "Failed to allocate memory for dither", errno);
+        return NULL;
+    }
+    d->layout = layout_;
+    d->tile = tile;
+    d->x = x;
+    d->y = y;
+    d->width = width;
+    d->method = method;
+    d->rows_left = (int32_t)tile_get_height(&layout->tiles[tile]) * 8 - y;
+    d->stride = stride;
+    d->bits = bits;
+    d->err_buf = err;
+    for (int i = 0; i < 3; i++) {
+        d->err[i] = err + i * err_len + DT_PAD;
+    }
+    return d;
+}
+
+void dither_free(DitherPtr dither) {
+    Dither *d = (Dither *)dither;
+    if (d != NULL) {
+        free(d->bits);
+        free(d->err_buf);
+        free(d);
+    }
+}
+
+int8_t dither_flush(DitherPtr dither) {
+    Dither *d = (Dither *)dither;
+    if (d == NULL) {
+        errno = EINVAL;
+        LOG_ERROR(LOG_CAT_LAYOUT, "Dither is NULL", errno);
+        return LAYOUT_ERR_INVALID;
+    }
+    if (d->band_rows == 0) {
+        return LAYOUT_OK;
+    }
+    int8_t ret = layout_import_image(d->layout, d->tile, d->x, (int16_t)(d->y + d->row - d->band_rows),
+                                     d->bits, d->width, d->band_rows, d->stride, IMAGE_LSB_FIRST);
+    d->band_rows = 0;
+    return ret;
+}
+
+int8_t dither_row(DitherPtr dither, const uint8_t *gray) {
+    Dither *d = (Dither *)dither;
+    if (d == NULL || gray == NULL) {
+        errno = EINVAL;
+        LOG_ERROR(LOG_CAT_LAYOUT, "Dither or row is NULL", errno);
+        return LAYOUT_ERR_INVALID;
+    }
+    if (d->row >= d->rows_left) {
+        return LAYOUT_OK;           // below the tile, and errors only travel down
+    }
+    uint8_t *bits = d->bits + d->band_rows * d->stride;
+    memset(bits, 0, d->stride);
+    if (d->method == DITHER_BAYER || d->method == DITHER_THRESHOLD) {
+        uint8_t thresholds[8];
+        for (int i = 0; i < 8; i++) {
+            thresholds[i] = d->method == DITHER_BAYER ? (uint8_t)(dt_bayer[d->row % 8][i] * 4 + 2) : 127;
+        }
+        dt_ordered(gray, d->width, thresholds, bits);
+    } else {
+        bool atkinson = d->method == DITHER_ATKINSON;
+        int16_t *e = d->err[0];
+        dt_diffuse_row(gray, d->width, atkinson, e, bits);
+        dt_spread(e, d->width, atkinson, d->err[1], d->err[2]);
+        memset(e, 0, d->width * sizeof(int16_t));
+        d->err[0] = d->err[1];
+        d->err[1] = d->err[2];
+        d->err[2] = e;
+    }
+    d->row++;
+    if (++d->band_rows == 8) {
+        return dither_flush(d);
+    }
+    return LAYOUT_OK;
+}
+
+int8_t layout_dither_image(LayoutPtr layout, uint8_t tile, int16_t x, int16_t y, const uint8_t *gray,
+                           uint16_t width, uint16_t height, size_t stride, DitherMethod method) {
+    if (gray == NULL || stride < width) {
+        errno = EINVAL;
+        LOG_ERROR(LOG_CAT_LAYOUT, "Invalid grayscale image", errno);
+        return LAYOUT_ERR_INVALID_DATA;
+    }
+    DitherPtr d = dither_create(layout, tile, x, y, width, method);
+    if (d == NULL) {
+        return LAYOUT_ERR_INVALID;
+    }
+    int8_t ret = LAYOUT_OK;
+    for (uint16_t row = 0; row < height && ret == LAYOUT_OK; row++) {
+        ret = dither_row(d, gray + row * stride);
+    }
+    if (ret == LAYOUT_OK) {
+        ret = dither_flush(d);
+    }
+    dither_free(d);
+    return ret;
+}
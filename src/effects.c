@@ -0,0 +1,160 @@
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <errno.h>
+
+#include "effects.h"
+#include "layout.h"
+#include "layout-internal.h"
+#include "ssd1306.h"
+#include "timing.h"
+#include "log.h"
+
+#define EFFECT_FADE_STEP_US 8000    // shortest interval between contrast steps
+
+int8_t layout_start_marquee(LayoutPtr layout_, uint8_t tile, MarqueeDirection direction, MarqueeSpeed speed) {
+    Layout *layout = (Layout *)layout_;
+    if (layout == NULL || direction > MARQUEE_LEFT || (uint8_t)speed > MARQUEE_2_FRAMES) {
+        errno = EINVAL;
+        LOG_ERROR(LOG_CAT_LAYOUT, "Invalid marquee arguments", errno);
+        return LAYOUT_ERR_INVALID;
+    }
+    if (tile >= layout->num_tiles) {
+        errno = EINVAL;
+        LOG_ERROR(LOG_CAT_LAYOUT, "Invalid tile index", errno);
+        return LAYOUT_ERR_INVALID_TILE;
+    }
+    if (layout->panel != NULL && (layout->panel->flags & PANEL_FLAG_PAGE_ADDRESSING_ONLY)) {
+        // SH1106 has no scroll commands (26h/27h/2Fh)
+        errno = EINVAL;
+        LOG_ERROR(LOG_CAT_LAYOUT, "Panel cannot scroll", errno);
+        return LAYOUT_ERR_INVALID;
+    }
+    if (layout->double_buffer) {
+        errno = EBUSY;
+        LOG_ERROR(LOG_CAT_LAYOUT, "Cannot scroll while double buffering", errno);
+        return LAYOUT_ERR_INVALID;
+    }
+    if (layout->transposed) {
+        errno = EINVAL;
+        LOG_ERROR(LOG_CAT_LAYOUT, "Cannot scroll a layout rotated by 90 degrees", errno);
+        return LAYOUT_ERR_INVALID;
+    }
+    Tile *t = &layout->tiles[tile];
+    // The controller scrolls GDDRAM columns, which run backwards when remapped
+    bool left = (direction == MARQUEE_LEFT) != (layout->segment_remap == SSD1306_OPTION_SEGMENT_REMAP_SEG0_TO_127);
+    layout->scroll = (ScrollState){
+        .active = 1,
+        .direction = left ? SSD1306_OPTION_HORIZONTAL_SCROLL_LEFT : SSD1306_OPTION_HORIZONTAL_SCROLL_RIGHT,
+        .first_page = t->start.page,
+        .last_page = t->end.page,
+        .interval = (uint8_t)speed,
+    };
+    return LAYOUT_OK;
+}
+
+// Takes effect with the next flush, which also puts the scrolled pages back
+int8_t layout_stop_marquee(LayoutPtr layout_) {
+    Layout *layout = (Layout *)layout_;
+    if (layout == NULL) {
+        errno = EINVAL;
+        LOG_ERROR(LOG_CAT_LAYOUT, "Layout is NULL", errno);
+        return LAYOUT_ERR_INVALID;
+    }
+    layout->scroll.active = 0;
+    return LAYOUT_OK;
+}
+
+static int8_t fx_contrast(Layout *layout, uint8_t contrast) {
+    uint8_t cmd[] = {SSD1306_CMD_SET_CONTRAST(contrast)};
+    if (!ssd1306_send_commands(cmd, sizeof(cmd))) {
+        errno = EIO;
+        LOG_ERROR(LOG_CAT_LAYOUT, "Failed to set contrast", contrast);
+        return LAYOUT_ERR_FLUSH;
+    }
+    layout->controller.contrast = contrast;
+    return LAYOUT_OK;
+}
+
+static int8_t fx_display(Layout *layout, uint8_t option) {
+    uint8_t cmd[] = {SSD1306_CMD_SET_DISPLAY(option)};
+    if (!ssd1306_send_commands(cmd, sizeof(cmd))) {
+        errno = EIO;
+        LOG_ERROR(LOG_CAT_LAYOUT, "Failed to set display mode", option);
+        return LAYOUT_ERR_FLUSH;
+    }
+    layout->controller.display = option;
+    return LAYOUT_OK;
+}
+
+int8_t layout_set_contrast(LayoutPtr layout_, uint8_t contrast) {
+    Layout *layout = (Layout *)layout_;
+    if (layout == NULL) {
+        errno = EINVAL;
+        LOG_ERROR(LOG_CAT_LAYOUT, "Layout is NULL", errno);
+        return LAYOUT_ERR_INVALID;
+    }
+    return layout->controller.contrast == contrast ? LAYOUT_OK : fx_contrast(layout, contrast);
+}
+
+int8_t layout_set_inverted(LayoutPtr layout_, bool inverted) {
+    Layout *layout = (Layout *)layout_;
+    if (layout == NULL) {
+        errno = EINVAL;
+        LOG_ERROR(LOG_CAT_LAYOUT, "Layout is NULL", errno);
+        return LAYOUT_ERR_INVALID;
+    }
+    uint8_t option = inverted ? SSD1306_OPTION_DISPLAY_INVERT : SSD1306_OPTION_DISPLAY_NORMAL;
+    return layout->controller.display == option ? LAYOUT_OK : fx_display(layout, option);
+}
+
+int8_t layout_fade_contrast(LayoutPtr layout_, uint8_t target, uint16_t duration_ms) {
+    Layout *layout = (Layout *)layout_;
+    if (layout == NULL) {
+        errno = EINVAL;
+        LOG_ERROR(LOG_CAT_LAYOUT, "Layout is NULL", errno);
+        return LAYOUT_ERR_INVALID;
+    }
+    int16_t from = layout->controller.contrast;
+    int16_t delta = (int16_t)(target - from);
+    uint32_t duration_us = (uint32_t)duration_ms * 1000;
+    // One step per contrast level, unless that would outpace the bus
+    uint32_t steps = (uint32_t)abs(delta);
+    if (steps > duration_us / EFFECT_FADE_STEP_US) {
+        steps = duration_us / EFFECT_FADE_STEP_US;
+    }
+    if (steps == 0) {
+        return layout_set_contrast(layout, target);
+    }
+    uint64_t start = timing_now_us();
+    for (uint32_t i = 1; i <= steps; i++) {
+        timing_sleep_until_us(start + (uint64_t)duration_us * i / steps);
+        int8_t ret = fx_contrast(layout, (uint8_t)(from + delta * (int32_t)i / (int32_t)steps));
+        if (ret != LAYOUT_OK) {
+            return ret;
+        }
+    }
+    return LAYOUT_OK;
+}
+
+int8_t layout_blink(LayoutPtr layout_, uint8_t count, uint16_t period_ms) {
+    Layout *layout = (Layout *)layout_;
+    if (layout == NULL) {
+        errno = EINVAL;
+        LOG_ERROR(LOG_CAT_LAYOUT, "Layout is NULL", errno);
+        return LAYOUT_ERR_INVALID;
+    }
+    uint8_t normal = layout->controller.display;
+    uint8_t inverse = normal == SSD1306_OPTION_DISPLAY_INVERT ? SSD1306_OPTION_DISPLAY_NORMAL
+                                                               : SSD1306_OPTION_DISPLAY_INVERT;
+    uint64_t start = timing_now_us();
+    for (uint16_t i = 0; i < 2 * count; i++) {
+        int8_t ret = fx_display(layout, i % 2 == 0 ? inverse : normal);
+        if (ret != LAYOUT_OK) {
+            return ret;
+        }
+        timing_sleep_until_us(start + (uint64_t)period_ms * 500 * (i + 1));
+    }
+    return LAYOUT_OK;
+}
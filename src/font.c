@@ -0,0 +1,45 @@
+#include <stddef.h>
+#include <stdint.h>
+
+#include "font.h"
+
+uint32_t font_utf8_next(const uint8_t *text, size_t len, size_t *pos) {
+    uint8_t lead = text[*pos];
+    uint32_t c;
+    uint8_t extra;
+    if (lead < 0x80) {
+        (*pos)++;
+        return lead;
+    } else if ((lead & 0xE0) == 0xC0) {
+        c = lead & 0x1F;
+        extra = 1;
+    } else if ((lead & 0xF0) == 0xE0) {
+        c = lead & 0x0F;
+        extra = 2;
+    } else if ((lead & 0xF8) == 0xF0) {
+        c = lead & 0x07;
+        extra = 3;
+    } else {
+        (*pos)++;
+        return FONT_UTF8_INVALID;
+    }
+    if (*pos + extra >= len) {
+        *pos = len;
+        return FONT_UTF8_INVALID;
+    }
+    for (uint8_t i = 1; i <= extra; i++) {
+        uint8_t b = text[*pos + i];
+        if ((b & 0xC0) != 0x80) {
+            *pos += i;
+            return FONT_UTF8_INVALID;
+        }
+        c = (c << 6) | (b & 0x3F);
+    }
+    *pos += 1 + extra;
+    // Reject overlong forms and surrogates
+    if ((extra == 1 && c < 0x80) || (extra == 2 && c < 0x800) || (extra == 3 && c < 0x10000)
+            || (c >= 0xD800 && c <= 0xDFFF) || c > 0x10FFFF) {
+        return FONT_UTF8_INVALID;
+    }
+    return c;
+}
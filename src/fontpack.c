@@ -0,0 +1,187 @@
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include "fontpack.h"
+#include "font.h"
+#include "mapfile.h"
+#include "log.h"
+
+#define FONT_PACK_MAGIC         "SFPK"
+#define FONT_PACK_VERSION       1
+#define FONT_PACK_HEADER_SIZE   16
+#define FONT_PACK_ENTRY_SIZE    48
+
+typedef struct {
+    char name[16];
+    FontFace face;
+    uint32_t num_ranges;
+    const uint32_t *ranges;
+} FontPackFont;
+
+typedef struct {
+    MapFile map;
+    uint16_t num_fonts;
+    FontPackFont fonts[];
+} FontPack;
+
+// The pack is little-endian and may sit at any alignment, so fields are read bytewise
+static uint16_t fp_u16(const uint8_t *p) {
+    return (uint16_t)(p[0] | (p[1] << 8));
+}
+
+static uint32_t fp_u32(const uint8_t *p) {
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static bool fp_in_bounds(size_t size, uint32_t offset, size_t len, size_t align) {
+    return offset % align == 0 && offset <= size && len <= size - offset;
+}
+
+static bool fp_load_font(const uint8_t *base, size_t size, const uint8_t *entry, FontPackFont *font) {
+    memcpy(font->name, entry, 15);
+    font->name[15] = '\0';
+    uint8_t pages = entry[16];
+    uint8_t stride = entry[17];
+    uint32_t count = fp_u32(entry + 20);
+    uint32_t glyphs = fp_u32(entry + 24);
+    uint32_t widths = fp_u32(entry + 28);
+    uint32_t blocks = fp_u32(entry + 32);
+    uint32_t index = fp_u32(entry + 36);
+    uint32_t num_ranges = fp_u32(entry + 40);
+    uint32_t ranges = fp_u32(entry + 44);
+    if (pages == 0 || stride == 0 || count >= FONT_NO_GLYPH
+            || !fp_in_bounds(size, glyphs, (size_t)count * pages * stride, 1)
+            || !fp_in_bounds(size, widths, count, 1)
+            || !fp_in_bounds(size, blocks, FONT_BLOCKS * sizeof(uint16_t), sizeof(uint16_t))
+            || !fp_in_bounds(size, ranges, (size_t)num_ranges * 2 * sizeof(uint32_t), sizeof(uint32_t))) {
+        return false;
+    }
+    const uint16_t *block_table = (const uint16_t *)(base + blocks);
+    uint16_t slots = 0;
+    for (size_t i = 0; i < FONT_BLOCKS; i++) {
+        if (block_table[i] != FONT_NO_GLYPH && block_table[i] + 1 > slots) {
+            slots = block_table[i] + 1;
+        }
+    }
+    if (!fp_in_bounds(size, index, (size_t)slots * FONT_BLOCK_SIZE * sizeof(uint16_t), sizeof(uint16_t))) {
+        return false;
+    }
+    const uint16_t *index_table = (const uint16_t *)(base + index);
+    for (size_t i = 0; i < (size_t)slots * FONT_BLOCK_SIZE; i++) {
+        if (index_table[i] != FONT_NO_GLYPH && index_table[i] >= count) {
+            return false;
+        }
+    }
+    font->face = (FontFace){
+        .pages = pages,
+        .stride = stride,
+        .first = 0,
+        .count = count,
+        .glyphs = base + glyphs,
+        .widths = base + widths,
+        .blocks = block_table,
+        .index = index_table,
+    };
+    font->num_ranges = num_ranges;
+    font->ranges = (const uint32_t *)(base + ranges);
+    return true;
+}
+
+FontPackPtr fontpack_open(const char *path) {
+    MapFile map;
+    if (!mapfile_open(&map, path, 0, false)) {
+        errno = ENOENT;
+        LOG_ERROR(LOG_CAT_APP, "Failed to map font pack", errno);
+        return NULL;
+    }
+    const uint8_t *base = (const uint8_t *)map.addr;
+    if (map.size < FONT_PACK_HEADER_SIZE || memcmp(base, FONT_PACK_MAGIC, 4) != 0
+            || fp_u16(base + 4) != FONT_PACK_VERSION || fp_u32(base + 8) > map.size) {
+        errno = EINVAL;
+        LOG_ERROR(LOG_CAT_APP, "Not a font pack", errno);
+        mapfile_close(&map);
+        return NULL;
+    }
+    uint16_t num_fonts = fp_u16(base + 6);
+    if (!fp_in_bounds(map.size, FONT_PACK_HEADER_SIZE, (size_t)num_fonts * FONT_PACK_ENTRY_SIZE, 1)) {
+        errno = EINVAL;
+        LOG_ERROR(LOG_CAT_APP, "Truncated font pack", errno);
+        mapfile_close(&map);
+        return NULL;
+    }
+    FontPack *pack = malloc(sizeof(FontPack) + num_fonts * sizeof(FontPackFont));
+    if (pack == NULL) {
+        errno = ENOMEM;
+        LOG_ERROR(LOG_CAT_APP, "Failed to allocate memory for font pack", errno);
+        mapfile_close(&map);
+        return NULL;
+    }
+    pack->map = map;
+    pack->num_fonts = num_fonts;
+    for (uint16_t i = 0; i < num_fonts; i++) {
+        const uint8_t *entry = base + FONT_PACK_HEADER_SIZE + i * FONT_PACK_ENTRY_SIZE;
+        if (!fp_load_font(base, map.size, entry, &pack->fonts[i])) {
+            errno = EINVAL;
+            LOG_ERROR(LOG_CAT_APP, "Corrupt font in font pack", i);
+            fontpack_close(pack);
+            return NULL;
+        }
+    }
+    return pack;
+}
+
+void fontpack_close(FontPackPtr pack_) {
+    FontPack *pack = (FontPack *)pack_;
+    if (pack != NULL) {
+        mapfile_close(&pack->map);
+        free(pack);
+    }
+}
+
+uint16_t fontpack_get_num_fonts(FontPackPtr pack_) {
+    FontPack *pack = (FontPack *)pack_;
+    return pack != NULL ? pack->num_fonts : 0;
+}
+
+const char *fontpack_get_name(FontPackPtr pack_, uint16_t font) {
+    FontPack *pack = (FontPack *)pack_;
+    if (pack == NULL || font >= pack->num_fonts) {
+        return NULL;
+    }
+    return pack->fonts[font].name;
+}
+
+const FontFace *fontpack_get_face(FontPackPtr pack_, uint16_t font) {
+    FontPack *pack = (FontPack *)pack_;
+    if (pack == NULL || font >= pack->num_fonts) {
+        return NULL;
+    }
+    return &pack->fonts[font].face;
+}
+
+const FontFace *fontpack_find_face(FontPackPtr pack_, const char *name) {
+    FontPack *pack = (FontPack *)pack_;
+    if (pack == NULL || name == NULL) {
+        return NULL;
+    }
+    for (uint16_t i = 0; i < pack->num_fonts; i++) {
+        if (strcmp(pack->fonts[i].name, name) == 0) {
+            return &pack->fonts[i].face;
+        }
+    }
+    return NULL;
+}
+
+// Code point coverage of a font as (first, last) pairs
+uint32_t fontpack_get_ranges(FontPackPtr pack_, uint16_t font, const uint32_t **ranges) {
+    FontPack *pack = (FontPack *)pack_;
+    if (pack == NULL || font >= pack->num_fonts) {
+        return 0;
+    }
+    *ranges = pack->fonts[font].ranges;
+    return pack->fonts[font].num_ranges;
+}
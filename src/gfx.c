@@ -0,0 +1,353 @@
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+
+#include "gfx.h"
+#include "layout.h"
+#include "layout-internal.h"
+#include "log.h"
+
+#define GFX_BYTES_X8 0x0101010101010101ULL
+
+// Applies `mask` to n consecutive bytes of a page row, eight columns per 64-bit word
+static void gfx_apply_span(uint8_t *row, uint8_t n, uint8_t mask, GfxColor color) {
+    uint64_t m = mask * GFX_BYTES_X8;
+    uint64_t w;
+    switch (color) {
+        case GFX_BLACK:
+            for (; n >= 8; n -= 8, row += 8) {
+                memcpy(&w, row, 8);
+                w &= ~m;
+                memcpy(row, &w, 8);
+            }
+            for (; n > 0; n--, row++) {
+                *row &= (uint8_t)~mask;
+            }
+            break;
+        case GFX_WHITE:
+            if (mask == 0xFF) {
+                memset(row, 0xFF, n);
+                break;
+            }
+            for (; n >= 8; n -= 8, row += 8) {
+                memcpy(&w, row, 8);
+                w |= m;
+                memcpy(row, &w, 8);
+            }
+            for (; n > 0; n--, row++) {
+                *row |= mask;
+            }
+            break;
+        case GFX_INVERT:
+            for (; n >= 8; n -= 8, row += 8) {
+                memcpy(&w, row, 8);
+                w ^= m;
+                memcpy(row, &w, 8);
+            }
+            for (; n > 0; n--, row++) {
+                *row ^= mask;
+            }
+            break;
+    }
+}
+
+// Bits of a page covered by rows [y0, y1] of the tile
+static inline uint8_t gfx_page_mask(uint8_t page, int16_t y0, int16_t y1) {
+    uint8_t mask = 0xFF;
+    if (y0 > page * 8) {
+        mask &= (uint8_t)(0xFF << (y0 - page * 8));
+    }
+    if (y1 < page * 8 + 7) {
+        mask &= (uint8_t)(0xFF >> (page * 8 + 7 - y1));
+    }
+    return mask;
+}
+
+// Clips the box [x0, x1] x [y0, y1] to the tile; false if nothing is left
+static bool gfx_clip(Tile *t, int16_t *x0, int16_t *y0, int16_t *x1, int16_t *y1) {
+    int16_t w = tile_get_width(t);
+    int16_t h = tile_get_height(t) * 8;
+    if (*x0 < 0) *x0 = 0;
+    if (*y0 < 0) *y0 = 0;
+    if (*x1 >= w) *x1 = w - 1;
+    if (*y1 >= h) *y1 = h - 1;
+    return *x0 <= *x1 && *y0 <= *y1;
+}
+
+// Fills the box [x0, x1] x [y0, y1] one page at a time: a single mask per page
+// covers every column of the box
+static void gfx_fill(Layout *layout, Tile *t, int16_t x0, int16_t y0, int16_t x1, int16_t y1, GfxColor color) {
+    if (!gfx_clip(t, &x0, &y0, &x1, &y1)) {
+        return;
+    }
+    for (uint8_t page = y0 / 8; page <= y1 / 8; page++) {
+        gfx_apply_span(lt_tile_row(layout, t, page) + x0, (uint8_t)(x1 - x0 + 1), gfx_page_mask(page, y0, y1), color);
+    }
+    tile_mark_columns(t, (uint8_t)x0, (uint8_t)x1);
+}
+
+static inline void gfx_plot(Layout *layout, Tile *t, int16_t x, int16_t y, GfxColor color) {
+    gfx_fill(layout, t, x, y, x, y, color);
+}
+
+// Pixels of the four quadrant arcs of radius r around the corner centers, off
+// the axes: the axis pixels belong to the straight edges, so nothing is drawn
+// twice (which would undo itself with GFX_INVERT)
+static void gfx_corners(Layout *layout, Tile *t, int16_t left, int16_t top, int16_t right, int16_t bottom,
+                        int16_t r, GfxColor color) {
+    int16_t x = r;
+    int16_t y = 0;
+    int16_t err = 1 - r;
+    while (x >= y) {
+        for (int k = 0; k < 2; k++) {
+            int16_t dx = k ? y : x;
+            int16_t dy = k ? x : y;
+            if (dx > 0 && dy > 0 && (k == 0 || x != y)) {
+                gfx_plot(layout, t, right + dx, bottom + dy, color);
+                gfx_plot(layout, t, left - dx, bottom + dy, color);
+                gfx_plot(layout, t, right + dx, top - dy, color);
+                gfx_plot(layout, t, left - dx, top - dy, color);
+            }
+        }
+        y++;
+        if (err < 0) {
+            err += 2 * y + 1;
+        } else {
+            x--;
+            err += 2 * (y - x) + 1;
+        }
+    }
+}
+
+// Last coordinate of a run of n pixels from `from`, computed wide so large
+// arguments cannot wrap; anything past the int16 range is off every tile
+static inline int16_t gfx_last(int16_t from, int16_t n) {
+    int32_t last = (int32_t)from + n - 1;
+    return last > INT16_MAX ? INT16_MAX : (int16_t)last;
+}
+
+// Half-heights of a disc of radius r, one per column offset 0..r
+static void gfx_disc_spans(int16_t r, int16_t *half) {
+    int16_t h = r;
+    for (int16_t dx = 0; dx <= r; dx++) {
+        while (h > 0 && h * h + dx * dx > r * r + r) {
+            h--;
+        }
+        half[dx] = h;
+    }
+}
+
+static Layout *gfx_get(LayoutPtr layout_, uint8_t tile, Tile **t) {
+    Layout *layout = (Layout *)layout_;
+    if (layout == NULL) {
+        errno = EINVAL;
+        LOG_ERROR(LOG_CAT_LAYOUT, "Layout is NULL", errno);
+        return NULL;
+    }
+    if (tile >= layout->num_tiles) {
+        errno = EINVAL;
+        LOG_ERROR(LOG_CAT_LAYOUT, "Invalid tile index", errno);
+        return NULL;
+    }
+    *t = &layout->tiles[tile];
+    return layout;
+}
+
+#define GFX_GET(layout_, tile, layout, t)                                   \
+    Tile *t;                                                                \
+    Layout *layout = gfx_get(layout_, tile, &t);                            \
+    if (layout == NULL) {                                                   \
+        return layout_ == NULL ? LAYOUT_ERR_INVALID : LAYOUT_ERR_INVALID_TILE; \
+    }
+
+int8_t gfx_pixel(LayoutPtr layout_, uint8_t tile, int16_t x, int16_t y, GfxColor color) {
+    GFX_GET(layout_, tile, layout, t);
+    gfx_plot(layout, t, x, y, color);
+    return LAYOUT_OK;
+}
+
+int8_t gfx_hline(LayoutPtr layout_, uint8_t tile, int16_t x, int16_t y, int16_t w, GfxColor color) {
+    GFX_GET(layout_, tile, layout, t);
+    if (w > 0) {
+        gfx_fill(layout, t, x, y, gfx_last(x, w), y, color);
+    }
+    return LAYOUT_OK;
+}
+
+int8_t gfx_vline(LayoutPtr layout_, uint8_t tile, int16_t x, int16_t y, int16_t h, GfxColor color) {
+    GFX_GET(layout_, tile, layout, t);
+    if (h > 0) {
+        gfx_fill(layout, t, x, y, x, gfx_last(y, h), color);
+    }
+    return LAYOUT_OK;
+}
+
+// Bresenham, emitting each straight run as one span: horizontal runs for
+// shallow lines, vertical runs for steep ones
+int8_t gfx_line(LayoutPtr layout_, uint8_t tile, int16_t x0, int16_t y0, int16_t x1, int16_t y1, GfxColor color) {
+    GFX_GET(layout_, tile, layout, t);
+    bool steep = (y1 > y0 ? y1 - y0 : y0 - y1) > (x1 > x0 ? x1 - x0 : x0 - x1);
+    if (steep) {
+        int16_t tmp;
+        tmp = x0; x0 = y0; y0 = tmp;
+        tmp = x1; x1 = y1; y1 = tmp;
+    }
+    if (x0 > x1) {
+        int16_t tmp;
+        tmp = x0; x0 = x1; x1 = tmp;
+        tmp = y0; y0 = y1; y1 = tmp;
+    }
+    int16_t dx = x1 - x0;
+    int16_t dy = y1 > y0 ? y1 - y0 : y0 - y1;
+    int16_t step = y1 > y0 ? 1 : -1;
+    int16_t err = dx / 2;
+    int16_t run = x0;
+    for (int16_t x = x0; x <= x1; x++) {
+        err -= dy;
+        if (err < 0 || x == x1) {
+            if (steep) {
+                gfx_fill(layout, t, y0, run, y0, x, color);
+            } else {
+                gfx_fill(layout, t, run, y0, x, y0, color);
+            }
+            run = x + 1;
+            y0 += step;
+            err += dx;
+        }
+    }
+    return LAYOUT_OK;
+}
+
+int8_t gfx_rect(LayoutPtr layout_, uint8_t tile, int16_t x, int16_t y, int16_t w, int16_t h, GfxColor color) {
+    return gfx_round_rect(layout_, tile, x, y, w, h, 0, color);
+}
+
+int8_t gfx_fill_rect(LayoutPtr layout_, uint8_t tile, int16_t x, int16_t y, int16_t w, int16_t h, GfxColor color) {
+    GFX_GET(layout_, tile, layout, t);
+    if (w > 0 && h > 0) {
+        gfx_fill(layout, t, x, y, gfx_last(x, w), gfx_last(y, h), color);
+    }
+    return LAYOUT_OK;
+}
+
+int8_t gfx_round_rect(LayoutPtr layout_, uint8_t tile, int16_t x, int16_t y, int16_t w, int16_t h, int16_t r, GfxColor color) {
+    GFX_GET(layout_, tile, layout, t);
+    if (w <= 0 || h <= 0) {
+        return LAYOUT_OK;
+    }
+    if (w <= 2 || h <= 2) {
+        gfx_fill(layout, t, x, y, gfx_last(x, w), gfx_last(y, h), color);
+        return LAYOUT_OK;
+    }
+    int16_t right = gfx_last(x, w);
+    int16_t bottom = gfx_last(y, h);
+    if (r > (right - x) / 2) r = (int16_t)((right - x) / 2);
+    if (r > (bottom - y) / 2) r = (int16_t)((bottom - y) / 2);
+    if (r < 0) r = 0;
+    // Top and bottom edges span the full width when square, the sides never
+    // include the corner rows
+    gfx_fill(layout, t, x + r, y, right - r, y, color);
+    gfx_fill(layout, t, x + r, bottom, right - r, bottom, color);
+    gfx_fill(layout, t, x, y + (r ? r : 1), x, bottom - (r ? r : 1), color);
+    gfx_fill(layout, t, right, y + (r ? r : 1), right, bottom - (r ? r : 1), color);
+    if (r > 0) {
+        gfx_corners(layout, t, x + r, y + r, right - r, bottom - r, r, color);
+    }
+    return LAYOUT_OK;
+}
+
+int8_t gfx_fill_round_rect(LayoutPtr layout_, uint8_t tile, int16_t x, int16_t y, int16_t w, int16_t h, int16_t r, GfxColor color) {
+    GFX_GET(layout_, tile, layout, t);
+    if (w <= 0 || h <= 0) {
+        return LAYOUT_OK;
+    }
+    int16_t right = gfx_last(x, w);
+    int16_t bottom = gfx_last(y, h);
+    if (r > (right - x) / 2) r = (int16_t)((right - x) / 2);
+    if (r > (bottom - y) / 2) r = (int16_t)((bottom - y) / 2);
+    if (r <= 0) {
+        gfx_fill(layout, t, x, y, right, bottom, color);
+        return LAYOUT_OK;
+    }
+    // The radius is bounded by the rect, not the tile, so the corner spans are
+    // worked out column by column (as gfx_disc_spans does) instead of into a
+    // LT_MAX_SIDE table
+    gfx_fill(layout, t, x + r, y, right - r, bottom, color);
+    int32_t half = r;
+    for (int32_t dx = 1; dx <= r; dx++) {
+        while (half > 0 && half * half + dx * dx > (int32_t)r * r + r) {
+            half--;
+        }
+        gfx_fill(layout, t, (int16_t)(x + r - dx), (int16_t)(y + r - half), (int16_t)(x + r - dx),
+                 (int16_t)(bottom - r + half), color);
+        gfx_fill(layout, t, (int16_t)(right - r + dx), (int16_t)(y + r - half), (int16_t)(right - r + dx),
+                 (int16_t)(bottom - r + half), color);
+    }
+    return LAYOUT_OK;
+}
+
+int8_t gfx_circle(LayoutPtr layout_, uint8_t tile, int16_t cx, int16_t cy, int16_t r, GfxColor color) {
+    GFX_GET(layout_, tile, layout, t);
+    if (r < 0) {
+        return LAYOUT_OK;
+    }
+    gfx_plot(layout, t, cx, cy - r, color);
+    if (r > 0) {
+        gfx_plot(layout, t, cx, cy + r, color);
+        gfx_plot(layout, t, cx - r, cy, color);
+        gfx_plot(layout, t, cx + r, cy, color);
+        gfx_corners(layout, t, cx, cy, cx, cy, r, color);
+    }
+    return LAYOUT_OK;
+}
+
+// One vertical span per column, so every pixel is written exactly once
+int8_t gfx_fill_circle(LayoutPtr layout_, uint8_t tile, int16_t cx, int16_t cy, int16_t r, GfxColor color) {
+    GFX_GET(layout_, tile, layout, t);
+    if (r < 0 || r >= LT_MAX_SIDE) {
+        return r < 0 ? LAYOUT_OK : LAYOUT_ERR_INVALID;
+    }
+    int16_t half[LT_MAX_SIDE];
+    gfx_disc_spans(r, half);
+    gfx_fill(layout, t, cx, cy - r, cx, cy + r, color);
+    for (int16_t dx = 1; dx <= r; dx++) {
+        gfx_fill(layout, t, cx - dx, cy - half[dx], cx - dx, cy + half[dx], color);
+        gfx_fill(layout, t, cx + dx, cy - half[dx], cx + dx, cy + half[dx], color);
+    }
+    return LAYOUT_OK;
+}
+
+int8_t gfx_fill_pattern(LayoutPtr layout_, uint8_t tile, int16_t x, int16_t y, int16_t w, int16_t h,
+                        const uint8_t pattern[8]) {
+    GFX_GET(layout_, tile, layout, t);
+    int16_t x0 = x, y0 = y, x1 = gfx_last(x, w), y1 = gfx_last(y, h);
+    if (w <= 0 || h <= 0 || !gfx_clip(t, &x0, &y0, &x1, &y1)) {
+        return LAYOUT_OK;
+    }
+    // The pattern repeats every 8 columns, so one word holds it at the span's phase
+    uint64_t pat;
+    uint8_t phase[8];
+    for (int i = 0; i < 8; i++) {
+        phase[i] = pattern[(x0 + i) & 7];
+    }
+    memcpy(&pat, phase, 8);
+    for (uint8_t page = y0 / 8; page <= y1 / 8; page++) {
+        uint8_t mask = gfx_page_mask(page, y0, y1);
+        uint64_t m = mask * GFX_BYTES_X8;
+        uint8_t *row = lt_tile_row(layout, t, page) + x0;
+        int16_t n = x1 - x0 + 1;
+        uint64_t word;
+        for (; n >= 8; n -= 8, row += 8) {
+            memcpy(&word, row, 8);
+            word = (word & ~m) | (pat & m);
+            memcpy(row, &word, 8);
+        }
+        for (int i = 0; n > 0; n--, i++, row++) {
+            *row = (uint8_t)((*row & ~mask) | (phase[i] & mask));
+        }
+    }
+    tile_mark_columns(t, (uint8_t)x0, (uint8_t)x1);
+    return LAYOUT_OK;
+}
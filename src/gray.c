@@ -0,0 +1,241 @@
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include "gray.h"
+#include "layout.h"
+#include "layout-internal.h"
+#include "timing.h"
+#include "log.h"
+
+#define GRAY_DEFAULT_FPS 150
+
+typedef struct {
+    Layout *layout;
+    Tile *tile;
+    uint8_t width;
+    uint8_t pages;
+    uint8_t *hi;                // [pages][width] bit 1 of every level
+    uint8_t *lo;                // [pages][width] bit 0
+    uint8_t phase;
+    uint32_t period_us;
+    uint64_t deadline_us;       // 0: not started
+    GrayStats stats;
+    uint64_t jitter_sum_us;
+    uint64_t flush_sum_us;
+} Gray;
+
+// Level 1 is lit in phase 0, level 2 in phases 0 and 1, level 3 in all three
+static inline uint8_t gr_plane(uint8_t hi, uint8_t lo, uint8_t phase) {
+    switch (phase) {
+        case 0:  return hi | lo;
+        case 1:  return hi;
+        default: return hi & lo;
+    }
+}
+
+GrayPtr gray_create(LayoutPtr layout_, uint8_t tile) {
+    Layout *layout = (Layout *)layout_;
+    if (layout == NULL) {
+        errno = EINVAL;
+        LOG_ERROR(LOG_CAT_LAYOUT, "Layout is NULL", errno);
+        return NULL;
+    }
+    if (tile >= layout->num_tiles) {
+        errno = EINVAL;
+        LOG_ERROR(LOG_CAT_LAYOUT, "Invalid tile index", errno);
+        return NULL;
+    }
+    Tile *t = &layout->tiles[tile];
+    if (t->prepare != NULL) {
+        errno = EBUSY;
+        LOG_ERROR(LOG_CAT_LAYOUT, "Tile already has deferred content", errno);
+        return NULL;
+    }
+    size_t size = (size_t)tile_get_width(t) * tile_get_height(t);
+    Gray *gray = calloc(1, sizeof(Gray));
+    uint8_t *planes = calloc(2 * size, 1);
+    if (gray == NULL || planes == NULL) {
+        free(gray);
+        free(planes);
+        errno = ENOMEM;
+        LOG_ERROR(LOG_CAT_LAYOUT, "Failed to allocate memory for grayscale tile", errno);
+        return NULL;
+    }
+    gray->layout = layout;
+    gray->tile = t;
+    gray->width = tile_get_width(t);
+    gray->pages = tile_get_height(t);
+    gray->hi = planes;
+    gray->lo = planes + size;
+    gray->period_us = 1000000 / GRAY_DEFAULT_FPS;
+    return gray;
+}
+
+void gray_free(GrayPtr gray_) {
+    Gray *gray = (Gray *)gray_;
+    if (gray != NULL) {
+        free(gray->hi);
+        free(gray);
+    }
+}
+
+int8_t gray_clear(GrayPtr gray_, uint8_t level) {
+    Gray *gray = (Gray *)gray_;
+    if (gray == NULL || level >= GRAY_LEVELS) {
+        errno = EINVAL;
+        LOG_ERROR(LOG_CAT_LAYOUT, "Invalid grayscale clear", errno);
+        return LAYOUT_ERR_INVALID;
+    }
+    size_t size = (size_t)gray->width * gray->pages;
+    memset(gray->hi, level & 2 ? 0xFF : 0x00, size);
+    memset(gray->lo, level & 1 ? 0xFF : 0x00, size);
+    return LAYOUT_OK;
+}
+
+static inline void gr_put(Gray *gray, uint8_t x, uint8_t y, uint8_t level) {
+    size_t i = (size_t)(y / 8) * gray->width + x;
+    uint8_t bit = (uint8_t)(1u << (y % 8));
+    gray->hi[i] = level & 2 ? gray->hi[i] | bit : gray->hi[i] & (uint8_t)~bit;
+    gray->lo[i] = level & 1 ? gray->lo[i] | bit : gray->lo[i] & (uint8_t)~bit;
+}
+
+int8_t gray_set_pixel(GrayPtr gray_, uint8_t x, uint8_t y, uint8_t level) {
+    Gray *gray = (Gray *)gray_;
+    if (gray == NULL || level >= GRAY_LEVELS) {
+        errno = EINVAL;
+        LOG_ERROR(LOG_CAT_LAYOUT, "Invalid grayscale pixel", errno);
+        return LAYOUT_ERR_INVALID;
+    }
+    if (x >= gray->width || y >= gray->pages * 8) {
+        errno = EINVAL;
+        LOG_ERROR(LOG_CAT_LAYOUT, "Pixel outside the tile", errno);
+        return LAYOUT_ERR_INVALID_POINT;
+    }
+    gr_put(gray, x, y, level);
+    return LAYOUT_OK;
+}
+
+int8_t gray_import(GrayPtr gray_, int16_t x, int16_t y, const uint8_t *pixels,
+                   uint16_t width, uint16_t height, size_t stride) {
+    Gray *gray = (Gray *)gray_;
+    if (gray == NULL || pixels == NULL || stride < width) {
+        errno = EINVAL;
+        LOG_ERROR(LOG_CAT_LAYOUT, "Invalid grayscale image", errno);
+        return LAYOUT_ERR_INVALID_DATA;
+    }
+    for (int32_t row = y < 0 ? -y : 0; row < height && y + row < gray->pages * 8; row++) {
+        const uint8_t *src = pixels + (size_t)row * stride;
+        for (int32_t col = x < 0 ? -x : 0; col < width && x + col < gray->width; col++) {
+            gr_put(gray, (uint8_t)(x + col), (uint8_t)(y + row), src[col] >> 6);
+        }
+    }
+    return LAYOUT_OK;
+}
+
+int8_t gray_set_rate(GrayPtr gray_, uint16_t fps) {
+    Gray *gray = (Gray *)gray_;
+    if (gray == NULL || fps == 0) {
+        errno = EINVAL;
+        LOG_ERROR(LOG_CAT_LAYOUT, "Invalid grayscale frame rate", errno);
+        return LAYOUT_ERR_INVALID;
+    }
+    gray->period_us = 1000000 / fps;
+    gray->deadline_us = 0;
+    return LAYOUT_OK;
+}
+
+// Writes the bitplane of the current phase into the tile. Only bytes that
+// change are touched and marked, so the flush sends the columns that differ
+// from the bitplane the panel already shows.
+static void gr_render(Gray *gray) {
+    uint8_t first_page = 0xFF, last_page = 0, first = 0xFF, last = 0;
+    for (uint8_t page = 0; page < gray->pages; page++) {
+        uint8_t *dst = lt_tile_row(gray->layout, gray->tile, page);
+        const uint8_t *hi = gray->hi + (size_t)page * gray->width;
+        const uint8_t *lo = gray->lo + (size_t)page * gray->width;
+        for (uint8_t col = 0; col < gray->width; col++) {
+            uint8_t b = gr_plane(hi[col], lo[col], gray->phase);
+            if (dst[col] != b) {
+                dst[col] = b;
+                first_page = first_page == 0xFF ? page : first_page;
+                last_page = page;
+                first = col < first ? col : first;
+                last = col > last ? col : last;
+            }
+        }
+    }
+    if (first_page != 0xFF) {
+        tile_mark_rect(gray->tile, first_page, last_page, first, last);
+    }
+    gray->phase = (uint8_t)((gray->phase + 1) % GRAY_PHASES);
+}
+
+int8_t gray_step(GrayPtr gray_) {
+    Gray *gray = (Gray *)gray_;
+    if (gray == NULL) {
+        errno = EINVAL;
+        LOG_ERROR(LOG_CAT_LAYOUT, "Grayscale tile is NULL", errno);
+        return LAYOUT_ERR_INVALID;
+    }
+    if (gray->deadline_us == 0) {
+        gray->deadline_us = timing_now_us();
+    }
+    timing_sleep_until_us(gray->deadline_us);
+    uint64_t start = timing_now_us();
+    uint64_t jitter = start - gray->deadline_us;
+    if (jitter >= gray->period_us) {
+        // Catching up would show bitplanes in a burst; give up the missed slots instead
+        gray->stats.dropped += (uint32_t)(jitter / gray->period_us);
+        gray->deadline_us = start;
+    }
+    gr_render(gray);
+    int8_t ret = layout_flush(gray->layout);
+    uint64_t flush = timing_now_us() - start;
+    gray->deadline_us += gray->period_us;
+
+    gray->stats.frames++;
+    gray->jitter_sum_us += jitter;
+    gray->flush_sum_us += flush;
+    if (jitter > gray->stats.jitter_max_us) {
+        gray->stats.jitter_max_us = (uint32_t)jitter;
+    }
+    if (flush > gray->stats.flush_max_us) {
+        gray->stats.flush_max_us = (uint32_t)flush;
+    }
+    return ret;
+}
+
+int8_t gray_run(GrayPtr gray, uint32_t frames) {
+    for (uint32_t i = 0; i < frames; i++) {
+        int8_t ret = gray_step(gray);
+        if (ret != LAYOUT_OK) {
+            return ret;
+        }
+    }
+    return LAYOUT_OK;
+}
+
+void gray_get_stats(GrayPtr gray_, GrayStats *stats) {
+    Gray *gray = (Gray *)gray_;
+    if (gray == NULL || stats == NULL) {
+        return;
+    }
+    *stats = gray->stats;
+    if (gray->stats.frames > 0) {
+        stats->jitter_mean_us = (uint32_t)(gray->jitter_sum_us / gray->stats.frames);
+        stats->flush_mean_us = (uint32_t)(gray->flush_sum_us / gray->stats.frames);
+    }
+}
+
+void gray_reset_stats(GrayPtr gray_) {
+    Gray *gray = (Gray *)gray_;
+    if (gray != NULL) {
+        memset(&gray->stats, 0, sizeof(gray->stats));
+        gray->jitter_sum_us = 0;
+        gray->flush_sum_us = 0;
+    }
+}
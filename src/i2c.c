@@ -3,6 +3,7 @@
 #include <stdio.h>
 
 #include "i2c.h"
+#include "log.h"
 
 #include "ssd1306-config.h"
 
@@ -25,9 +26,9 @@ __weak bool i2c_init() {
 __weak bool i2c_send(uint8_t bus, uint8_t payload_type, const uint8_t *data, size_t len) {
     // Send data over I2C
     // This is a placeholder for actual I2C send code
-    if (len > 32) {
-        for (size_t i = 0; i < len; i += 32) {
-            size_t chunk_size = (len - i > 32) ? 32 : (len - i);
+    if (len > I2C_MAX_CHUNK) {
+        for (size_t i = 0; i < len; i += I2C_MAX_CHUNK) {
+            size_t chunk_size = (len - i > I2C_MAX_CHUNK) ? I2C_MAX_CHUNK : (len - i);
             bool result = i2c_send(bus, payload_type, data + i, chunk_size);
             if (!result) {
                 return false;
@@ -44,13 +45,8 @@ __weak bool i2c_send(uint8_t bus, uint8_t payload_type, const uint8_t *data, siz
     }
     return udp_send(buffer, len + 2);
 #else
-    printf("[I2C] Sending %s: ", payload_type == 0x00 ? "command" : "data");
-    printf("%02X ", bus);
-    printf("%02X ", payload_type);
-    for (size_t i = 0; i < len; i++) {
-        printf("%02X ", data[i]);
-    }
-    printf("\n");
+    LOG_TRACE_BYTES(LOG_CAT_I2C, payload_type == 0x00 ? "Sending command" : "Sending data",
+                    (bus << 8) | payload_type, data, len);
     return true;
 #endif
 }
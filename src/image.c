@@ -0,0 +1,263 @@
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+
+#include "image.h"
+#include "blit.h"
+#include "layout.h"
+#include "layout-internal.h"
+#include "log.h"
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define IMAGE_X86 1
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#define IMAGE_TARGET(isa)
+#else
+#define IMAGE_TARGET(isa) __attribute__((target(isa)))
+#endif
+#else
+#define IMAGE_X86 0
+#endif
+
+#define IMAGE_BLOCK 32      // source bytes converted per band chunk, one AVX2 register
+
+typedef void (*transpose_f)(const uint8_t *rows, size_t stride, size_t bytes, uint8_t *page);
+
+static void im_transpose_portable(const uint8_t *rows, size_t stride, size_t bytes, uint8_t *page) {
+    for (size_t b = 0; b < bytes; b++) {
+        uint64_t x = 0;
+        for (int i = 0; i < 8; i++) {
+            x |= (uint64_t)rows[i * stride + b] << (8 * i);
+        }
+        // Bit 7 is the leftmost pixel, so output column k is result byte 7 - k
+        x = lt_transpose8(x);
+        for (int k = 0; k < 8; k++) {
+            page[b * 8 + k] = (uint8_t)(x >> (8 * (7 - k)));
+        }
+    }
+}
+
+#if IMAGE_X86
+// Interleaves 8 rows of 16 bytes so each register holds two source byte
+// columns (8 rows each), then peels one pixel column per movemask: the mask of
+// the byte MSBs is exactly the page byte of that column for both byte columns.
+IMAGE_TARGET("sse2")
+static void im_transpose_sse2(const uint8_t *rows, size_t stride, size_t bytes, uint8_t *page) {
+    size_t b = 0;
+    for (; b + 16 <= bytes; b += 16) {
+        __m128i r[8];
+        for (int i = 0; i < 8; i++) {
+            r[i] = _mm_loadu_si128((const __m128i *)(rows + i * stride + b));
+        }
+        for (int half = 0; half < 2; half++) {
+            __m128i t0 = half ? _mm_unpackhi_epi8(r[0], r[1]) : _mm_unpacklo_epi8(r[0], r[1]);
+            __m128i t1 = half ? _mm_unpackhi_epi8(r[2], r[3]) : _mm_unpacklo_epi8(r[2], r[3]);
+            __m128i t2 = half ? _mm_unpackhi_epi8(r[4], r[5]) : _mm_unpacklo_epi8(r[4], r[5]);
+            __m128i t3 = half ? _mm_unpackhi_epi8(r[6], r[7]) : _mm_unpacklo_epi8(r[6], r[7]);
+            __m128i u[4] = {
+                _mm_unpacklo_epi16(t0, t1), _mm_unpacklo_epi16(t2, t3),
+                _mm_unpackhi_epi16(t0, t1), _mm_unpackhi_epi16(t2, t3),
+            };
+            __m128i v[4] = {
+                _mm_unpacklo_epi32(u[0], u[1]), _mm_unpackhi_epi32(u[0], u[1]),
+                _mm_unpacklo_epi32(u[2], u[3]), _mm_unpackhi_epi32(u[2], u[3]),
+            };
+            for (int j = 0; j < 4; j++) {
+                // v[j] holds source byte columns 2j and 2j + 1 of this half
+                uint8_t *out = page + (b + half * 8 + 2 * j) * 8;
+                __m128i w = v[j];
+                for (int k = 0; k < 8; k++) {
+                    int m = _mm_movemask_epi8(w);
+                    out[k] = (uint8_t)m;
+                    out[8 + k] = (uint8_t)(m >> 8);
+                    w = _mm_add_epi8(w, w);
+                }
+            }
+        }
+    }
+    im_transpose_portable(rows + b, stride, bytes - b, page + b * 8);
+}
+
+// Same as SSE2 on both 128-bit lanes: lane 0 covers source bytes 0-15, lane 1
+// bytes 16-31 of the block
+IMAGE_TARGET("avx2")
+static void im_transpose_avx2(const uint8_t *rows, size_t stride, size_t bytes, uint8_t *page) {
+    size_t b = 0;
+    for (; b + 32 <= bytes; b += 32) {
+        __m256i r[8];
+        for (int i = 0; i < 8; i++) {
+            r[i] = _mm256_loadu_si256((const __m256i *)(rows + i * stride + b));
+        }
+        for (int half = 0; half < 2; half++) {
+            __m256i t0 = half ? _mm256_unpackhi_epi8(r[0], r[1]) : _mm256_unpacklo_epi8(r[0], r[1]);
+            __m256i t1 = half ? _mm256_unpackhi_epi8(r[2], r[3]) : _mm256_unpacklo_epi8(r[2], r[3]);
+            __m256i t2 = half ? _mm256_unpackhi_epi8(r[4], r[5]) : _mm256_unpacklo_epi8(r[4], r[5]);
+            __m256i t3 = half ? _mm256_unpackhi_epi8(r[6], r[7]) : _mm256_unpacklo_epi8(r[6], r[7]);
+            __m256i u[4] = {
+                _mm256_unpacklo_epi16(t0, t1), _mm256_unpacklo_epi16(t2, t3),
+                _mm256_unpackhi_epi16(t0, t1), _mm256_unpackhi_epi16(t2, t3),
+            };
+            __m256i v[4] = {
+                _mm256_unpacklo_epi32(u[0], u[1]), _mm256_unpackhi_epi32(u[0], u[1]),
+                _mm256_unpacklo_epi32(u[2], u[3]), _mm256_unpackhi_epi32(u[2], u[3]),
+            };
+            for (int j = 0; j < 4; j++) {
+                uint8_t *lo = page + (b + half * 8 + 2 * j) * 8;
+                uint8_t *hi = lo + 16 * 8;
+                __m256i w = v[j];
+                for (int k = 0; k < 8; k++) {
+                    uint32_t m = (uint32_t)_mm256_movemask_epi8(w);
+                    lo[k] = (uint8_t)m;
+                    lo[8 + k] = (uint8_t)(m >> 8);
+                    hi[k] = (uint8_t)(m >> 16);
+                    hi[8 + k] = (uint8_t)(m >> 24);
+                    w = _mm256_add_epi8(w, w);
+                }
+            }
+        }
+    }
+    im_transpose_sse2(rows + b, stride, bytes - b, page + b * 8);
+}
+
+static bool im_cpu_has(ImageKernel kernel) {
+#ifdef _MSC_VER
+    int info[4];
+    __cpuid(info, 0);
+    int max = info[0];
+    if (kernel == IMAGE_KERNEL_SSE2) {
+        __cpuid(info, 1);
+        return (info[3] >> 26) & 1;
+    }
+    if (max < 7) {
+        return false;
+    }
+    __cpuid(info, 1);
+    bool osxsave = (info[2] >> 27) & 1;
+    bool avx = (info[2] >> 28) & 1;
+    if (!osxsave || !avx || (_xgetbv(0) & 6) != 6) {
+        return false;
+    }
+    __cpuidex(info, 7, 0);
+    return (info[1] >> 5) & 1;
+#else
+    __builtin_cpu_init();
+    return kernel == IMAGE_KERNEL_SSE2 ? __builtin_cpu_supports("sse2") : __builtin_cpu_supports("avx2");
+#endif
+}
+#else
+static bool im_cpu_has(ImageKernel kernel) {
+    (void)kernel;
+    return false;
+}
+#endif
+
+static ImageKernel im_kernel = IMAGE_KERNEL_AUTO;
+static transpose_f im_transpose = NULL;
+
+void image_set_kernel(ImageKernel kernel) {
+    if (kernel == IMAGE_KERNEL_AUTO || (kernel != IMAGE_KERNEL_PORTABLE && !im_cpu_has(kernel))) {
+        kernel = im_cpu_has(IMAGE_KERNEL_AVX2) ? IMAGE_KERNEL_AVX2
+               : im_cpu_has(IMAGE_KERNEL_SSE2) ? IMAGE_KERNEL_SSE2
+               : IMAGE_KERNEL_PORTABLE;
+    }
+    switch (kernel) {
+#if IMAGE_X86
+        case IMAGE_KERNEL_AVX2:
+            im_transpose = im_transpose_avx2;
+            break;
+        case IMAGE_KERNEL_SSE2:
+            im_transpose = im_transpose_sse2;
+            break;
+#endif
+        default:
+            kernel = IMAGE_KERNEL_PORTABLE;
+            im_transpose = im_transpose_portable;
+            break;
+    }
+    im_kernel = kernel;
+}
+
+ImageKernel image_get_kernel(void) {
+    if (im_transpose == NULL) {
+        image_set_kernel(IMAGE_KERNEL_AUTO);
+    }
+    return im_kernel;
+}
+
+const char *image_kernel_name(ImageKernel kernel) {
+    switch (kernel) {
+        case IMAGE_KERNEL_PORTABLE: return "portable";
+        case IMAGE_KERNEL_SSE2:     return "sse2";
+        case IMAGE_KERNEL_AVX2:     return "avx2";
+        default:                    return "auto";
+    }
+}
+
+void image_rows_to_page(const uint8_t *rows, size_t stride, size_t bytes, uint8_t *page) {
+    image_get_kernel();
+    im_transpose(rows, stride, bytes, page);
+}
+
+static inline uint8_t im_reverse(uint8_t b) {
+    b = (uint8_t)((b & 0xF0) >> 4 | (b & 0x0F) << 4);
+    b = (uint8_t)((b & 0xCC) >> 2 | (b & 0x33) << 2);
+    return (uint8_t)((b & 0xAA) >> 1 | (b & 0x55) << 1);
+}
+
+// Converts the image one 8-row band at a time: the source bytes covering the
+// visible columns are gathered into a padded block (so the last band and the
+// flags need no special case in the kernels), transposed, then blitted at the
+// band's pixel position, which handles any y offset and the clipping.
+int8_t layout_import_image(LayoutPtr layout_, uint8_t tile, int16_t x, int16_t y, const uint8_t *pixels,
+                           uint16_t width, uint16_t height, size_t stride, uint8_t flags) {
+    Layout *layout = (Layout *)layout_;
+    if (layout == NULL || pixels == NULL) {
+        errno = EINVAL;
+        LOG_ERROR(LOG_CAT_LAYOUT, "Layout or image is NULL", errno);
+        return LAYOUT_ERR_INVALID;
+    }
+    if (tile >= layout->num_tiles) {
+        errno = EINVAL;
+        LOG_ERROR(LOG_CAT_LAYOUT, "Invalid tile index", errno);
+        return LAYOUT_ERR_INVALID_TILE;
+    }
+    if (stride * 8 < width) {
+        errno = EINVAL;
+        LOG_ERROR(LOG_CAT_LAYOUT, "Image stride shorter than a row", errno);
+        return LAYOUT_ERR_INVALID_DATA;
+    }
+    Tile *t = &layout->tiles[tile];
+    int32_t c0 = x < 0 ? -x : 0;
+    int32_t c1 = (int32_t)tile_get_width(t) - x < width ? (int32_t)tile_get_width(t) - x : width;
+    int32_t r0 = y < 0 ? (-y) / 8 * 8 : 0;
+    int32_t r1 = (int32_t)tile_get_height(t) * 8 - y < height ? (int32_t)tile_get_height(t) * 8 - y : height;
+    if (c0 >= c1 || r0 >= r1) {
+        return LAYOUT_OK;
+    }
+    size_t byte0 = (size_t)c0 / 8;
+    size_t bytes = ((size_t)c1 + 7) / 8 - byte0;
+    uint8_t block[8][N_COLUMNS / 8 + IMAGE_BLOCK];
+    uint8_t band[(N_COLUMNS / 8 + IMAGE_BLOCK) * 8];
+    for (int32_t row = r0; row < r1; row += 8) {
+        uint8_t rows = r1 - row < 8 ? (uint8_t)(r1 - row) : 8;
+        memset(block, 0, sizeof(block));
+        for (uint8_t i = 0; i < rows; i++) {
+            const uint8_t *src = pixels + (size_t)(row + i) * stride + byte0;
+            for (size_t b = 0; b < bytes; b++) {
+                uint8_t v = flags & IMAGE_INVERT ? (uint8_t)~src[b] : src[b];
+                block[i][b] = flags & IMAGE_LSB_FIRST ? im_reverse(v) : v;
+            }
+        }
+        image_rows_to_page(&block[0][0], sizeof(block[0]), bytes, band);
+        int8_t ret = layout_blit(layout_, tile, (int16_t)(x + c0), (int16_t)(y + row),
+                                 band + (c0 - byte0 * 8), (uint8_t)(c1 - c0), rows, BLIT_SET);
+        if (ret != LAYOUT_OK) {
+            return ret;
+        }
+    }
+    return LAYOUT_OK;
+}
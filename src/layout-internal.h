@@ -0,0 +1,304 @@
+#pragma once
+
+// Private view of the Layout object, shared by the modules that build on top of
+// the layout (cost model, graphics, ...). Not part of the public API.
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "layout.h"
+#include "panel.h"
+#include "mapfile.h"
+#include "font.h"
+#include "ssd1306-config.h"
+
+#define N_ROWS (N_PAGES * 8)
+
+#define LT_MAX_SIDE (N_COLUMNS > N_ROWS ? N_COLUMNS : N_ROWS)  // tile width or height, in any orientation
+
+#define MAX_TILES LAYOUT_MAX_TILES
+
+#define LT_ADDRESSING_UNKNOWN 0xFF
+
+#define LT_RAM_PAGES PANEL_RAM_PAGES // GDDRAM height of the controller, whatever the panel shows
+
+#define LT_TEXT_MAX_GLYPHS LAYOUT_TEXT_GLYPHS
+
+// Text a tile last printed, so the next print can redraw only what changed.
+// Drawing anything else into the tile forgets it (face = NULL).
+typedef struct {
+    const FontFace *face;           // NULL: the tile does not show known text
+    uint8_t scale;
+    uint8_t count;                  // glyphs
+    bool split;                     // some glyph wraps across lines
+    uint8_t end_page;               // text line and column the text ends at
+    uint8_t end_column;
+    uint32_t c[LT_TEXT_MAX_GLYPHS];
+    uint8_t page[LT_TEXT_MAX_GLYPHS];   // where each glyph starts
+    uint8_t column[LT_TEXT_MAX_GLYPHS];
+} TileText;
+
+#define LT_DEFER_MAX_OPS    8
+#define LT_DEFER_ARENA      256     // text and bitmap bytes the recorded ops copy
+
+typedef enum {
+    LT_DEFER_PRINT = 0,
+    LT_DEFER_CLEAR = 1,
+    LT_DEFER_TEXT = 2,      // layout_draw_text
+    LT_DEFER_BLIT = 3,
+} LtDeferKind;
+
+// A drawing call recorded for a deferred tile, replayed before the tile is used
+typedef struct {
+    uint8_t kind;
+    uint8_t arg;            // print scale, clear fill or blit op
+    bool opaque;            // replaces every pixel of its box
+    int16_t x, y;           // text and blits: where they go
+    uint8_t width;          // blits
+    uint8_t height;
+    const FontFace *face;
+    uint16_t offset;        // text or bitmap in the arena
+    uint16_t len;
+    int16_t x0, y0, x1, y1; // pixels it can change, clipped to the tile; x1 and y1 exclusive
+} TileDeferOp;
+
+typedef struct TileDefer {
+    uint8_t count;
+    bool replaying;
+    uint16_t used;          // arena bytes
+    TileDeferOp ops[LT_DEFER_MAX_OPS];
+    uint8_t arena[LT_DEFER_ARENA];
+} TileDefer;
+
+struct Layout;
+struct Tile;
+
+// Renders content a tile keeps in another form (e.g. console cells) into the
+// framebuffer, marking what changed. Called before the tile is flushed.
+typedef void (*tile_prepare_f)(struct Layout *layout, struct Tile *tile, void *ctx);
+
+typedef struct Tile {
+    Point start;
+    Point end;      // inclusive
+    bool dirty;
+    uint8_t dirty_start;    // columns to flush, relative to the tile; valid while dirty
+    uint8_t dirty_end;      // inclusive
+    uint8_t dirty_page_start;   // pages to flush, relative to the tile
+    uint8_t dirty_page_end;     // inclusive
+    bool stale;             // double buffering: part of the tile the hidden GDDRAM half lacks
+    uint8_t stale_start;
+    uint8_t stale_end;
+    uint8_t stale_page_start;
+    uint8_t stale_page_end;
+    uint8_t shift;          // columns the panel's copy scrolls left before the dirty box goes out
+    TileText text;
+    tile_prepare_f prepare;
+    void *prepare_ctx;
+    TileDefer *defer;       // display list while drawing is deferred, NULL otherwise
+    uint16_t store;         // LAYOUT_TILE_STORE: where the tile's rows start in the layout's pixels
+} Tile;
+
+// Continuous horizontal scroll of a page range (commands 26h/27h, 2Fh)
+typedef struct {
+    uint8_t active;
+    uint8_t direction;              // SSD1306_OPTION_HORIZONTAL_SCROLL_RIGHT / _LEFT
+    uint8_t first_page;
+    uint8_t last_page;
+    uint8_t interval;               // frames per step, as encoded by the controller
+} ScrollState;
+
+// Controller registers the layout has set, so they can be restored or skipped
+typedef struct {
+    uint8_t addressing;             // LT_ADDRESSING_UNKNOWN until set
+    uint8_t contrast;
+    uint8_t display;                // SSD1306_OPTION_DISPLAY_NORMAL / _INVERT
+    uint8_t start_line;
+    uint8_t segment_remap;
+    uint8_t com_scan_dir;
+    ScrollState scroll;             // rotates GDDRAM while active
+} ControllerState;
+
+// Persisted layout state, mapped from the state file (see persist.h)
+typedef struct {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t size;
+    uint8_t pages;
+    uint8_t columns;
+    uint8_t num_tiles;
+    uint8_t valid;                  // frame matches the panel; cleared while a flush is in flight
+    char panel[16];
+    Point tiles[MAX_TILES][2];
+    ControllerState controller;
+    uint8_t frame[N_PAGES][N_COLUMNS];  // what the panel GDDRAM holds
+} LayoutState;
+
+typedef struct Layout {
+    uint8_t num_tiles;
+    Tile tiles[MAX_TILES];
+    uint8_t pixels[LAYOUT_PIXEL_BYTES];     // the framebuffer (see lt_frame), or the tile store
+    uint16_t store_used;            // LAYOUT_TILE_STORE: bytes handed out to tiles
+    bool heap;                      // allocated by layout_create
+    write_f write;
+    const PanelProfile *panel;      // NULL: plain SSD1306 of N_PAGES x N_COLUMNS
+    ControllerState controller;
+    uint8_t start_line;             // display start line wanted, sent by the next flush
+    ScrollState scroll;             // scroll wanted, started by the next flush
+    bool double_buffer;             // flushes write the hidden half of GDDRAM, then flip to it
+    uint8_t ram_page;               // GDDRAM page framebuffer page 0 is written to
+    uint8_t segment_remap;          // orientation wanted, sent by the next flush
+    uint8_t com_scan_dir;
+    bool transposed;                // 90/270 degrees: drawing goes to view, flushes transpose it into data
+    uint8_t view[LAYOUT_ROTATION ? N_COLUMNS / 8 : 1][LAYOUT_ROTATION ? N_ROWS : 1];   // drawing surface while transposed, a page per 8 panel columns
+    LayoutState *state;             // NULL unless a state file is attached
+    MapFile state_file;
+    struct GlyphCache *glyph_cache; // pre-shifted glyphs for layout_draw_text, not owned
+    struct SpanCache *span_cache;   // rendered text strips for layout_print, not owned
+} Layout;
+
+// Rendered single-line text, see spancache.h
+typedef struct SpanEntry {
+    struct SpanEntry *prev;         // LRU order, most recent first
+    struct SpanEntry *next;
+    struct SpanEntry *chain;        // hash bucket
+    const FontFace *face;
+    uint32_t hash;
+    size_t size;                    // bytes charged against the cache cap
+    size_t len;                     // text bytes
+    uint8_t scale;
+    uint8_t pages;
+    uint8_t width;                  // strip columns
+    uint8_t count;                  // glyphs
+    uint32_t *c;                    // code point and start column of each glyph
+    uint8_t *column;
+    uint8_t *text;
+    uint8_t *strip;                 // pages rows of width bytes
+} SpanEntry;
+
+// Transfers a flush is made of. `layout_flush` feeds these to the panel, the
+// cost model feeds them to a counter - both walk the same plan.
+typedef struct {
+    bool (*command)(void *ctx, const uint8_t *cmds, size_t len);
+    bool (*data)(void *ctx, const uint8_t *data, size_t len);
+    void *ctx;
+    uint8_t addressing;             // addressing mode as of this point of the walk
+} FlushVisitor;
+
+// Whether the panel shows the whole GDDRAM, so the start line wraps around
+// the displayed rows (and can scroll or flip them)
+static inline bool lt_shows_whole_ram(Layout *layout) {
+    return layout->panel != NULL ? layout->panel->pages == LT_RAM_PAGES && layout->panel->multiplex == LT_RAM_PAGES * 8 - 1
+                                 : N_PAGES == LT_RAM_PAGES;
+}
+
+// Pages of GDDRAM the panel shows at once, one buffer in double-buffer mode
+static inline uint8_t lt_buffer_pages(Layout *layout) {
+    return layout->panel != NULL ? (layout->panel->multiplex + 8) / 8 : N_PAGES;
+}
+
+// Start line that puts GDDRAM page `page` at the top of the panel. The display
+// offset moves COM0 down the RAM as well, so it is taken back out.
+static inline uint8_t lt_buffer_line(Layout *layout, uint8_t page) {
+    uint8_t offset = layout->panel != NULL ? layout->panel->display_offset : 0;
+    return (uint8_t)((page * 8 - offset) & (LT_RAM_PAGES * 8 - 1));
+}
+
+// The framebuffer; not there with LAYOUT_TILE_STORE
+static inline uint8_t (*lt_frame(Layout *layout))[N_COLUMNS] {
+    return (uint8_t (*)[N_COLUMNS])layout->pixels;
+}
+
+// Row of `page` of the surface drawing goes to: the framebuffer, or the
+// rotated view while the layout is transposed
+static inline uint8_t *lt_row(Layout *layout, uint8_t page) {
+    return layout->transposed ? layout->view[page] : lt_frame(layout)[page];
+}
+
+// Distance between the rows lt_tile_row returns
+static inline size_t lt_tile_stride(Layout *layout, Tile *tile) {
+    if (LAYOUT_TILE_STORE > 0) {
+        return tile->end.column - tile->start.column + 1;
+    }
+    return layout->transposed ? N_ROWS : N_COLUMNS;
+}
+
+void lt_defer_resolve(Layout *layout, Tile *tile);
+
+// Framebuffer row of `page` (relative to the tile), starting at the tile's
+// first column. Drawing still recorded for the tile is rasterized first.
+static inline uint8_t *lt_tile_row(Layout *layout, Tile *tile, uint8_t page) {
+    if (tile->defer != NULL && tile->defer->count > 0) {
+        lt_defer_resolve(layout, tile);
+    }
+    if (LAYOUT_TILE_STORE > 0) {
+        return layout->pixels + tile->store + page * lt_tile_stride(layout, tile);
+    }
+    return lt_row(layout, tile->start.page + page) + tile->start.column;
+}
+
+// 8x8 bit transpose: byte i of x is row i, and byte j of the result holds bit
+// j of every row (bit i of result byte j is bit j of row i)
+static inline uint64_t lt_transpose8(uint64_t x) {
+    uint64_t t;
+    t = (x ^ (x >> 7)) & 0x00AA00AA00AA00AAULL;
+    x ^= t ^ (t << 7);
+    t = (x ^ (x >> 14)) & 0x0000CCCC0000CCCCULL;
+    x ^= t ^ (t << 14);
+    t = (x ^ (x >> 28)) & 0x00000000F0F0F0F0ULL;
+    x ^= t ^ (t << 28);
+    return x;
+}
+
+void tile_init(Tile *tile, Point start, Point end);
+uint8_t tile_get_width(Tile *tile);
+uint8_t tile_get_height(Tile *tile);
+uint8_t tile_isdirty(Tile *tile);
+void tile_setdirty(Tile *tile, bool dirty);
+void tile_mark_columns(Tile *tile, uint8_t first, uint8_t last);
+void tile_mark_rect(Tile *tile, uint8_t first_page, uint8_t last_page, uint8_t first, uint8_t last);
+bool tile_overlap(Tile *tile1, Tile *tile2);
+
+uint8_t lt_get_pages(Layout *layout);
+uint8_t lt_get_columns(Layout *layout);
+void lt_tile_bounds(Layout *layout, Tile *tile, Point *start, Point *end);
+bool lt_tile_fits(Layout *layout, const Point *start, const Point *end);
+void lt_panel_visitor(Layout *layout, FlushVisitor *visitor);
+void lt_prepare_tiles(Layout *layout);
+void lt_pending_tile(Layout *layout, Tile *tile, Tile *pending);
+bool lt_plan_tile(Layout *layout, Tile *tile, FlushVisitor *visitor);
+bool lt_plan_window(Layout *layout, Point *start, Point *end, FlushVisitor *visitor);
+bool lt_scroll_conflicts(Layout *layout);
+bool lt_tile_scrolled(Layout *layout, Tile *tile);
+bool lt_tile_can_shift(Layout *layout, Tile *tile);
+bool lt_plan_scroll_stop(Layout *layout, FlushVisitor *visitor);
+bool lt_plan_orientation(Layout *layout, FlushVisitor *visitor);
+bool lt_plan_controller(Layout *layout, FlushVisitor *visitor);
+
+// Recording: true while calls on the tile go to its display list
+static inline bool lt_defer_active(Tile *tile) {
+    return tile->defer != NULL && !tile->defer->replaying;
+}
+// Drawing recorded for the tile and not rasterized yet, so not marked dirty either
+static inline bool lt_defer_pending(Tile *tile) {
+    return tile->defer != NULL && tile->defer->count > 0;
+}
+bool lt_defer_add(Layout *layout, Tile *tile, const TileDeferOp *op, const uint8_t *data, size_t len);
+void lt_defer_drop(Tile *tile);
+void lt_defer_resolve_all(Layout *layout);
+
+const FontFace *lt_font_face(FontType font);
+int8_t lt_print(Layout *layout, Tile *t, const uint8_t *text, size_t len, const FontFace *face, uint8_t scale);
+uint32_t lt_expand_byte(uint8_t byte, uint8_t scale);
+void lt_render_glyph(uint8_t *dst, size_t stride, const uint8_t *glyph, const FontFace *face,
+                     uint8_t scale, uint8_t from, uint8_t n);
+
+SpanEntry *lt_span_find(struct SpanCache *cache, const FontFace *face, uint8_t scale, const uint8_t *text, size_t len);
+SpanEntry *lt_span_insert(struct SpanCache *cache, const FontFace *face, uint8_t scale, const uint8_t *text, size_t len,
+                          uint8_t pages, uint8_t width, uint8_t count);
+
+void lt_state_begin_flush(Layout *layout);
+void lt_state_commit_tile(Layout *layout, Tile *tile);
+void lt_state_forget_pages(Layout *layout, uint8_t first, uint8_t last);
+void lt_state_end_flush(Layout *layout, bool ok);
+void lt_state_close(Layout *layout);
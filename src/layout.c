@@ -1,53 +1,42 @@
 #include <stddef.h>
 #include <stdint.h>
 #include <stdbool.h>
+#include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <errno.h>
 
-#include <stdio.h>
-
 #include "layout.h"
+#include "layout-internal.h"
+#include "log.h"
 #include "ssd1306.h"
+#include "panel.h"
+#include "font.h"
 
-#define N_ROWS (N_PAGES * 8)
-
-#define MAX_TILES 8
-
-extern int8_t font_8x9_get_columns(uint8_t c, uint8_t *buf);
-extern int8_t font_16x8_get_columns(uint8_t c, uint16_t *buf);
-
-typedef struct {
-    Point start;
-    Point end;      // inclusive
-    bool dirty;
-} Tile;
-
-typedef struct {
-    uint8_t num_tiles;
-    Tile tiles[MAX_TILES];
-    uint8_t data[N_PAGES][N_COLUMNS];
-    write_f write;
-} Layout;
-
-typedef enum {
-    LAYOUT_OK = 0,
-    LAYOUT_ERR_INVALID = -1,
-    LAYOUT_ERR_FULL = -2,
-    LAYOUT_ERR_OVERLAP = -3,
-    LAYOUT_ERR_INVALID_TILE = -4,
-    LAYOUT_ERR_INVALID_POINT = -5,
-    LAYOUT_ERR_INVALID_DATA = -6,
-    LAYOUT_ERR_FLUSH = -7,
-    LAYOUT_ERR_OTHER = -8,
-} LayoutError;
-
-static bool lt_set_position(Layout *layout, AddressingMode mode, Point *start, Point *end);
-static bool lt_flush(Layout *layout, uint8_t *data, uint8_t len);
+static uint8_t lt_encode_window(Layout *layout, FlushVisitor *visitor, AddressingMode mode, Point *start, Point *end, uint8_t *buf);
+static bool lt_flush(Layout *layout, const uint8_t *data, size_t len);
+static bool lt_visit_command(void *ctx, const uint8_t *cmds, size_t len);
+static bool lt_visit_data(void *ctx, const uint8_t *data, size_t len);
+static uint8_t lt_panel_pages(Layout *layout);
+static uint8_t lt_panel_columns(Layout *layout);
+static bool lt_plan_shift(Layout *layout, Tile *tile, FlushVisitor *visitor);
+static const uint8_t *lt_frame_row(Layout *layout, uint8_t page, uint8_t column);
+
+STATIC_ASSERT(sizeof(Layout) <= LAYOUT_STORAGE_SIZE, layout_storage_size);
+STATIC_ASSERT(LAYOUT_MAX_TILES >= 1 && LAYOUT_MAX_TILES <= 32, layout_max_tiles);
+STATIC_ASSERT(LAYOUT_TEXT_GLYPHS >= 1 && LAYOUT_TEXT_GLYPHS <= 255, layout_text_glyphs);
+STATIC_ASSERT(LAYOUT_TILE_STORE < N_PAGES * N_COLUMNS, layout_tile_store);
 
 void tile_init(Tile *tile, Point start, Point end) {
     tile->start = start;
     tile->end = end;
-    tile->dirty = false;
+    tile->text.face = NULL;
+    tile->prepare = NULL;
+    tile->prepare_ctx = NULL;
+    tile->defer = NULL;
+    tile->store = 0;
+    tile->stale = false;
+    tile_setdirty(tile, false);
 }
 
 uint8_t tile_get_width(Tile *tile) {
@@ -63,7 +52,38 @@ uint8_t tile_isdirty(Tile *tile) {
 }
 
 void tile_setdirty(Tile *tile, bool dirty) {
+    if (dirty) {
+        tile->text.face = NULL;
+    }
     tile->dirty = dirty;
+    tile->shift = 0;
+    tile->dirty_start = 0;
+    tile->dirty_end = tile_get_width(tile) - 1;
+    tile->dirty_page_start = 0;
+    tile->dirty_page_end = tile_get_height(tile) - 1;
+}
+
+// Marks tile columns [first, last] dirty on every page of the tile
+void tile_mark_columns(Tile *tile, uint8_t first, uint8_t last) {
+    tile_mark_rect(tile, 0, tile_get_height(tile) - 1, first, last);
+}
+
+// Marks a rectangle of the tile dirty, growing the dirty box of a tile that
+// already is. Drawing code uses this so a flush only sends what was touched.
+void tile_mark_rect(Tile *tile, uint8_t first_page, uint8_t last_page, uint8_t first, uint8_t last) {
+    tile->text.face = NULL;
+    if (!tile->dirty) {
+        tile->dirty = true;
+        tile->dirty_start = first;
+        tile->dirty_end = last;
+        tile->dirty_page_start = first_page;
+        tile->dirty_page_end = last_page;
+        return;
+    }
+    if (first < tile->dirty_start) tile->dirty_start = first;
+    if (last > tile->dirty_end) tile->dirty_end = last;
+    if (first_page < tile->dirty_page_start) tile->dirty_page_start = first_page;
+    if (last_page > tile->dirty_page_end) tile->dirty_page_end = last_page;
 }
 
 bool tile_overlap(Tile *tile1, Tile *tile2) {
@@ -77,55 +97,153 @@ LayoutPtr layout_create(write_f write) {
     Layout *layout = malloc(sizeof(Layout));
     if (layout == NULL) {
         errno = ENOMEM;
-        perror("Failed to allocate memory for layout");
+        LOG_ERROR(LOG_CAT_LAYOUT, "Failed to allocate memory for layout", errno);
         return NULL; // Memory allocation failed
     }
+    layout_init((LayoutStorage *)layout, write);
+    layout->heap = true;
+    return layout;
+}
+
+// Sets a layout up in the caller's storage (see LAYOUT_STORAGE_SIZE). Nothing
+// is allocated then, and later only layout_set_deferred allocates, a display
+// list per deferred tile. layout_free releases what the layout holds but
+// leaves the storage to the caller.
+LayoutPtr layout_init(LayoutStorage *storage, write_f write) {
+    Layout *layout = (Layout *)storage;
+    if (layout == NULL) {
+        errno = EINVAL;
+        LOG_ERROR(LOG_CAT_LAYOUT, "Layout storage is NULL", errno);
+        return NULL;
+    }
     layout->num_tiles = 0;
     for (int i = 0; i < MAX_TILES; i++) {
         tile_init(&layout->tiles[i], (Point){0, 0}, (Point){0, 0});
     }
-    for (int i = 0; i < N_PAGES; i++) {
-        for (int j = 0; j < N_COLUMNS; j++) {
-            layout->data[i][j] = 0;
-        }
-    }
+    memset(layout->pixels, 0, sizeof(layout->pixels));
+    layout->store_used = 0;
+    layout->heap = false;
     layout->write = write;
+    layout->panel = NULL;
+    layout->controller = (ControllerState){
+        .addressing = LT_ADDRESSING_UNKNOWN,
+        .contrast = 0x7F,
+        .display = SSD1306_OPTION_DISPLAY_NORMAL,
+        .start_line = 0,
+        .segment_remap = SSD1306_OPTION_SEGMENT_REMAP_SEG0_TO_0,
+        .com_scan_dir = SSD1306_OPTION_COM_SCAN_DIR_NORMAL,
+        .scroll = {0},
+    };
+    layout->start_line = 0;
+    layout->scroll = (ScrollState){0};
+    layout->double_buffer = false;
+    layout->ram_page = 0;
+    layout->segment_remap = SSD1306_OPTION_SEGMENT_REMAP_SEG0_TO_0;
+    layout->com_scan_dir = SSD1306_OPTION_COM_SCAN_DIR_NORMAL;
+    layout->transposed = false;
+    memset(layout->view, 0, sizeof(layout->view));
+    layout->state = NULL;
+    layout->glyph_cache = NULL;
+    layout->span_cache = NULL;
     return layout;
 }
 
 void layout_free(LayoutPtr layout_) {
     if (layout_ != NULL) {
-        free((Layout *)layout_);
+        Layout *layout = (Layout *)layout_;
+        for (int i = 0; i < layout->num_tiles; i++) {
+            free(layout->tiles[i].defer);
+        }
+        lt_state_close(layout);
+        if (layout->heap) {
+            free(layout);
+        }
+    }
+}
+
+// Call after panel_init: the layout assumes the controller is in the state the
+// profile's init sequence leaves it in.
+int8_t layout_set_panel(LayoutPtr layout_, const PanelProfile *panel) {
+    Layout *layout = (Layout *)layout_;
+    if (layout == NULL || panel == NULL) {
+        errno = EINVAL;
+        LOG_ERROR(LOG_CAT_LAYOUT, "Layout or panel is NULL", errno);
+        return LAYOUT_ERR_INVALID;
+    }
+    if (panel->pages > N_PAGES || panel->width > N_COLUMNS) {
+        errno = EINVAL;
+        LOG_ERROR(LOG_CAT_LAYOUT, "Panel does not fit the framebuffer", panel->pages);
+        return LAYOUT_ERR_INVALID;
+    }
+    if (layout->transposed) {
+        errno = EBUSY;
+        LOG_ERROR(LOG_CAT_LAYOUT, "Set the panel before rotating the layout", errno);
+        return LAYOUT_ERR_INVALID;
+    }
+    for (int i = 0; i < layout->num_tiles; i++) {
+        Tile *t = &layout->tiles[i];
+        if (t->end.page >= panel->pages || t->end.column >= panel->width) {
+            errno = EINVAL;
+            LOG_ERROR(LOG_CAT_LAYOUT, "Existing tile outside of panel", i);
+            return LAYOUT_ERR_INVALID_TILE;
+        }
     }
+    layout->panel = panel;
+    layout->controller.addressing = panel->addressing_mode;
+    layout->controller.contrast = panel->contrast;
+    layout->controller.display = SSD1306_OPTION_DISPLAY_NORMAL;
+    layout->controller.start_line = 0;
+    layout->start_line = 0;
+    layout->controller.segment_remap = SSD1306_OPTION_SEGMENT_REMAP_SEG0_TO_0;
+    layout->controller.com_scan_dir = SSD1306_OPTION_COM_SCAN_DIR_NORMAL;
+    layout->controller.scroll = (ScrollState){0};
+    layout->scroll = (ScrollState){0};
+    layout->double_buffer = false;
+    layout->ram_page = 0;
+    return LAYOUT_OK;
+}
+
+// Whether [start, end] is a tile rectangle inside the layout
+bool lt_tile_fits(Layout *layout, const Point *start, const Point *end) {
+    return start->page <= end->page && start->column <= end->column
+        && end->page < lt_get_pages(layout) && end->column < lt_get_columns(layout);
 }
 
 int8_t layout_add_tile(LayoutPtr layout_, Point *start, Point *end) {
     Layout *layout = (Layout *)layout_;
     if (layout == NULL) {
         errno = EINVAL;
-        perror("Layout is NULL");
+        LOG_ERROR(LOG_CAT_LAYOUT, "Layout is NULL", errno);
         return LAYOUT_ERR_INVALID;
     }
     if (layout->num_tiles >= MAX_TILES) {
         errno = ENOMEM;
-        perror("Layout is full");
+        LOG_ERROR(LOG_CAT_LAYOUT, "Layout is full", errno);
         return LAYOUT_ERR_FULL;
     }
-    if (start->page > end->page || start->column > end->column
-        || end->page >= N_PAGES || end->column >= N_COLUMNS) {
+    if (!lt_tile_fits(layout, start, end)) {
         errno = EINVAL;
-        perror("Invalid tile coordinates");
+        LOG_ERROR(LOG_CAT_LAYOUT, "Invalid tile coordinates", errno);
         return LAYOUT_ERR_INVALID_TILE;
     }
     for (int i = 0; i < layout->num_tiles; i++) {
-        if (tile_overlap(&layout->tiles[i], &(Tile){*start, *end, false})) {
+        if (tile_overlap(&layout->tiles[i], &(Tile){.start = *start, .end = *end})) {
             errno = EEXIST;
-            perror("Tile overlaps with existing tile");
+            LOG_ERROR(LOG_CAT_LAYOUT, "Tile overlaps with existing tile", errno);
             return LAYOUT_ERR_OVERLAP;
         }
     }
-    layout->tiles[layout->num_tiles].start = *start;
-    layout->tiles[layout->num_tiles].end = *end;
+    uint16_t bytes = (uint16_t)((end->column - start->column + 1) * (end->page - start->page + 1));
+    if (LAYOUT_TILE_STORE > 0 && bytes > LAYOUT_TILE_STORE - layout->store_used) {
+        errno = ENOMEM;
+        LOG_ERROR(LOG_CAT_LAYOUT, "Tile store is full", bytes);
+        return LAYOUT_ERR_FULL;
+    }
+    tile_init(&layout->tiles[layout->num_tiles], *start, *end);
+    if (LAYOUT_TILE_STORE > 0) {
+        layout->tiles[layout->num_tiles].store = layout->store_used;
+        layout->store_used += bytes;
+    }
     layout->num_tiles++;
     return layout->num_tiles - 1; // Return the index of the new tile
 }
@@ -134,12 +252,12 @@ int8_t layout_edit_tile(LayoutPtr layout_, uint8_t tile, Point *tile_point, uint
     Layout *layout = (Layout *)layout_;
     if (layout == NULL) {
         errno = EINVAL;
-        perror("Layout is NULL");
+        LOG_ERROR(LOG_CAT_LAYOUT, "Layout is NULL", errno);
         return LAYOUT_ERR_INVALID;
     }
     if (tile >= layout->num_tiles) {
         errno = EINVAL;
-        perror("Invalid tile index");
+        LOG_ERROR(LOG_CAT_LAYOUT, "Invalid tile index", errno);
         return LAYOUT_ERR_INVALID_TILE;
     }
     Tile *t = &layout->tiles[tile];
@@ -149,18 +267,21 @@ int8_t layout_edit_tile(LayoutPtr layout_, uint8_t tile, Point *tile_point, uint
     if (point.page < t->start.page || point.page > t->end.page ||
             point.column < t->start.column || point.column > t->end.column) {
         errno = EINVAL;
-        perror("Invalid tile point");
+        LOG_ERROR(LOG_CAT_LAYOUT, "Invalid tile point", errno);
         return LAYOUT_ERR_INVALID_POINT;
     }
     if (point.column + len > t->end.column + 1) {
         errno = EMSGSIZE;
-        perror("Data length exceeds tile bounds");
+        LOG_ERROR(LOG_CAT_LAYOUT, "Data length exceeds tile bounds", errno);
         return LAYOUT_ERR_INVALID_DATA;
     }
+    uint8_t *row = lt_tile_row(layout, t, tile_point->page);
     for (int i = 0; i < len; i++) {
-        layout->data[point.page][point.column + i] = data[i];
+        row[tile_point->column + i] = data[i];
+    }
+    if (len > 0) {
+        tile_mark_columns(t, tile_point->column, tile_point->column + len - 1);
     }
-    tile_setdirty(t, true);
     return LAYOUT_OK;
 }
 
@@ -168,7 +289,7 @@ uint8_t layout_get_num_tiles(LayoutPtr layout_) {
     Layout *layout = (Layout *)layout_;
     if (layout == NULL) {
         errno = EINVAL;
-        perror("Layout is NULL");
+        LOG_ERROR(LOG_CAT_LAYOUT, "Layout is NULL", errno);
         return 0;
     }
     return layout->num_tiles;
@@ -178,21 +299,24 @@ int8_t layout_clear_tile(LayoutPtr layout_, uint8_t tile, uint8_t fill) {
     Layout *layout = (Layout *)layout_;
     if (layout == NULL) {
         errno = EINVAL;
-        perror("Layout is NULL");
+        LOG_ERROR(LOG_CAT_LAYOUT, "Layout is NULL", errno);
         return LAYOUT_ERR_INVALID;
     }
     if (tile >= layout->num_tiles) {
         errno = EINVAL;
-        perror("Invalid tile index");
+        LOG_ERROR(LOG_CAT_LAYOUT, "Invalid tile index", errno);
         return LAYOUT_ERR_INVALID_TILE;
     }
     Tile *t = &layout->tiles[tile];
     uint8_t width = tile_get_width(t);
     uint8_t height = tile_get_height(t);
+    if (lt_defer_active(t)) {
+        TileDeferOp op = {.kind = LT_DEFER_CLEAR, .arg = fill, .opaque = true, .x1 = width, .y1 = height * 8};
+        lt_defer_add(layout, t, &op, NULL, 0);
+        return LAYOUT_OK;
+    }
     for (int i = 0; i < height; i++) {
-        for (int j = 0; j < width; j++) {
-            layout->data[t->start.page + i][t->start.column + j] = fill;
-        }
+        memset(lt_tile_row(layout, t, i), fill, width);
     }
     tile_setdirty(t, true);
     return LAYOUT_OK;
@@ -202,12 +326,12 @@ uint8_t layout_get_tile_width(LayoutPtr layout_, uint8_t tile) {
     Layout *layout = (Layout *)layout_;
     if (layout == NULL) {
         errno = EINVAL;
-        perror("Layout is NULL");
+        LOG_ERROR(LOG_CAT_LAYOUT, "Layout is NULL", errno);
         return 0;
     }
     if (tile >= layout->num_tiles) {
         errno = EINVAL;
-        perror("Invalid tile index");
+        LOG_ERROR(LOG_CAT_LAYOUT, "Invalid tile index", errno);
         return 0;
     }
     Tile *t = &layout->tiles[tile];
@@ -218,12 +342,12 @@ uint8_t layout_get_tile_height(LayoutPtr layout_, uint8_t tile) {
     Layout *layout = (Layout *)layout_;
     if (layout == NULL) {
         errno = EINVAL;
-        perror("Layout is NULL");
+        LOG_ERROR(LOG_CAT_LAYOUT, "Layout is NULL", errno);
         return 0;
     }
     if (tile >= layout->num_tiles) {
         errno = EINVAL;
-        perror("Invalid tile index");
+        LOG_ERROR(LOG_CAT_LAYOUT, "Invalid tile index", errno);
         return 0;
     }
     Tile *t = &layout->tiles[tile];
@@ -234,220 +358,674 @@ int8_t layout_print(LayoutPtr layout_, uint8_t tile, uint8_t *text, uint8_t len,
     Layout *layout = (Layout *)layout_;
     if (layout == NULL) {
         errno = EINVAL;
-        perror("Layout is NULL");
+        LOG_ERROR(LOG_CAT_LAYOUT, "Layout is NULL", errno);
         return LAYOUT_ERR_INVALID;
     }
     if (tile >= layout->num_tiles) {
         errno = EINVAL;
-        perror("Invalid tile index");
+        LOG_ERROR(LOG_CAT_LAYOUT, "Invalid tile index", errno);
         return LAYOUT_ERR_INVALID_TILE;
     }
+    const FontFace *face = lt_font_face(font);
+    if (face == NULL) {
+        errno = EINVAL;
+        LOG_ERROR(LOG_CAT_LAYOUT, "Invalid font type", font);
+        return LAYOUT_ERR_OTHER;
+    }
     Tile *t = &layout->tiles[tile];
-    uint8_t width = tile_get_width(t);
-    uint8_t height = tile_get_height(t);
+    return lt_print(layout, t, text, len, face, 1);
+}
 
-    if (font == FONT_8x9) {
-        uint8_t page = 0;
-        uint8_t column = 0;
-        uint8_t columns[10] = {0};
-        for (int i = 0; i < len; i++) {
-            int8_t clen = 0;
-            if (text[i] == ' ') {
-                clen = 4;
-                for (int j = 0; j < clen; j++) {
-                    columns[j] = 0;
-                }
-            }
-            else {
-                clen = font_8x9_get_columns(text[i], columns);
-            }
-            if (clen < 0) {
-                errno = EINVAL;
-                perror("Invalid character");
-                return LAYOUT_ERR_INVALID_DATA;
-            }
-            for (int j = 0; j < clen; j++) {
-                if (page >= height) {
-                    errno = ENOSPC;
-                    perror("No space left in tile");
-                    return LAYOUT_ERR_FULL;
-                }
-                layout->data[t->start.page + page][t->start.column + column] = columns[j];
-                column++;
-                if (column >= width) {
-                    column = 0;
-                    page++;
-                }
-            }
-        }
-        while (page < height) {
-            for (int j = column; j < width; j++) {
-                layout->data[t->start.page + page][t->start.column + j] = 0;
-            }
-            page++;
-        }
-    } else if (font == FONT_16x8) {
-        uint8_t page = 0;
-        uint8_t column = 0;
-        uint16_t columns[8] = {0};
-        for (int i = 0; i < len; i++) {
-            int8_t clen = 0;
-            if (text[i] == ' ') {
-                clen = 8;
-                for (int j = 0; j < clen; j++) {
-                    columns[j] = 0;
-                }
-            }
-            else {
-                clen = font_16x8_get_columns(text[i], columns);
-            }
-            if (clen < 0) {
-                errno = EINVAL;
-                perror("Invalid character");
-                return LAYOUT_ERR_INVALID_DATA;
-            }
-            for (int j = 0; j < clen; j++) {
-                if (page >= height) {
-                    errno = ENOSPC;
-                    perror("No space left in tile");
-                    return LAYOUT_ERR_FULL;
-                }
-                layout->data[t->start.page + page][t->start.column + column] = columns[j] & 0xFF;
-                layout->data[t->start.page + page + 1][t->start.column + column] = (columns[j] >> 8) & 0xFF;
-                column++;
-                if (column >= width) {
-                    column = 0;
-                    page += 2;
-                }
-            }
-        }
-        while (page < height) {
-            for (int j = column; j < width; j++) {
-                layout->data[t->start.page + page][t->start.column + j] = 0;
-                layout->data[t->start.page + page + 1][t->start.column + j] = 0;
-            }
-            page += 2;
-        }
-    } else {
+// Prints UTF-8 text with any font face, e.g. one loaded from a font pack
+int8_t layout_print_face(LayoutPtr layout, uint8_t tile, const uint8_t *text, size_t len, const FontFace *face) {
+    return layout_print_scaled(layout, tile, text, len, face, 1);
+}
+
+// Prints with every glyph scaled up by an integer factor (1 to LAYOUT_MAX_SCALE),
+// e.g. 8 px digits as 32 px readouts
+int8_t layout_print_scaled(LayoutPtr layout_, uint8_t tile, const uint8_t *text, size_t len, const FontFace *face, uint8_t scale) {
+    Layout *layout = (Layout *)layout_;
+    if (layout == NULL || face == NULL) {
         errno = EINVAL;
-        perror("Invalid font type");
-        return LAYOUT_ERR_OTHER;
+        LOG_ERROR(LOG_CAT_LAYOUT, "Layout or font is NULL", errno);
+        return LAYOUT_ERR_INVALID;
     }
+    if (tile >= layout->num_tiles) {
+        errno = EINVAL;
+        LOG_ERROR(LOG_CAT_LAYOUT, "Invalid tile index", errno);
+        return LAYOUT_ERR_INVALID_TILE;
+    }
+    if (scale < 1 || scale > LAYOUT_MAX_SCALE) {
+        errno = EINVAL;
+        LOG_ERROR(LOG_CAT_LAYOUT, "Invalid scale", scale);
+        return LAYOUT_ERR_INVALID;
+    }
+    Tile *t = &layout->tiles[tile];
+    return lt_print(layout, t, text, len, face, scale);
+}
 
-    tile_setdirty(t, true);
-    return LAYOUT_OK;
+// Prints a number right-aligned in a field of `digits` characters. Reprints
+// keep the glyph count, so only the digits that changed are redrawn.
+int8_t layout_print_number(LayoutPtr layout, uint8_t tile, int32_t value, uint8_t digits, const FontFace *face) {
+    char buf[16];
+    int len = snprintf(buf, sizeof(buf), "%*ld", digits, (long)value);
+    if (len < 0 || len >= (int)sizeof(buf)) {
+        errno = EINVAL;
+        LOG_ERROR(LOG_CAT_LAYOUT, "Number field too wide", digits);
+        return LAYOUT_ERR_INVALID;
+    }
+    return layout_print_face(layout, tile, (const uint8_t *)buf, (size_t)len, face);
 }
 
 int8_t layout_flush(LayoutPtr layout_) {
     Layout *layout = (Layout *)layout_;
     if (layout == NULL) {
         errno = EINVAL;
-        perror("Layout is NULL");
+        LOG_ERROR(LOG_CAT_LAYOUT, "Layout is NULL", errno);
         return LAYOUT_ERR_INVALID;
     }
+    FlushVisitor visitor;
+    lt_panel_visitor(layout, &visitor);
+    lt_prepare_tiles(layout);
+    lt_state_begin_flush(layout);
+    if (!lt_plan_scroll_stop(layout, &visitor) || !lt_plan_orientation(layout, &visitor)) {
+        lt_state_end_flush(layout, false);
+        errno = EIO;
+        return LAYOUT_ERR_FLUSH;
+    }
+    bool sent = false;
     for (int i = 0; i < layout->num_tiles; i++) {
         Tile *tile = &layout->tiles[i];
-        if (tile_isdirty(tile)) {
-            Point start = tile->start;
-            Point end = tile->end;
-            uint8_t width = tile_get_width(tile);
-            uint8_t height = tile_get_height(tile);
-            if (!lt_set_position(layout, ADDRESSING_MODE_HORIZONTAL, &start, &end)) {
+        Tile pending;
+        lt_pending_tile(layout, tile, &pending);
+        if (tile_isdirty(&pending)) {
+            bool ok = lt_plan_tile(layout, &pending, &visitor);
+            layout->controller.addressing = visitor.addressing;
+            if (!ok) {
+                layout->controller.addressing = LT_ADDRESSING_UNKNOWN;
+                lt_state_end_flush(layout, false);
                 errno = EIO;
-                perror("Failed to set position");
                 return LAYOUT_ERR_FLUSH;
             }
-            for (int j = 0; j < height; j++) {
-                if (!lt_flush(layout, layout->data[start.page + j] + start.column, width)) {
-                    errno = EIO;
-                    perror("Failed to print data");
-                    return LAYOUT_ERR_FLUSH;
-                }
+            if (layout->state != NULL) {
+                lt_state_commit_tile(layout, tile);
+            }
+            if (layout->double_buffer) {
+                // The half shown until now misses what was just sent
+                tile->stale = tile->dirty;
+                tile->stale_start = tile->dirty_start;
+                tile->stale_end = tile->dirty_end;
+                tile->stale_page_start = tile->dirty_page_start;
+                tile->stale_page_end = tile->dirty_page_end;
             }
             tile_setdirty(tile, false);
+            sent = true;
         }
     }
+    if (layout->double_buffer && sent) {
+        // Show the half just written, and write the other one next time
+        layout->start_line = lt_buffer_line(layout, layout->ram_page);
+        layout->ram_page = layout->ram_page == 0 ? lt_buffer_pages(layout) : 0;
+    }
+    if (!lt_plan_controller(layout, &visitor)) {
+        lt_state_end_flush(layout, false);
+        errno = EIO;
+        return LAYOUT_ERR_FLUSH;
+    }
+    layout->controller.start_line = layout->start_line;
+    layout->controller.scroll = layout->scroll;
+    layout->controller.segment_remap = layout->segment_remap;
+    layout->controller.com_scan_dir = layout->com_scan_dir;
+    lt_state_end_flush(layout, true);
     return LAYOUT_OK;
 }
 
-int8_t layout_clear(LayoutPtr layout_, uint8_t fill) {
+// Double buffering needs the panel to show at most half of GDDRAM. Frames
+// are written to the hidden half and shown with a single start line command,
+// so a slow transfer never shows a half-updated frame. Only tiles are
+// written: the rest of the hidden half is what panel_init's clear left there.
+int8_t layout_set_double_buffer(LayoutPtr layout_, bool enable) {
     Layout *layout = (Layout *)layout_;
     if (layout == NULL) {
         errno = EINVAL;
-        perror("Layout is NULL");
+        LOG_ERROR(LOG_CAT_LAYOUT, "Layout is NULL", errno);
+        return LAYOUT_ERR_INVALID;
+    }
+    if (enable == layout->double_buffer) {
+        return LAYOUT_OK;
+    }
+    uint8_t pages = lt_buffer_pages(layout);
+    if (enable && (2 * pages > LT_RAM_PAGES || lt_panel_pages(layout) > pages)) {
+        errno = EINVAL;
+        LOG_ERROR(LOG_CAT_LAYOUT, "Panel shows too much of GDDRAM for a hidden buffer", pages);
         return LAYOUT_ERR_INVALID;
     }
-    for (int j = 0; j < N_PAGES; j++) {
-        for (int k = 0; k < N_COLUMNS; k++) {
-            layout->data[j][k] = fill;
+    if (enable && (layout->scroll.active || layout->controller.scroll.active)) {
+        errno = EBUSY;
+        LOG_ERROR(LOG_CAT_LAYOUT, "Cannot double buffer while scrolling", errno);
+        return LAYOUT_ERR_INVALID;
+    }
+    for (int i = 0; i < layout->num_tiles; i++) {
+        Tile *tile = &layout->tiles[i];
+        tile->stale = enable;
+        tile->stale_start = 0;
+        tile->stale_end = tile_get_width(tile) - 1;
+        tile->stale_page_start = 0;
+        tile->stale_page_end = tile_get_height(tile) - 1;
+    }
+    if (enable) {
+        // Whichever half the panel shows stays up; the other one is written next
+        bool second = layout->controller.start_line == lt_buffer_line(layout, pages);
+        layout->ram_page = second ? 0 : pages;
+        layout->start_line = layout->controller.start_line;
+    } else {
+        if (layout->ram_page == 0) {
+            // The panel shows the second half: rewrite the first and go back to it
+            for (int i = 0; i < layout->num_tiles; i++) {
+                tile_setdirty(&layout->tiles[i], true);
+            }
         }
+        layout->ram_page = 0;
+        layout->start_line = 0;
+    }
+    layout->double_buffer = enable;
+    return LAYOUT_OK;
+}
+
+int8_t layout_clear(LayoutPtr layout_, uint8_t fill) {
+    Layout *layout = (Layout *)layout_;
+    if (layout == NULL) {
+        errno = EINVAL;
+        LOG_ERROR(LOG_CAT_LAYOUT, "Layout is NULL", errno);
+        return LAYOUT_ERR_INVALID;
+    }
+    if (layout->transposed) {
+        memset(layout->view, fill, sizeof(layout->view));
+    } else {
+        memset(layout->pixels, fill, sizeof(layout->pixels));
     }
     for (int i = 0; i < layout->num_tiles; i++) {
         Tile *tile = &layout->tiles[i];
+        lt_defer_drop(tile);
         tile_setdirty(tile, true);
     }
     return LAYOUT_OK;
 }
 
-static bool lt_set_position(Layout *layout, AddressingMode mode, Point *start, Point *end) {
+#define LT_FLIP_X       0x01    // segment remap
+#define LT_FLIP_Y       0x02    // COM scan reverse
+#define LT_TRANSPOSE    0x04    // rows and columns swapped in software
+
+// 180 degrees and mirroring are free: the controller flips columns (segment
+// remap) and rows (COM scan direction). 90 and 270 degrees add a transpose:
+// tiles and drawing use the rotated coordinates, and each flush transposes
+// only the dirty part of the dirty tiles into the framebuffer, 8x8 pixels at
+// a time. Switching between landscape and portrait clears the layout; tiles
+// keep their coordinates, so they must fit the new orientation.
+int8_t layout_set_orientation(LayoutPtr layout_, LayoutRotation rotation, bool mirror) {
+    // Flips for each rotation, then the same rotation mirrored left to right
+    static const uint8_t orientations[4][2] = {
+        {0, LT_FLIP_X},
+        {LT_FLIP_X | LT_TRANSPOSE, LT_FLIP_X | LT_FLIP_Y | LT_TRANSPOSE},
+        {LT_FLIP_X | LT_FLIP_Y, LT_FLIP_Y},
+        {LT_FLIP_Y | LT_TRANSPOSE, LT_TRANSPOSE},
+    };
+    Layout *layout = (Layout *)layout_;
+    if (layout == NULL || rotation > LAYOUT_ROTATE_270) {
+        errno = EINVAL;
+        LOG_ERROR(LOG_CAT_LAYOUT, "Invalid orientation", rotation);
+        return LAYOUT_ERR_INVALID;
+    }
+    if (layout->scroll.active || layout->controller.scroll.active) {
+        errno = EBUSY;
+        LOG_ERROR(LOG_CAT_LAYOUT, "Cannot rotate while scrolling", errno);
+        return LAYOUT_ERR_INVALID;
+    }
+    uint8_t flags = orientations[rotation][mirror ? 1 : 0];
+    bool transposed = flags & LT_TRANSPOSE;
+    if (transposed && (!LAYOUT_ROTATION || LAYOUT_TILE_STORE > 0)) {
+        errno = EINVAL;
+        LOG_ERROR(LOG_CAT_LAYOUT, "Rotation by 90 or 270 degrees not built in", rotation);
+        return LAYOUT_ERR_INVALID;
+    }
+    if (transposed && lt_panel_columns(layout) % 8 != 0) {
+        errno = EINVAL;
+        LOG_ERROR(LOG_CAT_LAYOUT, "Panel width is not a whole number of pages", lt_panel_columns(layout));
+        return LAYOUT_ERR_INVALID;
+    }
+    uint8_t pages = transposed ? lt_panel_columns(layout) / 8 : lt_panel_pages(layout);
+    uint8_t columns = transposed ? lt_panel_pages(layout) * 8 : lt_panel_columns(layout);
+    for (int i = 0; i < layout->num_tiles; i++) {
+        Tile *t = &layout->tiles[i];
+        if (t->end.page >= pages || t->end.column >= columns) {
+            errno = EINVAL;
+            LOG_ERROR(LOG_CAT_LAYOUT, "Existing tile outside of the rotated panel", i);
+            return LAYOUT_ERR_INVALID_TILE;
+        }
+    }
+    uint8_t remap = flags & LT_FLIP_X ? SSD1306_OPTION_SEGMENT_REMAP_SEG0_TO_127 : SSD1306_OPTION_SEGMENT_REMAP_SEG0_TO_0;
+    bool turned = transposed != layout->transposed;
+    if (turned) {
+        memset(layout->pixels, 0, sizeof(layout->pixels));
+        memset(layout->view, 0, sizeof(layout->view));
+        layout->transposed = transposed;
+        for (int i = 0; i < layout->num_tiles; i++) {
+            lt_defer_drop(&layout->tiles[i]);
+        }
+    }
+    if (turned || remap != layout->segment_remap) {
+        // The remap only applies to data written after it: rewrite every tile
+        for (int i = 0; i < layout->num_tiles; i++) {
+            tile_setdirty(&layout->tiles[i], true);
+        }
+    }
+    layout->segment_remap = remap;
+    layout->com_scan_dir = flags & LT_FLIP_Y ? SSD1306_OPTION_COM_SCAN_DIR_REVERSE : SSD1306_OPTION_COM_SCAN_DIR_NORMAL;
+    return LAYOUT_OK;
+}
+
+static uint8_t lt_panel_pages(Layout *layout) {
+    return layout->panel != NULL ? layout->panel->pages : N_PAGES;
+}
+
+static uint8_t lt_panel_columns(Layout *layout) {
+    return layout->panel != NULL ? layout->panel->width : N_COLUMNS;
+}
+
+// Pages and columns tiles are laid out in: the panel's, swapped while transposed
+uint8_t lt_get_pages(Layout *layout) {
+    return layout->transposed ? lt_panel_columns(layout) / 8 : lt_panel_pages(layout);
+}
+
+uint8_t lt_get_columns(Layout *layout) {
+    return layout->transposed ? lt_panel_pages(layout) * 8 : lt_panel_columns(layout);
+}
+
+// Framebuffer rect a tile ends up in
+void lt_tile_bounds(Layout *layout, Tile *tile, Point *start, Point *end) {
+    *start = tile->start;
+    *end = tile->end;
+    if (layout->transposed) {
+        *start = (Point){tile->start.column / 8, tile->start.page * 8};
+        *end = (Point){tile->end.column / 8, tile->end.page * 8 + 7};
+    }
+}
+
+// GDDRAM column of framebuffer column 0
+static uint8_t lt_column_offset(Layout *layout) {
+    uint8_t offset = layout->panel != NULL ? layout->panel->column_offset : 0;
+    if (layout->segment_remap == SSD1306_OPTION_SEGMENT_REMAP_SEG0_TO_127) {
+        // Remapped columns count from the other end of GDDRAM
+        uint8_t ram_columns = layout->panel != NULL ? layout->panel->ram_columns : N_COLUMNS;
+        offset = ram_columns - lt_panel_columns(layout) - offset;
+    }
+    return offset;
+}
+
+static uint8_t lt_encode_window(Layout *layout, FlushVisitor *visitor, AddressingMode mode, Point *start, Point *end, uint8_t *buf) {
+    uint8_t len = 0;
+    uint8_t offset = lt_column_offset(layout);
+    uint8_t start_column = start->column + offset;
+    uint8_t end_column = end->column + offset;
+    uint8_t start_page = start->page + layout->ram_page;
+    uint8_t end_page = end->page + layout->ram_page;
+    bool page_only = layout->panel != NULL && (layout->panel->flags & PANEL_FLAG_PAGE_ADDRESSING_ONLY);
+    if (visitor->addressing != mode && !page_only) {
+        // The mode persists in the controller, so it is only sent when it changes
+        uint8_t cmd[] = {SSD1306_CMD_SET_MEMORY_ADDRESSING_MODE(mode)};
+        memcpy(buf + len, cmd, sizeof(cmd));
+        len += sizeof(cmd);
+        visitor->addressing = mode;
+    }
     switch (mode) {
         case ADDRESSING_MODE_HORIZONTAL:
-            if (!ssd1306_set_memory_addressing_mode(SSD1306_OPTION_ADDRESSING_MODE_HORIZONTAL)) {
-                perror("Failed to set addressing mode");
-                return false;
-            }
-            if (!ssd1306_hava_mode_set_page_addr(start->page, end->page)) {
-                perror("Failed to set page address");
-                return false;
-            }
-            if (!ssd1306_hava_mode_set_column_addr(start->column, end->column)) {
-                perror("Failed to set column address");
-                return false;
-            }
+        case ADDRESSING_MODE_VERTICAL: {
+            uint8_t cmd[] = {
+                SSD1306_CMD_HAVA_MODE_SET_PAGE_ADDR(start_page, end_page),
+                SSD1306_CMD_HAVA_MODE_SET_COLUMN_ADDR(start_column, end_column),
+            };
+            memcpy(buf + len, cmd, sizeof(cmd));
+            len += sizeof(cmd);
             break;
-        case ADDRESSING_MODE_VERTICAL:
-            if (!ssd1306_set_memory_addressing_mode(SSD1306_OPTION_ADDRESSING_MODE_VERTICAL)) {
-                perror("Failed to set addressing mode");
-                return false;
-            }
-            if (!ssd1306_hava_mode_set_page_addr(start->page, end->page)) {
-                perror("Failed to set page address");
-                return false;
-            }
-            if (!ssd1306_hava_mode_set_column_addr(start->column, end->column)) {
-                perror("Failed to set column address");
-                return false;
-            }
+        }
+        case ADDRESSING_MODE_PAGE: {
+            uint8_t cmd[] = {
+                SSD1306_CMD_PA_MODE_SET_PAGE_ADDR(start_page),
+                SSD1306_CMD_PA_MODE_SET_COLUMN_ADDR_LOW(start_column),
+                SSD1306_CMD_PA_MODE_SET_COLUMN_ADDR_HIGH(start_column),
+            };
+            memcpy(buf + len, cmd, sizeof(cmd));
+            len += sizeof(cmd);
             break;
-        case ADDRESSING_MODE_PAGE:
-            if (!ssd1306_set_memory_addressing_mode(SSD1306_OPTION_ADDRESSING_MODE_PAGE)) {
-                perror("Failed to set addressing mode");
-                return false;
+        }
+        default:
+            LOG_ERROR(LOG_CAT_LAYOUT, "Invalid addressing mode", mode);
+            return 0;
+    }
+    return len;
+}
+
+static bool lt_flush(Layout *layout, const uint8_t *data, size_t len) {
+    if (!layout->write(data, len)) {
+        LOG_ERROR(LOG_CAT_LAYOUT, "Failed to send message", errno);
+        return false;
+    }
+    return true;
+}
+
+// Narrows [start, end] to the bytes that differ from what the panel holds.
+// Returns false when nothing differs.
+static bool lt_diff_bounds(Layout *layout, Point *start, Point *end) {
+    Point lo = {0xFF, 0xFF};
+    Point hi = {0, 0};
+    for (uint8_t page = start->page; page <= end->page; page++) {
+        const uint8_t *now = lt_frame(layout)[page];
+        const uint8_t *was = layout->state->frame[page];
+        uint8_t first = start->column;
+        uint8_t last = end->column;
+        while (first <= last && now[first] == was[first]) {
+            first++;
+        }
+        if (first > last) {
+            continue;
+        }
+        while (now[last] == was[last]) {
+            last--;
+        }
+        if (page < lo.page) lo.page = page;
+        hi.page = page;
+        if (first < lo.column) lo.column = first;
+        if (last > hi.column) hi.column = last;
+    }
+    if (lo.page == 0xFF) {
+        return false;
+    }
+    *start = lo;
+    *end = hi;
+    return true;
+}
+
+// What a flush sends for the tile: its dirty box, grown in double-buffer mode
+// by what the hidden half missed while the other half was being written
+void lt_pending_tile(Layout *layout, Tile *tile, Tile *pending) {
+    *pending = *tile;
+    if (!layout->double_buffer || !tile->stale) {
+        return;
+    }
+    if (!pending->dirty) {
+        pending->dirty = true;
+        pending->dirty_start = tile->stale_start;
+        pending->dirty_end = tile->stale_end;
+        pending->dirty_page_start = tile->stale_page_start;
+        pending->dirty_page_end = tile->stale_page_end;
+        return;
+    }
+    if (tile->stale_start < pending->dirty_start) pending->dirty_start = tile->stale_start;
+    if (tile->stale_end > pending->dirty_end) pending->dirty_end = tile->stale_end;
+    if (tile->stale_page_start < pending->dirty_page_start) pending->dirty_page_start = tile->stale_page_start;
+    if (tile->stale_page_end > pending->dirty_page_end) pending->dirty_page_end = tile->stale_page_end;
+}
+
+// Transposes the view rect [start, end] into the framebuffer, a view page by
+// 8 view columns at a time, and turns it into the framebuffer rect it covers
+static void lt_transpose_rect(Layout *layout, Point *start, Point *end) {
+    uint8_t first = start->column / 8;
+    uint8_t last = end->column / 8;
+    for (uint8_t page = start->page; page <= end->page; page++) {
+        const uint8_t *src = layout->view[page];
+        for (uint8_t k = first; k <= last; k++) {
+            uint64_t x = 0;
+            for (int j = 0; j < 8; j++) {
+                x |= (uint64_t)src[k * 8 + j] << (8 * j);
             }
-            if (!ssd1306_pa_mode_set_page_addr(start->page)) {
-                perror("Failed to set page address");
-                return false;
+            x = lt_transpose8(x);
+            uint8_t *dst = &lt_frame(layout)[k][page * 8];
+            for (int i = 0; i < 8; i++) {
+                dst[i] = (uint8_t)(x >> (8 * i));
+            }
+        }
+    }
+    *start = (Point){first, start->page * 8};
+    *end = (Point){last, end->page * 8 + 7};
+}
+
+bool lt_plan_tile(Layout *layout, Tile *tile, FlushVisitor *visitor) {
+    Point start = tile->start;
+    Point end = tile->end;
+    if (tile->dirty) {
+        end.column = start.column + tile->dirty_end;
+        end.page = start.page + tile->dirty_page_end;
+        start.column += tile->dirty_start;
+        start.page += tile->dirty_page_start;
+    }
+    bool shift = tile->shift && lt_tile_can_shift(layout, tile);
+    if (tile->shift && !shift) {
+        // The framebuffer moved under the whole tile
+        start = tile->start;
+        end = tile->end;
+    }
+    if (layout->transposed) {
+        lt_transpose_rect(layout, &start, &end);
+    }
+    if (shift) {
+        if (!lt_plan_shift(layout, tile, visitor)) {
+            return false;
+        }
+        return lt_plan_window(layout, &start, &end, visitor);
+    }
+    // The state frame is what the panel shows, not the hidden half being
+    // written, and holds columns the way they were mapped before a remap
+    if (layout->state != NULL && !layout->double_buffer && layout->segment_remap == layout->controller.segment_remap
+        && !lt_diff_bounds(layout, &start, &end)) {
+        return true;    // the panel already shows this tile
+    }
+    return lt_plan_window(layout, &start, &end, visitor);
+}
+
+// Whether the panel's copy of the tile can be moved in place by a content
+// scroll (2Ch/2Dh), which shifts a page and column range of GDDRAM by a column
+bool lt_tile_can_shift(Layout *layout, Tile *tile) {
+    return !layout->double_buffer && !layout->transposed && !layout->scroll.active && !layout->controller.scroll.active
+        && layout->segment_remap == layout->controller.segment_remap && tile_get_width(tile) > 1
+        && !lt_defer_pending(tile)
+        && (layout->panel == NULL || !(layout->panel->flags & PANEL_FLAG_PAGE_ADDRESSING_ONLY));
+}
+
+// One column per flush: the controller may need a frame period to carry out a
+// content scroll, so several are not sent back to back
+static bool lt_plan_shift(Layout *layout, Tile *tile, FlushVisitor *visitor) {
+    uint8_t offset = lt_column_offset(layout);
+    uint8_t cmd[] = {
+        SSD1306_CMD_CONTENT_SCROLL(SSD1306_OPTION_HORIZONTAL_SCROLL_LEFT, tile->start.page, tile->end.page,
+                                   tile->start.column + offset, tile->end.column + offset),
+    };
+    if (!visitor->command(visitor->ctx, cmd, sizeof(cmd))) {
+        LOG_ERROR(LOG_CAT_LAYOUT, "Failed to scroll tile content", errno);
+        return false;
+    }
+    return true;
+}
+
+// What a flush sends of panel page `page` from `column` on: the framebuffer,
+// or the row of the tile holding it in a tile store
+static const uint8_t *lt_frame_row(Layout *layout, uint8_t page, uint8_t column) {
+    if (LAYOUT_TILE_STORE > 0) {
+        for (int i = 0; i < layout->num_tiles; i++) {
+            Tile *t = &layout->tiles[i];
+            if (page >= t->start.page && page <= t->end.page && column >= t->start.column && column <= t->end.column) {
+                return lt_tile_row(layout, t, page - t->start.page) + (column - t->start.column);
             }
-            if (!ssd1306_pa_mode_set_column_addr_low(start->column & 0x0F)) {
-                perror("Failed to set column address");
+        }
+    }
+    return lt_frame(layout)[page] + column;
+}
+
+// Sends the framebuffer window [start, end], in panel pages and columns
+bool lt_plan_window(Layout *layout, Point *start_, Point *end_, FlushVisitor *visitor) {
+    uint8_t cmds[16];
+    uint8_t len;
+    Point start = *start_;
+    Point end = *end_;
+    uint8_t width = end.column - start.column + 1;
+    uint8_t height = end.page - start.page + 1;
+    if (layout->panel != NULL && (layout->panel->flags & PANEL_FLAG_PAGE_ADDRESSING_ONLY)) {
+        for (int j = 0; j < height; j++) {
+            Point row = {start.page + j, start.column};
+            len = lt_encode_window(layout, visitor, ADDRESSING_MODE_PAGE, &row, &row, cmds);
+            if (len == 0 || !visitor->command(visitor->ctx, cmds, len)) {
+                LOG_ERROR(LOG_CAT_LAYOUT, "Failed to set position", errno);
                 return false;
             }
-            if (!ssd1306_pa_mode_set_column_addr_high(start->column >> 4)) {
-                perror("Failed to set column address");
+            if (!visitor->data(visitor->ctx, lt_frame_row(layout, row.page, row.column), width)) {
+                LOG_ERROR(LOG_CAT_LAYOUT, "Failed to print data", errno);
                 return false;
             }
-            break;
-        default:
-            perror("Invalid addressing mode\n");
+        }
+        return true;
+    }
+    len = lt_encode_window(layout, visitor, ADDRESSING_MODE_HORIZONTAL, &start, &end, cmds);
+    if (len == 0 || !visitor->command(visitor->ctx, cmds, len)) {
+        LOG_ERROR(LOG_CAT_LAYOUT, "Failed to set position", errno);
+        return false;
+    }
+    if (width == N_COLUMNS) {
+        // Full-width rows are contiguous, in the framebuffer as in a tile store:
+        // one transfer for the tile
+        if (!visitor->data(visitor->ctx, lt_frame_row(layout, start.page, 0), (size_t)width * height)) {
+            LOG_ERROR(LOG_CAT_LAYOUT, "Failed to print data", errno);
+            return false;
+        }
+        return true;
+    }
+    for (int j = 0; j < height; j++) {
+        if (!visitor->data(visitor->ctx, lt_frame_row(layout, start.page + j, start.column), width)) {
+            LOG_ERROR(LOG_CAT_LAYOUT, "Failed to print data", errno);
             return false;
+        }
     }
     return true;
 }
 
-static bool lt_flush(Layout *layout, uint8_t *data, uint8_t len) {
-    if (!layout->write(data, len)) {
-        perror("Failed to send message");
+void lt_prepare_tiles(Layout *layout) {
+    for (int i = 0; i < layout->num_tiles; i++) {
+        Tile *tile = &layout->tiles[i];
+        lt_defer_resolve(layout, tile);
+        if (tile->prepare != NULL) {
+            tile->prepare(layout, tile, tile->prepare_ctx);
+        }
+    }
+}
+
+static bool lt_scroll_equal(const ScrollState *a, const ScrollState *b) {
+    return a->active == b->active && (!a->active || (a->direction == b->direction && a->first_page == b->first_page
+                                                     && a->last_page == b->last_page && a->interval == b->interval));
+}
+
+// The controller forbids RAM writes while it scrolls, and a stopped scroll
+// leaves the scrolled pages rotated by however far it got. So before a flush
+// that sends data or changes the scroll, the scroll is stopped and the tiles on
+// its pages are rewritten from the framebuffer; lt_plan_controller restarts it.
+bool lt_scroll_conflicts(Layout *layout) {
+    if (!layout->controller.scroll.active) {
+        return false;
+    }
+    if (!lt_scroll_equal(&layout->controller.scroll, &layout->scroll)) {
+        return true;
+    }
+    for (int i = 0; i < layout->num_tiles; i++) {
+        if (tile_isdirty(&layout->tiles[i])) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool lt_tile_scrolled(Layout *layout, Tile *tile) {
+    ScrollState *scroll = &layout->controller.scroll;
+    return scroll->active && tile->start.page <= scroll->last_page && tile->end.page >= scroll->first_page;
+}
+
+bool lt_plan_scroll_stop(Layout *layout, FlushVisitor *visitor) {
+    if (!lt_scroll_conflicts(layout)) {
+        return true;
+    }
+    uint8_t cmd[] = {SSD1306_CMD_DEACTIVATE_SCROLL};
+    if (!visitor->command(visitor->ctx, cmd, sizeof(cmd))) {
+        LOG_ERROR(LOG_CAT_LAYOUT, "Failed to stop scrolling", errno);
         return false;
     }
+    for (int i = 0; i < layout->num_tiles; i++) {
+        if (lt_tile_scrolled(layout, &layout->tiles[i])) {
+            tile_setdirty(&layout->tiles[i], true);
+        }
+    }
+    ScrollState *scroll = &layout->controller.scroll;
+    if (layout->state != NULL) {
+        lt_state_forget_pages(layout, scroll->first_page, scroll->last_page);
+    }
+    scroll->active = 0;
+    return true;
+}
+
+// Unlike the registers lt_plan_controller sends, the segment remap only applies
+// to data written after it, so it goes out before the tiles
+bool lt_plan_orientation(Layout *layout, FlushVisitor *visitor) {
+    if (layout->segment_remap == layout->controller.segment_remap) {
+        return true;
+    }
+    uint8_t cmd[] = {SSD1306_CMD_SET_SEGMENT_REMAP(layout->segment_remap)};
+    if (!visitor->command(visitor->ctx, cmd, sizeof(cmd))) {
+        LOG_ERROR(LOG_CAT_LAYOUT, "Failed to set segment remap", errno);
+        return false;
+    }
+    return true;
+}
+
+// Controller registers the layout changed since the last flush. They go out
+// after the tiles, so e.g. a scroll shows rows that are already written.
+bool lt_plan_controller(Layout *layout, FlushVisitor *visitor) {
+    if (layout->com_scan_dir != layout->controller.com_scan_dir) {
+        uint8_t cmd[] = {SSD1306_CMD_SET_COM_OUTPUT_SCAN_DIR(layout->com_scan_dir)};
+        if (!visitor->command(visitor->ctx, cmd, sizeof(cmd))) {
+            LOG_ERROR(LOG_CAT_LAYOUT, "Failed to set COM scan direction", errno);
+            return false;
+        }
+    }
+    if (layout->start_line != layout->controller.start_line) {
+        uint8_t cmd[] = {SSD1306_CMD_SET_START_LINE(layout->start_line)};
+        if (!visitor->command(visitor->ctx, cmd, sizeof(cmd))) {
+            LOG_ERROR(LOG_CAT_LAYOUT, "Failed to set start line", errno);
+            return false;
+        }
+    }
+    ScrollState *scroll = &layout->scroll;
+    if (scroll->active && !lt_scroll_equal(scroll, &layout->controller.scroll)) {
+        uint8_t cmd[] = {
+            SSD1306_CMD_SCROLL_HORIZONTAL(scroll->direction, scroll->first_page, scroll->interval, scroll->last_page),
+            SSD1306_CMD_ACTIVATE_SCROLL,
+        };
+        if (!visitor->command(visitor->ctx, cmd, sizeof(cmd))) {
+            LOG_ERROR(LOG_CAT_LAYOUT, "Failed to start scrolling", errno);
+            return false;
+        }
+    }
     return true;
 }
+
+void lt_panel_visitor(Layout *layout, FlushVisitor *visitor) {
+    *visitor = (FlushVisitor){
+        .command = lt_visit_command,
+        .data = lt_visit_data,
+        .ctx = layout,
+        .addressing = layout->controller.addressing,
+    };
+}
+
+static bool lt_visit_command(void *ctx, const uint8_t *cmds, size_t len) {
+    (void)ctx;
+    return ssd1306_send_commands(cmds, len);
+}
+
+static bool lt_visit_data(void *ctx, const uint8_t *data, size_t len) {
+    return lt_flush((Layout *)ctx, data, len);
+}
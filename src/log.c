@@ -0,0 +1,147 @@
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "log.h"
+#include "timing.h"
+
+#if (LOG_RING_SIZE & (LOG_RING_SIZE - 1)) != 0
+#error "LOG_RING_SIZE must be a power of two"
+#endif
+
+#ifdef _MSC_VER
+#include <intrin.h>
+static uint32_t atomic_load_u32(volatile uint32_t *p) {
+    uint32_t v = *p;
+    _ReadWriteBarrier();
+    return v;
+}
+static void atomic_store_u32(volatile uint32_t *p, uint32_t v) {
+    _ReadWriteBarrier();
+    *p = v;
+}
+static bool atomic_cas_u32(volatile uint32_t *p, uint32_t expected, uint32_t desired) {
+    return (uint32_t)_InterlockedCompareExchange((volatile long *)p, (long)desired, (long)expected) == expected;
+}
+static void atomic_inc_u32(volatile uint32_t *p) {
+    _InterlockedIncrement((volatile long *)p);
+}
+#else
+static uint32_t atomic_load_u32(volatile uint32_t *p) {
+    return __atomic_load_n(p, __ATOMIC_ACQUIRE);
+}
+static void atomic_store_u32(volatile uint32_t *p, uint32_t v) {
+    __atomic_store_n(p, v, __ATOMIC_RELEASE);
+}
+static bool atomic_cas_u32(volatile uint32_t *p, uint32_t expected, uint32_t desired) {
+    return __atomic_compare_exchange_n(p, &expected, desired, false, __ATOMIC_ACQ_REL, __ATOMIC_RELAXED);
+}
+static void atomic_inc_u32(volatile uint32_t *p) {
+    __atomic_fetch_add(p, 1, __ATOMIC_RELAXED);
+}
+#endif
+
+// Bounded multi-producer ring. Slot seq holds the lap (pos with the index bits
+// cleared) the slot is free for, or lap + 1 once it holds a record - so the
+// zero-initialized ring is ready without any setup. Producers never wait; when
+// the ring is full the record is counted and dropped.
+#define LAP(pos) ((pos) & ~(uint32_t)(LOG_RING_SIZE - 1))
+
+static LogRecord ring[LOG_RING_SIZE];
+static volatile uint32_t head;
+static volatile uint32_t tail;
+static volatile uint32_t dropped;
+
+static uint32_t category_mask = LOG_CAT_ALL;
+static uint8_t runtime_level = LOG_LEVEL;
+
+static const char *level_names[] = {"-", "E", "W", "I", "D", "T"};
+static const char *category_names[LOG_CAT_COUNT] = {"i2c", "udp", "ssd1306", "layout", "app"};
+
+void log_set_categories(uint32_t mask) {
+    category_mask = mask;
+}
+
+void log_set_level(uint8_t level) {
+    runtime_level = level;
+}
+
+bool log_enabled(uint8_t level, LogCategory category) {
+    return level <= runtime_level && ((category_mask >> category) & 1);
+}
+
+void log_write(uint8_t level, LogCategory category, const char *message, int32_t arg, const uint8_t *payload, size_t size) {
+    if (!log_enabled(level, category)) {
+        return;
+    }
+    uint32_t pos = atomic_load_u32(&head);
+    LogRecord *record;
+    for (;;) {
+        record = &ring[pos & (LOG_RING_SIZE - 1)];
+        int32_t diff = (int32_t)(atomic_load_u32(&record->seq) - LAP(pos));
+        if (diff == 0) {
+            if (atomic_cas_u32(&head, pos, pos + 1)) {
+                break;
+            }
+            pos = atomic_load_u32(&head);
+        } else if (diff < 0) {
+            atomic_inc_u32(&dropped);      // full, the drain is behind
+            return;
+        } else {
+            pos = atomic_load_u32(&head);
+        }
+    }
+    record->timestamp_us = (uint32_t)timing_now_us();
+    record->message = message;
+    record->arg = arg;
+    record->level = level;
+    record->category = (uint8_t)category;
+    record->size = (uint16_t)(size > 0xFFFF ? 0xFFFF : size);
+    if (payload != NULL && size > 0) {
+        memcpy(record->payload, payload, size > LOG_PAYLOAD_SIZE ? LOG_PAYLOAD_SIZE : size);
+    }
+    atomic_store_u32(&record->seq, LAP(pos) + 1);
+}
+
+// Single consumer. Returns the number of records formatted.
+size_t log_drain(FILE *out, size_t max_records) {
+    size_t count = 0;
+    while (max_records == 0 || count < max_records) {
+        uint32_t pos = tail;
+        LogRecord *record = &ring[pos & (LOG_RING_SIZE - 1)];
+        if (atomic_load_u32(&record->seq) != LAP(pos) + 1) {
+            break;      // empty
+        }
+        if (out != NULL) {
+            fprintf(out, "[%10lu] %s %s: %s", (unsigned long)record->timestamp_us,
+                    level_names[record->level], category_names[record->category], record->message);
+            if (record->size > 0) {
+                size_t n = record->size > LOG_PAYLOAD_SIZE ? LOG_PAYLOAD_SIZE : record->size;
+                fprintf(out, " %04lX:", (unsigned long)(uint32_t)record->arg);
+                for (size_t i = 0; i < n; i++) {
+                    fprintf(out, " %02X", record->payload[i]);
+                }
+                if (n < record->size) {
+                    fprintf(out, " ... (%u bytes)", record->size);
+                }
+            } else if (record->arg != 0) {
+                fprintf(out, " (%ld)", (long)record->arg);
+            }
+            fprintf(out, "\n");
+        }
+        atomic_store_u32(&record->seq, LAP(pos) + LOG_RING_SIZE);
+        tail = pos + 1;
+        count++;
+    }
+    uint32_t lost = atomic_load_u32(&dropped);
+    if (lost != 0 && out != NULL && count > 0) {
+        fprintf(out, "[log] %lu records dropped so far\n", (unsigned long)lost);
+    }
+    return count;
+}
+
+uint32_t log_dropped() {
+    return atomic_load_u32(&dropped);
+}
@@ -0,0 +1,116 @@
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <errno.h>
+
+#include "mapfile.h"
+#include "log.h"
+
+#ifdef _WIN32
+    #include <windows.h>
+#else
+    #include <fcntl.h>
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+    #include <unistd.h>
+#endif
+
+bool mapfile_open(MapFile *map, const char *path, size_t size, bool writable) {
+    map->addr = NULL;
+    map->size = 0;
+#ifdef _WIN32
+    map->file = CreateFileA(path, writable ? (GENERIC_READ | GENERIC_WRITE) : GENERIC_READ,
+                            FILE_SHARE_READ, NULL, writable ? OPEN_ALWAYS : OPEN_EXISTING,
+                            FILE_ATTRIBUTE_NORMAL, NULL);
+    if (map->file == INVALID_HANDLE_VALUE) {
+        LOG_ERROR(LOG_CAT_APP, "Failed to open mapped file", GetLastError());
+        return false;
+    }
+    if (size == 0) {
+        LARGE_INTEGER file_size;
+        GetFileSizeEx(map->file, &file_size);
+        size = (size_t)file_size.QuadPart;
+    }
+    if (size == 0) {
+        CloseHandle(map->file);
+        LOG_ERROR(LOG_CAT_APP, "Mapped file is empty", 0);
+        return false;
+    }
+    map->mapping = CreateFileMappingA(map->file, NULL, writable ? PAGE_READWRITE : PAGE_READONLY,
+                                      (DWORD)((uint64_t)size >> 32), (DWORD)size, NULL);
+    if (map->mapping == NULL) {
+        LOG_ERROR(LOG_CAT_APP, "Failed to create file mapping", GetLastError());
+        CloseHandle(map->file);
+        return false;
+    }
+    map->addr = MapViewOfFile(map->mapping, writable ? FILE_MAP_WRITE : FILE_MAP_READ, 0, 0, size);
+    if (map->addr == NULL) {
+        LOG_ERROR(LOG_CAT_APP, "Failed to map view of file", GetLastError());
+        CloseHandle(map->mapping);
+        CloseHandle(map->file);
+        return false;
+    }
+#else
+    map->fd = open(path, writable ? (O_RDWR | O_CREAT) : O_RDONLY, 0644);
+    if (map->fd < 0) {
+        LOG_ERROR(LOG_CAT_APP, "Failed to open mapped file", errno);
+        return false;
+    }
+    struct stat st;
+    if (fstat(map->fd, &st) != 0) {
+        LOG_ERROR(LOG_CAT_APP, "Failed to stat mapped file", errno);
+        close(map->fd);
+        return false;
+    }
+    if (size == 0) {
+        size = (size_t)st.st_size;
+    } else if ((size_t)st.st_size != size) {
+        if (!writable || ftruncate(map->fd, (off_t)size) != 0) {
+            LOG_ERROR(LOG_CAT_APP, "Mapped file has the wrong size", (int32_t)st.st_size);
+            close(map->fd);
+            return false;
+        }
+    }
+    if (size == 0) {
+        LOG_ERROR(LOG_CAT_APP, "Mapped file is empty", 0);
+        close(map->fd);
+        return false;
+    }
+    map->addr = mmap(NULL, size, writable ? (PROT_READ | PROT_WRITE) : PROT_READ, MAP_SHARED, map->fd, 0);
+    if (map->addr == MAP_FAILED) {
+        LOG_ERROR(LOG_CAT_APP, "Failed to map file", errno);
+        map->addr = NULL;
+        close(map->fd);
+        return false;
+    }
+#endif
+    map->size = size;
+    return true;
+}
+
+bool mapfile_sync(MapFile *map) {
+    if (map->addr == NULL) {
+        return false;
+    }
+#ifdef _WIN32
+    return FlushViewOfFile(map->addr, map->size) != 0;
+#else
+    return msync(map->addr, map->size, MS_SYNC) == 0;
+#endif
+}
+
+void mapfile_close(MapFile *map) {
+    if (map->addr == NULL) {
+        return;
+    }
+#ifdef _WIN32
+    UnmapViewOfFile(map->addr);
+    CloseHandle(map->mapping);
+    CloseHandle(map->file);
+#else
+    munmap(map->addr, map->size);
+    close(map->fd);
+#endif
+    map->addr = NULL;
+    map->size = 0;
+}
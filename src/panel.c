@@ -0,0 +1,181 @@
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+
+#include "panel.h"
+#include "ssd1306.h"
+#include "log.h"
+
+#include "ssd1306-config.h"
+
+// Every profile is checked and encoded by the compiler: the init sequence is a
+// constant byte blob that goes out as a single command transfer.
+
+#define PANEL_CHECK(name, width, height, column_offset, ram_columns)                                \
+    STATIC_ASSERT((height) % 8 == 0 && (height) >= 16 && (height) <= 64, name##_height);           \
+    STATIC_ASSERT((width) > 0 && (column_offset) + (width) <= (ram_columns), name##_width);        \
+    STATIC_ASSERT((ram_columns) == 128 || (ram_columns) == 132, name##_ram_columns)
+
+// SSD1306 power-up sequence (datasheet application note), ending in horizontal addressing
+#define SSD1306_INIT_SEQUENCE(height, display_offset, com_pins, contrast)                          \
+    SSD1306_CMD_SET_DISPLAY(SSD1306_OPTION_DISPLAY_OFF),                                           \
+    SSD1306_CMD_SET_DISPLAY_CLOCK_DIV_RATIO(0x80),                                                 \
+    SSD1306_CMD_SET_MULTIPLEX((height) - 1),                                                       \
+    SSD1306_CMD_SET_DISPLAY_OFFSET(display_offset),                                                \
+    SSD1306_CMD_SET_START_LINE(0x00),                                                              \
+    SSD1306_CMD_CHARGE_PUMP(0x1),                                                                  \
+    SSD1306_CMD_SET_MEMORY_ADDRESSING_MODE(SSD1306_OPTION_ADDRESSING_MODE_HORIZONTAL),             \
+    SSD1306_CMD_SET_SEGMENT_REMAP(SSD1306_OPTION_SEGMENT_REMAP_SEG0_TO_0),                         \
+    SSD1306_CMD_SET_COM_OUTPUT_SCAN_DIR(SSD1306_OPTION_COM_SCAN_DIR_NORMAL),                       \
+    SSD1306_CMD_SET_COM_PINS(com_pins),                                                            \
+    SSD1306_CMD_SET_CONTRAST(contrast),                                                            \
+    SSD1306_CMD_SET_PRECHARGE_PERIOD(0xF1),                                                        \
+    SSD1306_CMD_SET_VCOM_DESELECT_LEVEL(0x4),                                                      \
+    SSD1306_CMD_SET_DISPLAY(SSD1306_OPTION_DISPLAY_ALLON_RESUME),                                  \
+    SSD1306_CMD_SET_DISPLAY(SSD1306_OPTION_DISPLAY_NORMAL),                                        \
+    SSD1306_CMD_SET_DISPLAY(SSD1306_OPTION_DISPLAY_ON)
+
+// SH1106: no addressing mode command, DC-DC converter instead of the charge pump
+#define SH1106_INIT_SEQUENCE(height, display_offset, contrast)                                     \
+    SSD1306_CMD_SET_DISPLAY(SSD1306_OPTION_DISPLAY_OFF),                                           \
+    SSD1306_CMD_SET_DISPLAY_CLOCK_DIV_RATIO(0x80),                                                 \
+    SSD1306_CMD_SET_MULTIPLEX((height) - 1),                                                       \
+    SSD1306_CMD_SET_DISPLAY_OFFSET(display_offset),                                                \
+    SSD1306_CMD_SET_START_LINE(0x00),                                                              \
+    SH1106_CMD_DCDC(0x1),                                                                          \
+    SSD1306_CMD_SET_SEGMENT_REMAP(SSD1306_OPTION_SEGMENT_REMAP_SEG0_TO_0),                         \
+    SSD1306_CMD_SET_COM_OUTPUT_SCAN_DIR(SSD1306_OPTION_COM_SCAN_DIR_NORMAL),                       \
+    SSD1306_CMD_SET_COM_PINS(0x1),                                                                 \
+    SSD1306_CMD_SET_CONTRAST(contrast),                                                            \
+    SSD1306_CMD_SET_PRECHARGE_PERIOD(0x1F),                                                        \
+    SSD1306_CMD_SET_VCOM_DESELECT_LEVEL(0x4),                                                      \
+    SSD1306_CMD_SET_DISPLAY(SSD1306_OPTION_DISPLAY_NORMAL),                                        \
+    SSD1306_CMD_SET_DISPLAY(SSD1306_OPTION_DISPLAY_ON)
+
+PANEL_CHECK(panel_128x32, 128, 32, 0, 128);
+static const uint8_t panel_128x32_init[] = {
+    SSD1306_INIT_SEQUENCE(32, 0x00, 0x0, 0x8F),                 // sequential COM pins
+};
+
+PANEL_CHECK(panel_128x64, 128, 64, 0, 128);
+static const uint8_t panel_128x64_init[] = {
+    SSD1306_INIT_SEQUENCE(64, 0x00, 0x1, 0xCF),                 // alternative COM pins
+};
+
+PANEL_CHECK(panel_72x40, 72, 40, 28, 128);
+static const uint8_t panel_72x40_init[] = {
+    SSD1306_INIT_SEQUENCE(40, 0x00, 0x1, 0x82),                 // 0.42" modules, columns 28..99
+};
+
+PANEL_CHECK(panel_sh1106_132x64, 128, 64, 2, 132);
+static const uint8_t panel_sh1106_132x64_init[] = {
+    SH1106_INIT_SEQUENCE(64, 0x00, 0x80),                       // 128 visible of 132 columns
+};
+
+STATIC_ASSERT(sizeof(panel_128x32_init) <= 0xFF && sizeof(panel_128x64_init) <= 0xFF
+              && sizeof(panel_72x40_init) <= 0xFF && sizeof(panel_sh1106_132x64_init) <= 0xFF, init_len);
+
+const PanelProfile panel_128x32 = {
+    .name = "128x32", .width = 128, .pages = 4, .column_offset = 0, .ram_columns = 128,
+    .multiplex = 31, .display_offset = 0, .flags = 0,
+    .addressing_mode = SSD1306_OPTION_ADDRESSING_MODE_HORIZONTAL,
+    .contrast = 0x8F,
+    .init = panel_128x32_init, .init_len = sizeof(panel_128x32_init),
+};
+
+const PanelProfile panel_128x64 = {
+    .name = "128x64", .width = 128, .pages = 8, .column_offset = 0, .ram_columns = 128,
+    .multiplex = 63, .display_offset = 0, .flags = 0,
+    .addressing_mode = SSD1306_OPTION_ADDRESSING_MODE_HORIZONTAL,
+    .contrast = 0xCF,
+    .init = panel_128x64_init, .init_len = sizeof(panel_128x64_init),
+};
+
+const PanelProfile panel_72x40 = {
+    .name = "72x40", .width = 72, .pages = 5, .column_offset = 28, .ram_columns = 128,
+    .multiplex = 39, .display_offset = 0, .flags = 0,
+    .addressing_mode = SSD1306_OPTION_ADDRESSING_MODE_HORIZONTAL,
+    .contrast = 0x82,
+    .init = panel_72x40_init, .init_len = sizeof(panel_72x40_init),
+};
+
+const PanelProfile panel_sh1106_132x64 = {
+    .name = "sh1106", .width = 128, .pages = 8, .column_offset = 2, .ram_columns = 132,
+    .multiplex = 63, .display_offset = 0, .flags = PANEL_FLAG_PAGE_ADDRESSING_ONLY,
+    .addressing_mode = SSD1306_OPTION_ADDRESSING_MODE_PAGE,
+    .contrast = 0x80,
+    .init = panel_sh1106_132x64_init, .init_len = sizeof(panel_sh1106_132x64_init),
+};
+
+static const PanelProfile *panels[] = {
+    &panel_128x32,
+    &panel_128x64,
+    &panel_72x40,
+    &panel_sh1106_132x64,
+};
+
+const PanelProfile *panel_find(const char *name) {
+    for (size_t i = 0; i < sizeof(panels) / sizeof(panels[0]); i++) {
+        if (strcmp(panels[i]->name, name) == 0) {
+            return panels[i];
+        }
+    }
+    return NULL;
+}
+
+// Clears all of GDDRAM, not only the shown pages: double buffering flips to
+// the hidden half, and what no tile covers there is never written otherwise
+static bool panel_clear(const PanelProfile *profile) {
+    static const uint8_t zeros[132] = {0};
+    if (profile->flags & PANEL_FLAG_PAGE_ADDRESSING_ONLY) {
+        // Clear whole RAM rows so the hidden columns do not show garbage after a remap
+        for (uint8_t page = 0; page < PANEL_RAM_PAGES; page++) {
+            uint8_t window[] = {
+                SSD1306_CMD_PA_MODE_SET_PAGE_ADDR(page),
+                SSD1306_CMD_PA_MODE_SET_COLUMN_ADDR_LOW(0),
+                SSD1306_CMD_PA_MODE_SET_COLUMN_ADDR_HIGH(0),
+            };
+            if (!ssd1306_send_commands(window, sizeof(window))
+                    || !ssd1306_send_data(zeros, profile->ram_columns)) {
+                return false;
+            }
+        }
+        return true;
+    }
+    for (uint8_t page = 0; page < PANEL_RAM_PAGES; page++) {
+        if (!ssd1306_send_data(zeros, profile->ram_columns)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool panel_init(const PanelProfile *profile, bool clear) {
+    if (profile == NULL) {
+        errno = EINVAL;
+        LOG_ERROR(LOG_CAT_SSD1306, "Panel profile is NULL", errno);
+        return false;
+    }
+    if (!clear || (profile->flags & PANEL_FLAG_PAGE_ADDRESSING_ONLY)) {
+        if (!ssd1306_send_commands(profile->init, profile->init_len)) {
+            LOG_ERROR(LOG_CAT_SSD1306, "Failed to send init sequence", profile->init_len);
+            return false;
+        }
+        return !clear || panel_clear(profile);
+    }
+    // Append the full-RAM window for the clear to the same command transfer
+    uint8_t cmds[0xFF + 6];
+    memcpy(cmds, profile->init, profile->init_len);
+    uint8_t window[] = {
+        SSD1306_CMD_HAVA_MODE_SET_PAGE_ADDR(0, PANEL_RAM_PAGES - 1),
+        SSD1306_CMD_HAVA_MODE_SET_COLUMN_ADDR(0, profile->ram_columns - 1),
+    };
+    memcpy(cmds + profile->init_len, window, sizeof(window));
+    if (!ssd1306_send_commands(cmds, profile->init_len + sizeof(window))) {
+        LOG_ERROR(LOG_CAT_SSD1306, "Failed to send init sequence", profile->init_len);
+        return false;
+    }
+    return panel_clear(profile);
+}
@@ -0,0 +1,174 @@
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+
+#include "persist.h"
+#include "layout.h"
+#include "layout-internal.h"
+#include "mapfile.h"
+#include "log.h"
+
+#define LAYOUT_STATE_MAGIC      0x4C445353      // "SSDL"
+#define LAYOUT_STATE_VERSION    2
+
+static const char *lt_panel_name(Layout *layout) {
+    return layout->panel != NULL ? layout->panel->name : "";
+}
+
+// The tiles are checked like layout_add_tile checks them: a stale or damaged
+// file must not leave tiles pointing outside the framebuffer
+static bool lt_state_tiles_valid(Layout *layout, LayoutState *state) {
+    for (int i = 0; i < state->num_tiles; i++) {
+        Tile tile = {.start = state->tiles[i][0], .end = state->tiles[i][1]};
+        if (!lt_tile_fits(layout, &tile.start, &tile.end)) {
+            return false;
+        }
+        for (int j = 0; j < i; j++) {
+            Tile other = {.start = state->tiles[j][0], .end = state->tiles[j][1]};
+            if (tile_overlap(&tile, &other)) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+static bool lt_state_matches(Layout *layout, LayoutState *state) {
+    return state->magic == LAYOUT_STATE_MAGIC
+        && state->version == LAYOUT_STATE_VERSION
+        && state->size == sizeof(LayoutState)
+        && state->pages == N_PAGES
+        && state->columns == N_COLUMNS
+        && state->num_tiles <= MAX_TILES
+        && state->valid
+        && strncmp(state->panel, lt_panel_name(layout), sizeof(state->panel)) == 0
+        && lt_state_tiles_valid(layout, state);
+}
+
+static void lt_state_save_tiles(Layout *layout) {
+    LayoutState *state = layout->state;
+    state->num_tiles = layout->num_tiles;
+    for (int i = 0; i < layout->num_tiles; i++) {
+        state->tiles[i][0] = layout->tiles[i].start;
+        state->tiles[i][1] = layout->tiles[i].end;
+    }
+}
+
+int8_t layout_attach_state(LayoutPtr layout_, const char *path) {
+    Layout *layout = (Layout *)layout_;
+    if (layout == NULL || path == NULL) {
+        errno = EINVAL;
+        LOG_ERROR(LOG_CAT_LAYOUT, "Layout or path is NULL", errno);
+        return LAYOUT_ERR_INVALID;
+    }
+    if (LAYOUT_TILE_STORE > 0) {
+        errno = EINVAL;
+        LOG_ERROR(LOG_CAT_LAYOUT, "Persisted state needs a framebuffer", LAYOUT_TILE_STORE);
+        return LAYOUT_ERR_INVALID;
+    }
+    lt_state_close(layout);
+    if (!mapfile_open(&layout->state_file, path, sizeof(LayoutState), true)) {
+        errno = EIO;
+        LOG_ERROR(LOG_CAT_LAYOUT, "Failed to map state file", errno);
+        return LAYOUT_ERR_OTHER;
+    }
+    LayoutState *state = (LayoutState *)layout->state_file.addr;
+    layout->state = state;
+
+    if (lt_state_matches(layout, state)) {
+        memcpy(lt_frame(layout), state->frame, sizeof(state->frame));
+        layout->controller = state->controller;
+        layout->start_line = state->controller.start_line;
+        layout->scroll = state->controller.scroll;
+        layout->segment_remap = state->controller.segment_remap;
+        layout->com_scan_dir = state->controller.com_scan_dir;
+        if (layout->num_tiles == 0) {
+            for (int i = 0; i < state->num_tiles; i++) {
+                tile_init(&layout->tiles[i], state->tiles[i][0], state->tiles[i][1]);
+            }
+            layout->num_tiles = state->num_tiles;
+        }
+        if (!lt_shows_whole_ram(layout) && layout->start_line != lt_buffer_line(layout, 0)) {
+            // Left flipped to the second half by double buffering: rewrite the
+            // first half and show it again, unless double buffering is turned
+            // back on before the next flush
+            lt_state_forget_pages(layout, 0, N_PAGES - 1);
+            layout->start_line = lt_buffer_line(layout, 0);
+            for (int i = 0; i < layout->num_tiles; i++) {
+                tile_setdirty(&layout->tiles[i], true);
+            }
+        }
+        lt_state_save_tiles(layout);
+        LOG_INFO(LOG_CAT_LAYOUT, "Adopted persisted panel state", state->num_tiles);
+        return LAYOUT_STATE_ADOPTED;
+    }
+
+    // The caller initializes and clears the panel, which is what the frame records
+    memset(state, 0, sizeof(LayoutState));
+    state->magic = LAYOUT_STATE_MAGIC;
+    state->version = LAYOUT_STATE_VERSION;
+    state->size = sizeof(LayoutState);
+    state->pages = N_PAGES;
+    state->columns = N_COLUMNS;
+    strncpy(state->panel, lt_panel_name(layout), sizeof(state->panel) - 1);
+    state->controller = layout->controller;
+    lt_state_save_tiles(layout);
+    state->valid = 1;
+    for (int i = 0; i < layout->num_tiles; i++) {
+        tile_setdirty(&layout->tiles[i], true);
+    }
+    LOG_INFO(LOG_CAT_LAYOUT, "Started fresh panel state", 0);
+    return LAYOUT_STATE_FRESH;
+}
+
+void layout_detach_state(LayoutPtr layout_) {
+    Layout *layout = (Layout *)layout_;
+    if (layout != NULL) {
+        lt_state_close(layout);
+    }
+}
+
+void lt_state_begin_flush(Layout *layout) {
+    if (layout->state != NULL) {
+        layout->state->valid = 0;
+    }
+}
+
+void lt_state_commit_tile(Layout *layout, Tile *tile) {
+    Point start, end;
+    lt_tile_bounds(layout, tile, &start, &end);
+    for (uint8_t page = start.page; page <= end.page; page++) {
+        memcpy(&layout->state->frame[page][start.column], &lt_frame(layout)[page][start.column], end.column - start.column + 1);
+    }
+}
+
+// The panel no longer holds the frame on these pages (e.g. after scrolling):
+// make every byte differ so the next flush of a tile there sends it in full
+void lt_state_forget_pages(Layout *layout, uint8_t first, uint8_t last) {
+    for (uint8_t page = first; page <= last && page < N_PAGES; page++) {
+        for (int column = 0; column < N_COLUMNS; column++) {
+            layout->state->frame[page][column] = (uint8_t)~lt_frame(layout)[page][column];
+        }
+    }
+}
+
+void lt_state_end_flush(Layout *layout, bool ok) {
+    LayoutState *state = layout->state;
+    if (state == NULL) {
+        return;
+    }
+    if (ok) {
+        state->controller = layout->controller;
+        lt_state_save_tiles(layout);
+    }
+    state->valid = ok;
+}
+
+void lt_state_close(Layout *layout) {
+    if (layout->state != NULL) {
+        mapfile_close(&layout->state_file);
+        layout->state = NULL;
+    }
+}
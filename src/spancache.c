@@ -0,0 +1,159 @@
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include "spancache.h"
+#include "layout.h"
+#include "layout-internal.h"
+#include "log.h"
+
+#define SPAN_CACHE_BUCKETS 64
+
+struct SpanCache {
+    SpanEntry *buckets[SPAN_CACHE_BUCKETS];
+    SpanEntry *head;                // most recently used
+    SpanEntry *tail;
+    SpanCacheStats stats;
+};
+
+static uint32_t sc_hash(const FontFace *face, uint8_t scale, const uint8_t *text, size_t len) {
+    uint32_t h = 2166136261u ^ (uint32_t)((uintptr_t)face >> 4) ^ scale;
+    for (size_t i = 0; i < len; i++) {
+        h = (h ^ text[i]) * 16777619u;
+    }
+    return h;
+}
+
+static void sc_unlink(struct SpanCache *cache, SpanEntry *e) {
+    if (e->prev != NULL) e->prev->next = e->next; else cache->head = e->next;
+    if (e->next != NULL) e->next->prev = e->prev; else cache->tail = e->prev;
+}
+
+static void sc_push_front(struct SpanCache *cache, SpanEntry *e) {
+    e->prev = NULL;
+    e->next = cache->head;
+    if (cache->head != NULL) cache->head->prev = e; else cache->tail = e;
+    cache->head = e;
+}
+
+static void sc_remove(struct SpanCache *cache, SpanEntry *e) {
+    SpanEntry **link = &cache->buckets[e->hash % SPAN_CACHE_BUCKETS];
+    while (*link != e) {
+        link = &(*link)->chain;
+    }
+    *link = e->chain;
+    sc_unlink(cache, e);
+    cache->stats.bytes -= e->size;
+    cache->stats.entries--;
+    free(e);
+}
+
+SpanEntry *lt_span_find(struct SpanCache *cache, const FontFace *face, uint8_t scale, const uint8_t *text, size_t len) {
+    uint32_t hash = sc_hash(face, scale, text, len);
+    for (SpanEntry *e = cache->buckets[hash % SPAN_CACHE_BUCKETS]; e != NULL; e = e->chain) {
+        if (e->hash == hash && e->face == face && e->scale == scale && e->len == len && memcmp(e->text, text, len) == 0) {
+            sc_unlink(cache, e);
+            sc_push_front(cache, e);
+            cache->stats.hits++;
+            return e;
+        }
+    }
+    cache->stats.misses++;
+    return NULL;
+}
+
+// Allocates an entry for text measured at `width` columns and `count` glyphs;
+// the caller renders the strip and fills in the glyph table. One allocation
+// holds the header, glyph table, key and strip.
+SpanEntry *lt_span_insert(struct SpanCache *cache, const FontFace *face, uint8_t scale, const uint8_t *text, size_t len,
+                          uint8_t pages, uint8_t width, uint8_t count) {
+    size_t size = sizeof(SpanEntry) + count * (sizeof(uint32_t) + 1) + len + (size_t)pages * width;
+    if (size > cache->stats.max_bytes) {
+        return NULL;
+    }
+    while (cache->stats.bytes + size > cache->stats.max_bytes) {
+        sc_remove(cache, cache->tail);
+        cache->stats.evictions++;
+    }
+    SpanEntry *e = malloc(size);
+    if (e == NULL) {
+        errno = ENOMEM;
+        LOG_ERROR(LOG_CAT_LAYOUT, "Failed to allocate memory for text span", errno);
+        return NULL;
+    }
+    e->face = face;
+    e->hash = sc_hash(face, scale, text, len);
+    e->size = size;
+    e->len = len;
+    e->scale = scale;
+    e->pages = pages;
+    e->width = width;
+    e->count = count;
+    e->c = (uint32_t *)(e + 1);
+    e->column = (uint8_t *)(e->c + count);
+    e->text = e->column + count;
+    e->strip = e->text + len;
+    memcpy(e->text, text, len);
+    e->chain = cache->buckets[e->hash % SPAN_CACHE_BUCKETS];
+    cache->buckets[e->hash % SPAN_CACHE_BUCKETS] = e;
+    sc_push_front(cache, e);
+    cache->stats.bytes += size;
+    cache->stats.entries++;
+    return e;
+}
+
+SpanCachePtr span_cache_create(size_t max_bytes) {
+    struct SpanCache *cache = calloc(1, sizeof(struct SpanCache));
+    if (cache == NULL) {
+        errno = ENOMEM;
+        LOG_ERROR(LOG_CAT_LAYOUT, "Failed to allocate memory for span cache", errno);
+        return NULL;
+    }
+    cache->stats.max_bytes = max_bytes;
+    return cache;
+}
+
+void span_cache_clear(SpanCachePtr cache_) {
+    struct SpanCache *cache = (struct SpanCache *)cache_;
+    if (cache == NULL) {
+        return;
+    }
+    while (cache->head != NULL) {
+        sc_remove(cache, cache->head);
+    }
+}
+
+void span_cache_free(SpanCachePtr cache) {
+    span_cache_clear(cache);
+    free(cache);
+}
+
+void span_cache_get_stats(SpanCachePtr cache_, SpanCacheStats *stats) {
+    struct SpanCache *cache = (struct SpanCache *)cache_;
+    if (cache != NULL && stats != NULL) {
+        *stats = cache->stats;
+    }
+}
+
+void span_cache_reset_stats(SpanCachePtr cache_) {
+    struct SpanCache *cache = (struct SpanCache *)cache_;
+    if (cache != NULL) {
+        cache->stats.hits = 0;
+        cache->stats.misses = 0;
+        cache->stats.evictions = 0;
+    }
+}
+
+int8_t layout_set_span_cache(LayoutPtr layout_, SpanCachePtr cache) {
+    Layout *layout = (Layout *)layout_;
+    if (layout == NULL) {
+        errno = EINVAL;
+        LOG_ERROR(LOG_CAT_LAYOUT, "Layout is NULL", errno);
+        return LAYOUT_ERR_INVALID;
+    }
+    layout->span_cache = (struct SpanCache *)cache;
+    return LAYOUT_OK;
+}
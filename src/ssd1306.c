@@ -45,6 +45,12 @@ bool ssd1306_write(uint8_t *cmd, size_t len) {
     return i2c_send(SSD1306_I2C_ADDRESS_WRITE, 0x00, cmd, len);
 }
 
+bool ssd1306_send_commands(const uint8_t *cmds, size_t len) {
+    // Co = 0: every byte after the control byte is a command, so a whole
+    // sequence goes out in one transaction
+    return i2c_send(SSD1306_I2C_ADDRESS_WRITE, 0x00, cmds, len);
+}
+
 bool ssd1306_send_data(const uint8_t *data, size_t len) {
     return i2c_send(SSD1306_I2C_ADDRESS_WRITE, 0x40, data, len);
 }
@@ -238,7 +244,7 @@ bool ssd1306_pa_mode_set_column_addr_high(uint8_t column) {
 CommandWithArgs cmd_hava_mode_set_page_addr = {
     .super = {0x22},
     .argc = 2,
-    .arg_bitmasks = {0x03, 0x03}
+    .arg_bitmasks = {0x07, 0x07}
 };
 bool ssd1306_hava_mode_set_page_addr(uint8_t start_page, uint8_t end_page) {
     return ssd1306_send_command_with_args(&cmd_hava_mode_set_page_addr, (uint8_t[]){start_page, end_page});
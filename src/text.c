@@ -0,0 +1,371 @@
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+
+#include "layout.h"
+#include "layout-internal.h"
+#include "font.h"
+#include "log.h"
+
+// Bit-expansion tables for integer scaling: entry b of table s holds b with
+// every bit repeated s times, i.e. one source column byte as s page bytes.
+// Built by the preprocessor, so there is nothing to initialize at runtime.
+#define LT_SPREAD_BIT(b, i, s) ((((b) >> (i)) & 1u) * (((1u << (s)) - 1u) << ((i) * (s))))
+#define LT_SPREAD(b, s) (LT_SPREAD_BIT(b, 0, s) | LT_SPREAD_BIT(b, 1, s) | LT_SPREAD_BIT(b, 2, s) \
+                       | LT_SPREAD_BIT(b, 3, s) | LT_SPREAD_BIT(b, 4, s) | LT_SPREAD_BIT(b, 5, s) \
+                       | LT_SPREAD_BIT(b, 6, s) | LT_SPREAD_BIT(b, 7, s))
+#define LT_R4(s, n)     LT_SPREAD((n), s), LT_SPREAD((n) + 1, s), LT_SPREAD((n) + 2, s), LT_SPREAD((n) + 3, s)
+#define LT_R16(s, n)    LT_R4(s, n), LT_R4(s, (n) + 4), LT_R4(s, (n) + 8), LT_R4(s, (n) + 12)
+#define LT_R64(s, n)    LT_R16(s, n), LT_R16(s, (n) + 16), LT_R16(s, (n) + 32), LT_R16(s, (n) + 48)
+#define LT_R256(s)      LT_R64(s, 0), LT_R64(s, 64), LT_R64(s, 128), LT_R64(s, 192)
+
+STATIC_ASSERT(LAYOUT_MAX_SCALE * 8 <= 32, expand_fits_u32);
+
+static const uint32_t lt_expand[LAYOUT_MAX_SCALE - 1][256] = {
+    {LT_R256(2)},
+    {LT_R256(3)},
+    {LT_R256(4)},
+};
+
+uint32_t lt_expand_byte(uint8_t byte, uint8_t scale) {
+    return scale == 1 ? byte : lt_expand[scale - 2][byte];
+}
+
+const FontFace *lt_font_face(FontType font) {
+    switch (font) {
+        case FONT_8x9:
+            return &font_8x9;
+        case FONT_16x8:
+            return &font_16x8;
+        default:
+            return NULL;
+    }
+}
+
+// Writes scaled glyph columns [from, from + n) to `dst`, whose rows are
+// `stride` bytes apart. Scaled glyphs expand each source column once into
+// pages * scale bytes, which then fill `scale` output columns.
+void lt_render_glyph(uint8_t *dst, size_t stride, const uint8_t *glyph, const FontFace *face,
+                     uint8_t scale, uint8_t from, uint8_t n) {
+    if (scale == 1) {
+        for (uint8_t p = 0; p < face->pages; p++) {
+            memcpy(dst + p * stride, glyph + p * face->stride + from, n);
+        }
+        return;
+    }
+    uint8_t out[8 * LAYOUT_MAX_SCALE];
+    uint8_t src = from / scale;
+    uint8_t rep = scale - from % scale;
+    while (n > 0) {
+        for (uint8_t p = 0; p < face->pages; p++) {
+            uint32_t bits = lt_expand_byte(glyph[p * face->stride + src], scale);
+            for (uint8_t k = 0; k < scale; k++) {
+                out[p * scale + k] = (uint8_t)(bits >> (8 * k));
+            }
+        }
+        if (rep > n) {
+            rep = n;
+        }
+        for (uint8_t q = 0; q < face->pages * scale; q++) {
+            memset(dst + q * stride, out[q], rep);
+        }
+        dst += rep;
+        n -= rep;
+        src++;
+        rep = scale;
+    }
+}
+
+// Draws scaled glyph columns [from, from + n) at `column` of the text line
+// starting at tile page `page`
+static void lt_put_glyph(Layout *layout, Tile *t, uint8_t page, uint8_t column,
+                         const uint8_t *glyph, const FontFace *face, uint8_t scale, uint8_t from, uint8_t n) {
+    lt_render_glyph(lt_tile_row(layout, t, page) + column, lt_tile_stride(layout, t), glyph, face, scale, from, n);
+    tile_mark_columns(t, column, column + n - 1);
+}
+
+// Clears text-line positions [from, to) in rendering order: the rest of the
+// line `page` from `column`, then whole lines of `pages` rows
+static void lt_zero_fill(Layout *layout, Tile *t, uint8_t pages, uint8_t page, uint8_t column,
+                         uint8_t to_page, uint8_t to_column) {
+    uint8_t width = tile_get_width(t);
+    uint8_t height = tile_get_height(t);
+    uint8_t lo = width;
+    uint8_t hi = 0;
+    while (page < height && (page < to_page || (page == to_page && column < to_column))) {
+        uint8_t end = page == to_page ? to_column : width;
+        for (uint8_t p = page; p < page + pages && p < height; p++) {
+            memset(lt_tile_row(layout, t, p) + column, 0, end - column);
+        }
+        if (column < lo) lo = column;
+        if (end - 1 > hi) hi = end - 1;
+        page += pages;
+        column = 0;
+    }
+    if (lo <= hi) {
+        tile_mark_columns(t, lo, hi);
+    }
+}
+
+// Fast path for fixed-width fields (counters, clocks): same number of ASCII
+// characters as last time, no glyph wrapped. Bytes are compared directly and
+// a changed character is redrawn in place if its width is unchanged.
+// Returns false to fall back to the general path; what was redrawn so far is
+// recorded, so that path picks up where this one stopped.
+static bool lt_print_fixed(Layout *layout, Tile *t, const uint8_t *text, size_t len,
+                           const FontFace *face, uint8_t scale) {
+    TileText *mem = &t->text;
+    if (mem->split || len != mem->count) {
+        return false;
+    }
+    for (size_t i = 0; i < len; i++) {
+        if (text[i] >= 0x80) {
+            return false;
+        }
+    }
+    for (uint8_t i = 0; i < len; i++) {
+        if (text[i] == mem->c[i]) {
+            continue;
+        }
+        uint8_t glen = 0;
+        uint8_t old = 0;
+        const uint8_t *glyph = font_glyph(face, text[i], &glen);
+        if (glyph == NULL || font_glyph(face, mem->c[i], &old) == NULL || glen != old) {
+            return false;
+        }
+        if (glen > 0) {
+            lt_put_glyph(layout, t, mem->page[i], mem->column[i], glyph, face, scale, 0, glen * scale);
+        }
+        mem->c[i] = text[i];
+    }
+    mem->face = face;
+    return true;
+}
+
+// Looks text up in the span cache, rendering it into a new entry on a miss.
+// NULL when the text cannot be cached: it does not fit in one panel-wide line,
+// has too many glyphs, or has characters the face lacks.
+static const SpanEntry *lt_span_get(struct SpanCache *cache, const uint8_t *text, size_t len,
+                                    const FontFace *face, uint8_t scale) {
+    SpanEntry *e = lt_span_find(cache, face, scale, text, len);
+    if (e != NULL) {
+        return e;
+    }
+    uint16_t width = 0;
+    uint8_t count = 0;
+    size_t i = 0;
+    while (i < len) {
+        uint8_t glen = 0;
+        uint32_t c = font_utf8_next(text, len, &i);
+        if (c == FONT_UTF8_INVALID || font_glyph(face, c, &glen) == NULL || count == LT_TEXT_MAX_GLYPHS) {
+            return NULL;
+        }
+        width += glen * scale;
+        count++;
+    }
+    if (width > N_COLUMNS) {
+        return NULL;
+    }
+    e = lt_span_insert(cache, face, scale, text, len, face->pages * scale, (uint8_t)width, count);
+    if (e == NULL) {
+        return NULL;
+    }
+    uint8_t column = 0;
+    i = 0;
+    for (uint8_t k = 0; k < count; k++) {
+        uint8_t glen = 0;
+        uint32_t c = font_utf8_next(text, len, &i);
+        const uint8_t *glyph = font_glyph(face, c, &glen);
+        e->c[k] = c;
+        e->column[k] = column;
+        if (glen > 0) {
+            lt_render_glyph(e->strip + column, e->width, glyph, face, scale, 0, glen * scale);
+        }
+        column += glen * scale;
+    }
+    return e;
+}
+
+// Copies a cached strip to the start of the tile. Only the columns that differ
+// from what the tile shows are written and marked dirty.
+static void lt_print_span(Layout *layout, Tile *t, const SpanEntry *e, bool known) {
+    TileText *mem = &t->text;
+    uint8_t width = tile_get_width(t);
+    uint8_t lo = e->width;
+    uint8_t hi = 0;
+    for (uint8_t p = 0; p < e->pages; p++) {
+        const uint8_t *now = lt_tile_row(layout, t, p);
+        const uint8_t *strip = e->strip + p * e->width;
+        uint8_t first = 0;
+        uint8_t last = e->width;
+        while (first < last && now[first] == strip[first]) {
+            first++;
+        }
+        while (last > first && now[last - 1] == strip[last - 1]) {
+            last--;
+        }
+        if (first < lo) lo = first;
+        if (last > hi) hi = last;
+    }
+    for (uint8_t p = 0; lo < hi && p < e->pages; p++) {
+        memcpy(lt_tile_row(layout, t, p) + lo, e->strip + p * e->width + lo, hi - lo);
+    }
+    if (lo < hi) {
+        tile_mark_columns(t, lo, hi - 1);
+    }
+    uint8_t page = e->width == width ? e->pages : 0;
+    uint8_t column = e->width == width ? 0 : e->width;
+    if (!known) {
+        lt_zero_fill(layout, t, e->pages, page, column, 0xFF, 0);
+    } else if (mem->end_page > page || (mem->end_page == page && mem->end_column > column)) {
+        lt_zero_fill(layout, t, e->pages, page, column, mem->end_page, mem->end_column);
+    }
+    memcpy(mem->c, e->c, e->count * sizeof(uint32_t));
+    memcpy(mem->column, e->column, e->count);
+    memset(mem->page, 0, e->count);
+    mem->scale = e->scale;
+    mem->count = e->count;
+    mem->split = false;
+    mem->end_page = page;
+    mem->end_column = column;
+    mem->face = e->face;
+}
+
+// The errors lt_print would stop at, found without drawing anything
+static int8_t lt_print_check(Tile *t, const uint8_t *text, size_t len, const FontFace *face, uint8_t scale) {
+    uint8_t width = tile_get_width(t);
+    uint8_t height = tile_get_height(t);
+    uint8_t pages = face->pages * scale;
+    uint16_t page = 0;
+    uint8_t column = 0;
+    size_t i = 0;
+    if (pages > 8) {
+        errno = EINVAL;
+        LOG_ERROR(LOG_CAT_LAYOUT, "Scaled font taller than the panel", pages);
+        return LAYOUT_ERR_INVALID;
+    }
+    while (i < len) {
+        uint8_t glen = 0;
+        uint32_t c = font_utf8_next(text, len, &i);
+        if (c == FONT_UTF8_INVALID || font_glyph(face, c, &glen) == NULL) {
+            errno = EINVAL;
+            LOG_ERROR(LOG_CAT_LAYOUT, "Invalid character", c);
+            return LAYOUT_ERR_INVALID_DATA;
+        }
+        uint16_t left = (uint16_t)glen * scale;
+        while (left > 0) {
+            if (page + pages > height) {
+                errno = ENOSPC;
+                LOG_ERROR(LOG_CAT_LAYOUT, "No space left in tile", errno);
+                return LAYOUT_ERR_FULL;
+            }
+            uint8_t n = left > width - column ? width - column : (uint8_t)left;
+            left -= n;
+            column += n;
+            if (column >= width) {
+                column = 0;
+                page += pages;
+            }
+        }
+    }
+    return LAYOUT_OK;
+}
+
+// Blits glyphs straight from the font into the tile rows, one memcpy per glyph
+// page (or a LUT expansion when scaled), wrapping to the next text line when
+// the tile width runs out.
+//
+// The tile remembers what it shows: a glyph already drawn at the same spot is
+// skipped, and only the part of the previous text past the new end is cleared,
+// so a print that changes a few characters dirties just those columns.
+int8_t lt_print(Layout *layout, Tile *t, const uint8_t *text, size_t len, const FontFace *face, uint8_t scale) {
+    TileText *mem = &t->text;
+    uint8_t width = tile_get_width(t);
+    uint8_t height = tile_get_height(t);
+    uint8_t pages = face->pages * scale;
+    uint8_t page = 0;
+    uint8_t column = 0;
+    uint8_t count = 0;
+    bool split = false;
+    bool known = mem->face == face && mem->scale == scale;
+    size_t i = 0;
+    if (lt_defer_active(t)) {
+        // A print too long to record is drawn now. Everything pending was
+        // dropped first, so the text the tile remembers is still what it shows.
+        int8_t err = lt_print_check(t, text, len, face, scale);
+        TileDeferOp op = {.kind = LT_DEFER_PRINT, .arg = scale, .opaque = true, .face = face,
+                          .x1 = width, .y1 = height * 8};
+        if (err != LAYOUT_OK || lt_defer_add(layout, t, &op, text, len)) {
+            return err;
+        }
+    }
+    if (pages > 8) {
+        errno = EINVAL;
+        LOG_ERROR(LOG_CAT_LAYOUT, "Scaled font taller than the panel", pages);
+        return LAYOUT_ERR_INVALID;
+    }
+    if (known && lt_print_fixed(layout, t, text, len, face, scale)) {
+        return LAYOUT_OK;
+    }
+    if (layout->span_cache != NULL) {
+        const SpanEntry *e = lt_span_get(layout->span_cache, text, len, face, scale);
+        if (e != NULL && e->width <= width && pages <= height) {
+            lt_print_span(layout, t, e, known);
+            return LAYOUT_OK;
+        }
+    }
+    while (i < len) {
+        uint8_t glen = 0;
+        uint32_t c = font_utf8_next(text, len, &i);
+        const uint8_t *glyph = c == FONT_UTF8_INVALID ? NULL : font_glyph(face, c, &glen);
+        if (glyph == NULL) {
+            mem->face = NULL;
+            errno = EINVAL;
+            LOG_ERROR(LOG_CAT_LAYOUT, "Invalid character", c);
+            return LAYOUT_ERR_INVALID_DATA;
+        }
+        bool same = known && count < mem->count && mem->c[count] == c &&
+                    mem->page[count] == page && mem->column[count] == column;
+        if (count < LT_TEXT_MAX_GLYPHS) {
+            mem->c[count] = c;
+            mem->page[count] = page;
+            mem->column[count] = column;
+        }
+        count = count < 0xFF ? count + 1 : count;
+        uint16_t slen = (uint16_t)glen * scale;
+        uint16_t done = 0;
+        while (done < slen) {
+            if (page + pages > height) {
+                mem->face = NULL;
+                errno = ENOSPC;
+                LOG_ERROR(LOG_CAT_LAYOUT, "No space left in tile", errno);
+                return LAYOUT_ERR_FULL;
+            }
+            uint8_t n = slen - done > width - column ? width - column : (uint8_t)(slen - done);
+            if (!same) {
+                lt_put_glyph(layout, t, page, column, glyph, face, scale, (uint8_t)done, n);
+            }
+            done += n;
+            column += n;
+            if (column >= width) {
+                column = 0;
+                page += pages;
+                split = split || done < slen;
+            }
+        }
+    }
+    if (!known) {
+        lt_zero_fill(layout, t, pages, page, column, 0xFF, 0);
+    } else if (mem->end_page > page || (mem->end_page == page && mem->end_column > column)) {
+        lt_zero_fill(layout, t, pages, page, column, mem->end_page, mem->end_column);
+    }
+    mem->scale = scale;
+    mem->count = count;
+    mem->split = split;
+    mem->end_page = page;
+    mem->end_column = column;
+    mem->face = count <= LT_TEXT_MAX_GLYPHS ? face : NULL;
+    return LAYOUT_OK;
+}
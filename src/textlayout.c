@@ -0,0 +1,319 @@
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+
+#include "textlayout.h"
+#include "layout.h"
+#include "layout-internal.h"
+#include "font.h"
+#include "log.h"
+
+#define TL_ELLIPSIS 0x2026
+
+// Width in columns of the glyph for `c`, or -1 if the face has none
+static int16_t tl_glyph_width(const FontFace *face, uint8_t scale, uint32_t c) {
+    uint8_t glen = 0;
+    if (c == FONT_UTF8_INVALID || font_glyph(face, c, &glen) == NULL) {
+        return -1;
+    }
+    return (int16_t)glen * scale;
+}
+
+int8_t text_measure(const FontFace *face, uint8_t scale, const uint8_t *text, size_t len, uint16_t *width) {
+    if (face == NULL || width == NULL) {
+        errno = EINVAL;
+        LOG_ERROR(LOG_CAT_LAYOUT, "Font or width is NULL", errno);
+        return LAYOUT_ERR_INVALID;
+    }
+    uint32_t w = 0;
+    size_t i = 0;
+    while (i < len) {
+        uint32_t c = font_utf8_next(text, len, &i);
+        int16_t gw = tl_glyph_width(face, scale, c);
+        if (gw < 0) {
+            errno = EINVAL;
+            LOG_ERROR(LOG_CAT_LAYOUT, "Invalid character", c);
+            return LAYOUT_ERR_INVALID_DATA;
+        }
+        w += gw;
+    }
+    *width = w > 0xFFFF ? 0xFFFF : (uint16_t)w;
+    return LAYOUT_OK;
+}
+
+// Ellipsis glyph of the face: U+2026 if it has one, else "..."
+static uint8_t tl_ellipsis(const FontFace *face, uint8_t scale, uint32_t *c, uint8_t *count) {
+    int16_t w = tl_glyph_width(face, scale, TL_ELLIPSIS);
+    if (w >= 0) {
+        *c = TL_ELLIPSIS;
+        *count = 1;
+        return (uint8_t)w;
+    }
+    w = tl_glyph_width(face, scale, '.');
+    *c = '.';
+    *count = w >= 0 ? 3 : 0;
+    return w >= 0 ? (uint8_t)(3 * w) : 0;
+}
+
+typedef struct {
+    size_t end;                 // end of the line's content
+    size_t next;                // where the next line starts
+    uint16_t width;
+    bool overflow;              // stopped because the next glyph did not fit
+} TextFit;
+
+// Greedy fit of one line starting at `pos`: takes glyphs until '\n' or until
+// `width` columns are used, then backs up to the last space if wrapping. A
+// line always takes at least one glyph, so an overlong glyph cannot stall.
+static int8_t tl_fit(const FontFace *face, uint8_t scale, const uint8_t *text, size_t len, size_t pos,
+                     uint16_t width, bool wrap, TextFit *fit) {
+    size_t i = pos;
+    uint16_t w = 0;
+    bool prev_space = false;
+    bool have_break = false;
+    size_t brk = 0;             // start of the last space run, its width and its end
+    uint16_t brk_width = 0;
+    size_t brk_next = 0;
+    while (i < len) {
+        size_t at = i;
+        uint32_t c = font_utf8_next(text, len, &i);
+        if (c == '\n') {
+            *fit = (TextFit){at, i, w, false};
+            return LAYOUT_OK;
+        }
+        int16_t gw = tl_glyph_width(face, scale, c);
+        if (gw < 0) {
+            errno = EINVAL;
+            LOG_ERROR(LOG_CAT_LAYOUT, "Invalid character", c);
+            return LAYOUT_ERR_INVALID_DATA;
+        }
+        if (w + gw > width && at > pos) {
+            if (wrap && have_break) {
+                *fit = (TextFit){brk, brk_next, brk_width, true};
+            } else {
+                *fit = (TextFit){at, at, w, true};
+            }
+            return LAYOUT_OK;
+        }
+        if (c == ' ' && at > pos) {
+            if (!prev_space) {
+                brk = at;
+                brk_width = w;
+            }
+            brk_next = i;
+            have_break = true;
+        }
+        prev_space = c == ' ';
+        w += gw;
+    }
+    *fit = (TextFit){len, len, w, false};
+    return LAYOUT_OK;
+}
+
+// Drops trailing spaces from a line's content
+static void tl_trim(const FontFace *face, uint8_t scale, const uint8_t *text, size_t start, TextFit *fit) {
+    int16_t sw = tl_glyph_width(face, scale, ' ');
+    while (fit->end > start && text[fit->end - 1] == ' ') {
+        fit->end--;
+        fit->width -= sw > 0 ? sw : 0;
+    }
+}
+
+int8_t text_layout(const FontFace *face, uint8_t scale, const uint8_t *text, size_t len,
+                   uint8_t width, uint8_t max_lines, TextAlign align, uint8_t flags, TextLayout *out) {
+    if (face == NULL || out == NULL || (text == NULL && len > 0)) {
+        errno = EINVAL;
+        LOG_ERROR(LOG_CAT_LAYOUT, "Font, text or layout is NULL", errno);
+        return LAYOUT_ERR_INVALID;
+    }
+    if (len > 0xFFFF) {
+        errno = EMSGSIZE;
+        LOG_ERROR(LOG_CAT_LAYOUT, "Text too long to lay out", errno);
+        return LAYOUT_ERR_INVALID_DATA;
+    }
+    bool wrap = flags & TEXT_WRAP;
+    uint32_t ellipsis_c;
+    uint8_t ellipsis_count;
+    uint8_t ellipsis_w = flags & TEXT_ELLIPSIS ? tl_ellipsis(face, scale, &ellipsis_c, &ellipsis_count) : 0;
+    if (max_lines > TEXT_MAX_LINES) {
+        max_lines = TEXT_MAX_LINES;
+    }
+    memset(out, 0, sizeof(*out));
+    size_t pos = 0;
+    while (pos < len && out->num_lines < max_lines) {
+        TextFit fit;
+        int8_t ret = tl_fit(face, scale, text, len, pos, width, wrap, &fit);
+        if (ret != LAYOUT_OK) {
+            return ret;
+        }
+        size_t next = fit.next;
+        bool cut = false;
+        if (fit.overflow && !wrap) {
+            // The rest of this line is dropped
+            cut = true;
+            while (next < len && text[next] != '\n') {
+                next++;
+            }
+            next += next < len;
+        } else if (fit.overflow) {
+            while (next < len && text[next] == ' ') {
+                next++;
+            }
+        }
+        if (out->num_lines == max_lines - 1 && next < len) {
+            cut = true;
+        }
+        TextLine *line = &out->lines[out->num_lines];
+        if (cut) {
+            out->truncated = true;
+            if (ellipsis_w > 0 && ellipsis_w <= width) {
+                ret = tl_fit(face, scale, text, len, pos, width - ellipsis_w, false, &fit);
+                if (ret != LAYOUT_OK) {
+                    return ret;
+                }
+                if (fit.width > width - ellipsis_w) {
+                    fit.end = pos;      // a single glyph wider than the room left
+                    fit.width = 0;
+                }
+                line->ellipsis = true;
+            }
+        }
+        tl_trim(face, scale, text, pos, &fit);
+        uint16_t w = fit.width + (line->ellipsis ? ellipsis_w : 0);
+        line->start = (uint16_t)pos;
+        line->end = (uint16_t)fit.end;
+        line->width = w > width ? width : (uint8_t)w;
+        switch (align) {
+            case TEXT_ALIGN_CENTER:
+                line->x = (width - line->width) / 2;
+                break;
+            case TEXT_ALIGN_RIGHT:
+                line->x = width - line->width;
+                break;
+            default:
+                line->x = 0;
+                break;
+        }
+        out->num_lines++;
+        pos = next;
+    }
+    // Text left over with no line for it, e.g. a font taller than max_lines allows
+    if (pos < len) {
+        out->truncated = true;
+    }
+    return LAYOUT_OK;
+}
+
+// Renders one glyph into a line buffer, clipped to `width` columns; returns the new x
+static uint16_t tl_put(uint8_t buf[][N_COLUMNS], uint16_t x, uint8_t width, uint32_t c,
+                       const FontFace *face, uint8_t scale) {
+    uint8_t glen = 0;
+    const uint8_t *glyph = font_glyph(face, c, &glen);
+    uint16_t gw = (uint16_t)glen * scale;
+    if (glyph != NULL && x < width && gw > 0) {
+        uint8_t n = gw > width - x ? (uint8_t)(width - x) : (uint8_t)gw;
+        lt_render_glyph(&buf[0][x], N_COLUMNS, glyph, face, scale, 0, n);
+    }
+    return x + gw;
+}
+
+// Draws laid-out text into a tile: each text line is rendered once into a line
+// buffer, and only the columns that differ from the tile are written back and
+// marked dirty. Lines past the layout are cleared.
+int8_t layout_render_text(LayoutPtr layout_, uint8_t tile, const uint8_t *text, size_t len,
+                          const TextLayout *lines, const FontFace *face, uint8_t scale) {
+    Layout *layout = (Layout *)layout_;
+    if (layout == NULL || lines == NULL || face == NULL) {
+        errno = EINVAL;
+        LOG_ERROR(LOG_CAT_LAYOUT, "Layout, text layout or font is NULL", errno);
+        return LAYOUT_ERR_INVALID;
+    }
+    if (tile >= layout->num_tiles) {
+        errno = EINVAL;
+        LOG_ERROR(LOG_CAT_LAYOUT, "Invalid tile index", errno);
+        return LAYOUT_ERR_INVALID_TILE;
+    }
+    uint8_t pages = face->pages * scale;
+    if (scale < 1 || scale > LAYOUT_MAX_SCALE || pages > 8) {
+        errno = EINVAL;
+        LOG_ERROR(LOG_CAT_LAYOUT, "Invalid scale", scale);
+        return LAYOUT_ERR_INVALID;
+    }
+    Tile *t = &layout->tiles[tile];
+    uint8_t width = tile_get_width(t);
+    uint8_t height = tile_get_height(t);
+    uint32_t ellipsis_c;
+    uint8_t ellipsis_count;
+    tl_ellipsis(face, scale, &ellipsis_c, &ellipsis_count);
+    uint8_t buf[8][N_COLUMNS];
+    for (uint8_t l = 0; l * pages < height; l++) {
+        uint8_t rows = height - l * pages < pages ? height - l * pages : pages;
+        memset(buf, 0, sizeof(buf));
+        if (l < lines->num_lines) {
+            const TextLine *line = &lines->lines[l];
+            uint16_t x = line->x;
+            size_t i = line->start;
+            while (i < line->end && i < len) {
+                x = tl_put(buf, x, width, font_utf8_next(text, len, &i), face, scale);
+            }
+            for (uint8_t k = 0; line->ellipsis && k < ellipsis_count; k++) {
+                x = tl_put(buf, x, width, ellipsis_c, face, scale);
+            }
+        }
+        uint8_t lo = width;
+        uint8_t hi = 0;
+        for (uint8_t p = 0; p < rows; p++) {
+            const uint8_t *now = lt_tile_row(layout, t, l * pages + p);
+            uint8_t first = 0;
+            uint8_t last = width;
+            while (first < last && now[first] == buf[p][first]) {
+                first++;
+            }
+            while (last > first && now[last - 1] == buf[p][last - 1]) {
+                last--;
+            }
+            if (first < last) {
+                if (first < lo) lo = first;
+                if (last > hi) hi = last;
+            }
+        }
+        if (lo < hi) {
+            for (uint8_t p = 0; p < rows; p++) {
+                memcpy(lt_tile_row(layout, t, l * pages + p) + lo, &buf[p][lo], hi - lo);
+            }
+            tile_mark_columns(t, lo, hi - 1);
+        }
+    }
+    return LAYOUT_OK;
+}
+
+// Lays text out to fit the tile and renders it in one pass
+int8_t layout_print_text(LayoutPtr layout_, uint8_t tile, const uint8_t *text, size_t len,
+                         const FontFace *face, uint8_t scale, TextAlign align, uint8_t flags) {
+    Layout *layout = (Layout *)layout_;
+    if (layout == NULL || face == NULL) {
+        errno = EINVAL;
+        LOG_ERROR(LOG_CAT_LAYOUT, "Layout or font is NULL", errno);
+        return LAYOUT_ERR_INVALID;
+    }
+    if (tile >= layout->num_tiles) {
+        errno = EINVAL;
+        LOG_ERROR(LOG_CAT_LAYOUT, "Invalid tile index", errno);
+        return LAYOUT_ERR_INVALID_TILE;
+    }
+    if (scale < 1 || scale > LAYOUT_MAX_SCALE) {
+        errno = EINVAL;
+        LOG_ERROR(LOG_CAT_LAYOUT, "Invalid scale", scale);
+        return LAYOUT_ERR_INVALID;
+    }
+    Tile *t = &layout->tiles[tile];
+    TextLayout lines;
+    int8_t ret = text_layout(face, scale, text, len, tile_get_width(t), tile_get_height(t) / (face->pages * scale),
+                             align, flags, &lines);
+    if (ret != LAYOUT_OK) {
+        return ret;
+    }
+    return layout_render_text(layout_, tile, text, len, &lines, face, scale);
+}
@@ -0,0 +1,51 @@
+#include <stdint.h>
+
+#include "timing.h"
+
+#ifdef _WIN32
+    #include <windows.h>
+#else
+    #include <errno.h>
+    #include <time.h>
+#endif
+
+uint64_t timing_now_us() {
+#ifdef _WIN32
+    static LARGE_INTEGER frequency;
+    LARGE_INTEGER counter;
+    if (frequency.QuadPart == 0) {
+        QueryPerformanceFrequency(&frequency);
+    }
+    QueryPerformanceCounter(&counter);
+    return (uint64_t)(counter.QuadPart / frequency.QuadPart) * 1000000ULL
+        + (uint64_t)(counter.QuadPart % frequency.QuadPart) * 1000000ULL / frequency.QuadPart;
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000ULL + (uint64_t)ts.tv_nsec / 1000ULL;
+#endif
+}
+
+void timing_sleep_until_us(uint64_t deadline_us) {
+    uint64_t now = timing_now_us();
+    if (now >= deadline_us) {
+        return;
+    }
+#ifdef _WIN32
+    uint64_t remaining = deadline_us - now;
+    if (remaining > 2000) {
+        Sleep((DWORD)((remaining - 1000) / 1000));     // coarse sleep, then spin the rest
+    }
+    while (timing_now_us() < deadline_us) {
+        YieldProcessor();
+    }
+#else
+    struct timespec ts = {
+        .tv_sec = (time_t)(deadline_us / 1000000ULL),
+        .tv_nsec = (long)(deadline_us % 1000000ULL) * 1000L,
+    };
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR) {
+        // interrupted - sleep again until the deadline
+    }
+#endif
+}
@@ -14,6 +14,7 @@
 
 #include "udp.h"
 #include "layout.h"
+#include "log.h"
 
 #ifdef _WIN32
     #include <winsock2.h>
@@ -42,14 +43,14 @@ bool udp_init() {
     // Initialize the socket
 #ifdef _WIN32
     if (WSAStartup(MAKEWORD(2, 2), &wsa) != 0) {
-        fprintf(stderr, "WSAStartup failed\n");
+        LOG_ERROR(LOG_CAT_UDP, "WSAStartup failed", WSAGetLastError());
         return false;
     }
 #endif
 
     sockfd = socket(AF_INET, SOCK_DGRAM, 0);
     if (sockfd == INVALID_SOCKET) {
-        perror("Socket creation failed");
+        LOG_ERROR(LOG_CAT_UDP, "Socket creation failed", errno);
 #ifdef _WIN32
         WSACleanup();
 #endif
@@ -61,7 +62,7 @@ bool udp_init() {
     server_addr.sin_port = htons(PORT);
 
     if (inet_pton(AF_INET, "127.0.0.1", &server_addr.sin_addr) <= 0) {
-        perror("inet_pton");
+        LOG_ERROR(LOG_CAT_UDP, "inet_pton failed", errno);
         close_socket(sockfd);
 #ifdef _WIN32
         WSACleanup();
@@ -73,14 +74,10 @@ bool udp_init() {
 }
 
 bool udp_send(const uint8_t *data, size_t len) {
-    printf("[UDP] Sending %s: ", data[1] == 0x00 ? "command" : "data");
-    for (size_t i = 0; i < len; i++) {
-        printf("%02X ", data[i]);
-    }
-    printf("\n");
+    LOG_TRACE_BYTES(LOG_CAT_UDP, data[1] == 0x00 ? "Sending command" : "Sending data", len, data, len);
     if (sendto(sockfd, data, len, 0,
                (struct sockaddr *)&server_addr, sizeof(server_addr)) == SOCKET_ERROR) {
-        perror("Send failed");
+        LOG_ERROR(LOG_CAT_UDP, "Send failed", errno);
         return false;
     }
     return true;
@@ -0,0 +1,596 @@
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include "widget.h"
+#include "layout.h"
+#include "layout-internal.h"
+#include "blit.h"
+#include "gfx.h"
+#include "textlayout.h"
+#include "log.h"
+
+typedef struct {
+    int16_t x0;
+    int16_t y0;
+    int16_t x1;     // inclusive
+    int16_t y1;
+} WidgetBox;
+
+struct WidgetTree;
+
+typedef struct Widget {
+    WidgetType type;
+    struct WidgetTree *tree;
+    struct Widget *parent;
+    struct Widget *child;       // first child, drawn first
+    struct Widget *next;        // next sibling, drawn above this one
+    int16_t x;                  // relative to the parent
+    int16_t y;
+    uint8_t width;
+    uint8_t height;
+    bool visible;
+    WidgetBox box;              // in tile pixels
+    const FontFace *face;       // labels and numbers
+    TextAlign align;
+    uint8_t digits;
+    uint8_t len;
+    uint8_t text[WIDGET_MAX_TEXT];
+    int32_t value;              // numbers and progress bars
+    int32_t min;
+    int32_t max;
+    uint8_t fill;               // progress bar columns drawn filled
+    const uint8_t *bitmap;      // icons
+} Widget;
+
+typedef struct WidgetTree {
+    Layout *layout;
+    uint8_t tile;
+    Widget *root;
+    uint8_t num_damage;
+    WidgetBox damage[WIDGET_MAX_DAMAGE];
+    uint8_t *before;            // the tile as it was before a render pass
+} WidgetTree;
+
+static bool wg_intersects(const WidgetBox *a, const WidgetBox *b) {
+    return a->x0 <= b->x1 && b->x0 <= a->x1 && a->y0 <= b->y1 && b->y0 <= a->y1;
+}
+
+static bool wg_contains(const WidgetBox *a, const WidgetBox *b) {
+    return a->x0 <= b->x0 && a->x1 >= b->x1 && a->y0 <= b->y0 && a->y1 >= b->y1;
+}
+
+static WidgetBox wg_union(const WidgetBox *a, const WidgetBox *b) {
+    return (WidgetBox){
+        .x0 = a->x0 < b->x0 ? a->x0 : b->x0,
+        .y0 = a->y0 < b->y0 ? a->y0 : b->y0,
+        .x1 = a->x1 > b->x1 ? a->x1 : b->x1,
+        .y1 = a->y1 > b->y1 ? a->y1 : b->y1,
+    };
+}
+
+static int32_t wg_area(const WidgetBox *b) {
+    return (int32_t)(b->x1 - b->x0 + 1) * (b->y1 - b->y0 + 1);
+}
+
+// The part of a box inside the tile; false when there is none
+static bool wg_clip(WidgetTree *tree, const WidgetBox *in, WidgetBox *out) {
+    Tile *t = &tree->layout->tiles[tree->tile];
+    int16_t x1 = tile_get_width(t) - 1;
+    int16_t y1 = tile_get_height(t) * 8 - 1;
+    *out = (WidgetBox){
+        .x0 = in->x0 > 0 ? in->x0 : 0,
+        .y0 = in->y0 > 0 ? in->y0 : 0,
+        .x1 = in->x1 < x1 ? in->x1 : x1,
+        .y1 = in->y1 < y1 ? in->y1 : y1,
+    };
+    return out->x0 <= out->x1 && out->y0 <= out->y1;
+}
+
+static bool wg_shown(Widget *w) {
+    for (; w != NULL; w = w->parent) {
+        if (!w->visible) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static void wg_update_box(Widget *w) {
+    int16_t x = w->parent != NULL ? w->parent->box.x0 : 0;
+    int16_t y = w->parent != NULL ? w->parent->box.y0 : 0;
+    w->box = (WidgetBox){x + w->x, y + w->y, x + w->x + w->width - 1, y + w->y + w->height - 1};
+    for (Widget *c = w->child; c != NULL; c = c->next) {
+        wg_update_box(c);
+    }
+}
+
+// Adds a region to redraw, merging it into the regions it overlaps. When all
+// slots are taken it merges with the region that grows the least.
+static void wg_damage(WidgetTree *tree, const WidgetBox *box) {
+    WidgetBox d;
+    if (!wg_clip(tree, box, &d)) {
+        return;
+    }
+    bool overlap = true;
+    while (overlap) {
+        // The grown region may overlap regions already checked
+        overlap = false;
+        for (uint8_t i = 0; i < tree->num_damage; i++) {
+            if (wg_intersects(&tree->damage[i], &d)) {
+                d = wg_union(&tree->damage[i], &d);
+                tree->damage[i] = tree->damage[--tree->num_damage];
+                overlap = true;
+                break;
+            }
+        }
+    }
+    if (tree->num_damage < WIDGET_MAX_DAMAGE) {
+        tree->damage[tree->num_damage++] = d;
+        return;
+    }
+    uint8_t best = 0;
+    int32_t best_growth = INT32_MAX;
+    for (uint8_t i = 0; i < tree->num_damage; i++) {
+        WidgetBox merged = wg_union(&tree->damage[i], &d);
+        int32_t growth = wg_area(&merged) - wg_area(&tree->damage[i]);
+        if (growth < best_growth) {
+            best = i;
+            best_growth = growth;
+        }
+    }
+    WidgetBox merged = wg_union(&tree->damage[best], &d);
+    tree->damage[best] = tree->damage[--tree->num_damage];
+    wg_damage(tree, &merged);
+}
+
+// Invalidates what the widget and everything in it show
+static void wg_invalidate(Widget *w) {
+    if (!wg_shown(w)) {
+        return;
+    }
+    if (w->type != WIDGET_CONTAINER) {
+        wg_damage(w->tree, &w->box);
+    }
+    for (Widget *c = w->child; c != NULL; c = c->next) {
+        wg_invalidate(c);
+    }
+}
+
+static Widget *wg_create(Widget *parent, WidgetType type, int16_t x, int16_t y, uint8_t width, uint8_t height) {
+    if (parent == NULL || parent->type != WIDGET_CONTAINER || width == 0 || height == 0) {
+        errno = EINVAL;
+        LOG_ERROR(LOG_CAT_LAYOUT, "Invalid widget parent or size", errno);
+        return NULL;
+    }
+    Widget *w = calloc(1, sizeof(Widget));
+    if (w == NULL) {
+        errno = ENOMEM;
+        LOG_ERROR(LOG_CAT_LAYOUT, "Failed to allocate memory for widget", errno);
+        return NULL;
+    }
+    w->type = type;
+    w->tree = parent->tree;
+    w->parent = parent;
+    w->x = x;
+    w->y = y;
+    w->width = width;
+    w->height = height;
+    w->visible = true;
+    Widget **link = &parent->child;
+    while (*link != NULL) {
+        link = &(*link)->next;
+    }
+    *link = w;
+    wg_update_box(w);
+    return w;
+}
+
+WidgetPtr widget_create_root(LayoutPtr layout_, uint8_t tile) {
+    Layout *layout = (Layout *)layout_;
+    if (layout == NULL) {
+        errno = EINVAL;
+        LOG_ERROR(LOG_CAT_LAYOUT, "Layout is NULL", errno);
+        return NULL;
+    }
+    if (tile >= layout->num_tiles) {
+        errno = EINVAL;
+        LOG_ERROR(LOG_CAT_LAYOUT, "Invalid tile index", errno);
+        return NULL;
+    }
+    Tile *t = &layout->tiles[tile];
+    WidgetTree *tree = calloc(1, sizeof(WidgetTree));
+    Widget *root = calloc(1, sizeof(Widget));
+    uint8_t *before = malloc((size_t)tile_get_width(t) * tile_get_height(t));
+    if (tree == NULL || root == NULL || before == NULL) {
+        free(tree);
+        free(root);
+        free(before);
+        errno = ENOMEM;
+        LOG_ERROR(LOG_CAT_LAYOUT, "Failed to allocate memory for widget tree", errno);
+        return NULL;
+    }
+    tree->layout = layout;
+    tree->tile = tile;
+    tree->root = root;
+    tree->before = before;
+    root->type = WIDGET_CONTAINER;
+    root->tree = tree;
+    root->width = tile_get_width(t);
+    root->height = tile_get_height(t) * 8;
+    root->visible = true;
+    wg_update_box(root);
+    // The tree owns the tile: the first pass clears it
+    wg_damage(tree, &root->box);
+    return root;
+}
+
+WidgetPtr widget_create_container(WidgetPtr parent, int16_t x, int16_t y, uint8_t width, uint8_t height) {
+    return wg_create((Widget *)parent, WIDGET_CONTAINER, x, y, width, height);
+}
+
+WidgetPtr widget_create_label(WidgetPtr parent, int16_t x, int16_t y, uint8_t width, uint8_t height,
+                              const FontFace *face, TextAlign align) {
+    if (face == NULL || align > TEXT_ALIGN_RIGHT) {
+        errno = EINVAL;
+        LOG_ERROR(LOG_CAT_LAYOUT, "Invalid label font or alignment", errno);
+        return NULL;
+    }
+    Widget *w = wg_create((Widget *)parent, WIDGET_LABEL, x, y, width, height);
+    if (w != NULL) {
+        w->face = face;
+        w->align = align;
+    }
+    return w;
+}
+
+static void wg_format(Widget *w) {
+    char buf[16];
+    int len = snprintf(buf, sizeof(buf), "%*ld", w->digits, (long)w->value);
+    w->len = len < 0 ? 0 : (uint8_t)len;
+    memcpy(w->text, buf, w->len);
+}
+
+WidgetPtr widget_create_number(WidgetPtr parent, int16_t x, int16_t y, uint8_t width, uint8_t height,
+                               const FontFace *face, uint8_t digits) {
+    if (face == NULL || digits > 11) {
+        errno = EINVAL;
+        LOG_ERROR(LOG_CAT_LAYOUT, "Invalid number font or field width", digits);
+        return NULL;
+    }
+    Widget *w = wg_create((Widget *)parent, WIDGET_NUMBER, x, y, width, height);
+    if (w != NULL) {
+        w->face = face;
+        w->align = TEXT_ALIGN_RIGHT;
+        w->digits = digits;
+        wg_format(w);
+        wg_invalidate(w);
+    }
+    return w;
+}
+
+// Columns inside the frame and the one pixel gap around the bar
+static uint8_t wg_fill(Widget *w, int32_t value) {
+    int32_t inner = w->width - 4;
+    if (value <= w->min) {
+        return 0;
+    }
+    if (value >= w->max) {
+        return (uint8_t)inner;
+    }
+    return (uint8_t)(((int64_t)value - w->min) * inner / ((int64_t)w->max - w->min));
+}
+
+WidgetPtr widget_create_progress(WidgetPtr parent, int16_t x, int16_t y, uint8_t width, uint8_t height,
+                                 int32_t min, int32_t max) {
+    if (min >= max || width < 5 || height < 5) {
+        errno = EINVAL;
+        LOG_ERROR(LOG_CAT_LAYOUT, "Invalid progress bar range or size", errno);
+        return NULL;
+    }
+    Widget *w = wg_create((Widget *)parent, WIDGET_PROGRESS, x, y, width, height);
+    if (w != NULL) {
+        w->min = min;
+        w->max = max;
+        w->value = min;
+        w->fill = 0;
+        wg_invalidate(w);
+    }
+    return w;
+}
+
+WidgetPtr widget_create_icon(WidgetPtr parent, int16_t x, int16_t y, const uint8_t *bitmap,
+                             uint8_t width, uint8_t height) {
+    if (bitmap == NULL) {
+        errno = EINVAL;
+        LOG_ERROR(LOG_CAT_LAYOUT, "Icon bitmap is NULL", errno);
+        return NULL;
+    }
+    Widget *w = wg_create((Widget *)parent, WIDGET_ICON, x, y, width, height);
+    if (w != NULL) {
+        w->bitmap = bitmap;
+        wg_invalidate(w);
+    }
+    return w;
+}
+
+static void wg_free_tree(Widget *w) {
+    Widget *c = w->child;
+    while (c != NULL) {
+        Widget *next = c->next;
+        wg_free_tree(c);
+        c = next;
+    }
+    free(w);
+}
+
+void widget_free(WidgetPtr widget) {
+    Widget *w = (Widget *)widget;
+    if (w == NULL) {
+        return;
+    }
+    if (w->parent == NULL) {
+        WidgetTree *tree = w->tree;
+        wg_free_tree(w);
+        free(tree->before);
+        free(tree);
+        return;
+    }
+    wg_invalidate(w);
+    Widget **link = &w->parent->child;
+    while (*link != w) {
+        link = &(*link)->next;
+    }
+    *link = w->next;
+    wg_free_tree(w);
+}
+
+WidgetType widget_get_type(WidgetPtr widget) {
+    Widget *w = (Widget *)widget;
+    return w != NULL ? w->type : WIDGET_CONTAINER;
+}
+
+int8_t widget_set_text(WidgetPtr widget, const uint8_t *text, size_t len) {
+    Widget *w = (Widget *)widget;
+    if (w == NULL || w->type != WIDGET_LABEL || (text == NULL && len > 0)) {
+        errno = EINVAL;
+        LOG_ERROR(LOG_CAT_LAYOUT, "Not a label, or text is NULL", errno);
+        return LAYOUT_ERR_INVALID;
+    }
+    if (len > WIDGET_MAX_TEXT) {
+        errno = EMSGSIZE;
+        LOG_ERROR(LOG_CAT_LAYOUT, "Label text too long", (int)len);
+        return LAYOUT_ERR_INVALID_DATA;
+    }
+    if (len == w->len && memcmp(text, w->text, len) == 0) {
+        return LAYOUT_OK;
+    }
+    memcpy(w->text, text, len);
+    w->len = (uint8_t)len;
+    wg_invalidate(w);
+    return LAYOUT_OK;
+}
+
+int8_t widget_set_value(WidgetPtr widget, int32_t value) {
+    Widget *w = (Widget *)widget;
+    if (w == NULL || (w->type != WIDGET_NUMBER && w->type != WIDGET_PROGRESS)) {
+        errno = EINVAL;
+        LOG_ERROR(LOG_CAT_LAYOUT, "Widget has no value", errno);
+        return LAYOUT_ERR_INVALID;
+    }
+    if (value == w->value) {
+        return LAYOUT_OK;
+    }
+    w->value = value;
+    if (w->type == WIDGET_NUMBER) {
+        wg_format(w);
+        wg_invalidate(w);
+        return LAYOUT_OK;
+    }
+    // Values that round to the same bar length change nothing on screen
+    uint8_t fill = wg_fill(w, value);
+    if (fill != w->fill) {
+        w->fill = fill;
+        wg_invalidate(w);
+    }
+    return LAYOUT_OK;
+}
+
+int8_t widget_set_bitmap(WidgetPtr widget, const uint8_t *bitmap) {
+    Widget *w = (Widget *)widget;
+    if (w == NULL || w->type != WIDGET_ICON || bitmap == NULL) {
+        errno = EINVAL;
+        LOG_ERROR(LOG_CAT_LAYOUT, "Not an icon, or bitmap is NULL", errno);
+        return LAYOUT_ERR_INVALID;
+    }
+    if (bitmap != w->bitmap) {
+        w->bitmap = bitmap;
+        wg_invalidate(w);
+    }
+    return LAYOUT_OK;
+}
+
+int8_t widget_set_visible(WidgetPtr widget, bool visible) {
+    Widget *w = (Widget *)widget;
+    if (w == NULL) {
+        errno = EINVAL;
+        LOG_ERROR(LOG_CAT_LAYOUT, "Widget is NULL", errno);
+        return LAYOUT_ERR_INVALID;
+    }
+    if (visible == w->visible) {
+        return LAYOUT_OK;
+    }
+    // Invalidated while shown: before hiding, after showing
+    wg_invalidate(w);
+    w->visible = visible;
+    wg_invalidate(w);
+    return LAYOUT_OK;
+}
+
+int8_t widget_move(WidgetPtr widget, int16_t x, int16_t y) {
+    Widget *w = (Widget *)widget;
+    if (w == NULL || w->parent == NULL) {
+        errno = EINVAL;
+        LOG_ERROR(LOG_CAT_LAYOUT, "Widget is NULL or the root", errno);
+        return LAYOUT_ERR_INVALID;
+    }
+    if (x == w->x && y == w->y) {
+        return LAYOUT_OK;
+    }
+    wg_invalidate(w);
+    w->x = x;
+    w->y = y;
+    wg_update_box(w);
+    wg_invalidate(w);
+    return LAYOUT_OK;
+}
+
+int8_t widget_invalidate(WidgetPtr widget) {
+    Widget *w = (Widget *)widget;
+    if (w == NULL) {
+        errno = EINVAL;
+        LOG_ERROR(LOG_CAT_LAYOUT, "Widget is NULL", errno);
+        return LAYOUT_ERR_INVALID;
+    }
+    wg_invalidate(w);
+    return LAYOUT_OK;
+}
+
+// Grows a region to the whole of every widget it touches, so that no widget
+// is redrawn in part. Returns whether the region grew.
+static bool wg_grow(Widget *w, WidgetBox *d) {
+    if (!w->visible) {
+        return false;
+    }
+    bool grown = false;
+    WidgetBox box;
+    if (w->type != WIDGET_CONTAINER && wg_clip(w->tree, &w->box, &box) && wg_intersects(d, &box)
+        && !wg_contains(d, &box)) {
+        *d = wg_union(d, &box);
+        grown = true;
+    }
+    for (Widget *c = w->child; c != NULL; c = c->next) {
+        grown |= wg_grow(c, d);
+    }
+    return grown;
+}
+
+static void wg_draw(Widget *w) {
+    WidgetTree *tree = w->tree;
+    switch (w->type) {
+        case WIDGET_LABEL:
+        case WIDGET_NUMBER: {
+            uint8_t line_height = w->face->pages * 8;
+            uint8_t lines = w->height / line_height > 0 ? w->height / line_height : 1;
+            TextLayout tl;
+            if (text_layout(w->face, 1, w->text, w->len, w->width, lines, w->align, lines > 1 ? TEXT_WRAP : 0, &tl) != LAYOUT_OK) {
+                return;
+            }
+            for (uint8_t l = 0; l < tl.num_lines; l++) {
+                const TextLine *line = &tl.lines[l];
+                layout_draw_text(tree->layout, tree->tile, w->box.x0 + line->x, w->box.y0 + l * line_height,
+                                 w->text + line->start, line->end - line->start, w->face, BLIT_OR);
+            }
+            break;
+        }
+        case WIDGET_PROGRESS:
+            gfx_rect(tree->layout, tree->tile, w->box.x0, w->box.y0, w->width, w->height, GFX_WHITE);
+            if (w->fill > 0) {
+                gfx_fill_rect(tree->layout, tree->tile, w->box.x0 + 2, w->box.y0 + 2, w->fill, w->height - 4, GFX_WHITE);
+            }
+            break;
+        case WIDGET_ICON:
+            layout_blit(tree->layout, tree->tile, w->box.x0, w->box.y0, w->bitmap, w->width, w->height, BLIT_OR);
+            break;
+        default:
+            break;
+    }
+}
+
+// Draws the widgets inside region `d`, bottom to top
+static void wg_draw_region(Widget *w, const WidgetBox *d) {
+    if (!w->visible) {
+        return;
+    }
+    if (w->type != WIDGET_CONTAINER && wg_intersects(d, &w->box)) {
+        wg_draw(w);
+    }
+    for (Widget *c = w->child; c != NULL; c = c->next) {
+        wg_draw_region(c, d);
+    }
+}
+
+int8_t widget_render(WidgetPtr widget) {
+    Widget *w = (Widget *)widget;
+    if (w == NULL) {
+        errno = EINVAL;
+        LOG_ERROR(LOG_CAT_LAYOUT, "Widget is NULL", errno);
+        return LAYOUT_ERR_INVALID;
+    }
+    WidgetTree *tree = w->tree;
+    if (tree->num_damage == 0) {
+        return LAYOUT_OK;
+    }
+    Layout *layout = tree->layout;
+    Tile *t = &layout->tiles[tree->tile];
+    uint8_t width = tile_get_width(t);
+    uint8_t height = tile_get_height(t);
+    bool grown = true;
+    while (grown) {
+        grown = false;
+        for (uint8_t i = 0; i < tree->num_damage; i++) {
+            WidgetBox d = tree->damage[i];
+            if (wg_grow(tree->root, &d)) {
+                // Re-added, as the region may now overlap another one
+                tree->damage[i] = tree->damage[--tree->num_damage];
+                wg_damage(tree, &d);
+                grown = true;
+                break;
+            }
+        }
+    }
+    for (uint8_t page = 0; page < height; page++) {
+        memcpy(tree->before + (size_t)page * width, lt_tile_row(layout, t, page), width);
+    }
+    // Drawing marks whole regions; what goes to the flush is worked out below
+    bool dirty = t->dirty;
+    uint8_t dirty_start = t->dirty_start;
+    uint8_t dirty_end = t->dirty_end;
+    uint8_t dirty_page_start = t->dirty_page_start;
+    uint8_t dirty_page_end = t->dirty_page_end;
+    for (uint8_t i = 0; i < tree->num_damage; i++) {
+        WidgetBox *d = &tree->damage[i];
+        gfx_fill_rect(layout, tree->tile, d->x0, d->y0, d->x1 - d->x0 + 1, d->y1 - d->y0 + 1, GFX_BLACK);
+        wg_draw_region(tree->root, d);
+    }
+    t->dirty = dirty;
+    t->dirty_start = dirty_start;
+    t->dirty_end = dirty_end;
+    t->dirty_page_start = dirty_page_start;
+    t->dirty_page_end = dirty_page_end;
+    for (uint8_t i = 0; i < tree->num_damage; i++) {
+        WidgetBox *d = &tree->damage[i];
+        uint8_t lo = 0xFF, hi = 0, page_lo = 0xFF, page_hi = 0;
+        for (uint8_t page = d->y0 / 8; page <= d->y1 / 8; page++) {
+            const uint8_t *now = lt_tile_row(layout, t, page);
+            const uint8_t *was = tree->before + (size_t)page * width;
+            for (uint8_t column = d->x0; column <= d->x1; column++) {
+                if (now[column] != was[column]) {
+                    if (column < lo) lo = column;
+                    if (column > hi) hi = column;
+                    if (page_lo == 0xFF) page_lo = page;
+                    page_hi = page;
+                }
+            }
+        }
+        if (page_lo != 0xFF) {
+            tile_mark_rect(t, page_lo, page_hi, lo, hi);
+        }
+    }
+    tree->num_damage = 0;
+    return LAYOUT_OK;
+}
@@ -0,0 +1,208 @@
+#!/usr/bin/env python3
+"""
+Converts an image sequence into a delta-encoded animation for anim_open
+(see include/anim.h).
+
+    anim.py [--delay MS] [--keyframe N] [--gap N] out.sanm frame0.pbm frame1.pbm ...
+
+Frames are PBM (P1/P4) or PGM (P2/P5, thresholded at half scale) images of
+at most 128 columns; all frames must have the same size. Lit pixels are 1 in
+PBM and bright in PGM.
+"""
+
+import struct
+from typing import List, Tuple
+
+ANIM_MAGIC = b'SANM'
+ANIM_VERSION = 1
+ANIM_FLAG_KEYFRAME = 0x01
+ANIM_END_OF_FRAME = 0xFF
+
+Frame = List[bytes]             # [page] column bytes, bit 0 = top row of the page
+
+
+def read_netpbm(path: str) -> Tuple[int, int, List[List[int]]]:
+    """
+    Reads a PBM or PGM file into (width, height, rows of 0/1 pixels).
+    """
+    with open(path, 'rb') as f:
+        data = f.read()
+    fields = []
+    pos = 0
+    need = 3 if data[:2] in (b'P1', b'P4') else 4
+    while len(fields) < need:
+        while data[pos:pos + 1].isspace():
+            pos += 1
+        if data[pos:pos + 1] == b'#':
+            pos = data.index(b'\n', pos)
+            continue
+        start = pos
+        while not data[pos:pos + 1].isspace():
+            pos += 1
+        fields.append(data[start:pos])
+    magic, width, height = fields[0], int(fields[1]), int(fields[2])
+    maxval = int(fields[3]) if need == 4 else 1
+    pos += 1                    # the single whitespace before the raster
+    if magic == b'P4':
+        stride = (width + 7) // 8
+        raster = data[pos:pos + stride * height]
+        rows = [[(raster[y * stride + x // 8] >> (7 - x % 8)) & 1 for x in range(width)] for y in range(height)]
+    elif magic == b'P5':
+        raster = data[pos:pos + width * height]
+        rows = [[int(raster[y * width + x] * 2 > maxval) for x in range(width)] for y in range(height)]
+    elif magic in (b'P1', b'P2'):
+        values = [int(v) for v in data[pos:].split()]
+        if magic == b'P1':
+            values = [v & 1 for v in values]
+        else:
+            values = [int(v * 2 > maxval) for v in values]
+        rows = [values[y * width:(y + 1) * width] for y in range(height)]
+    else:
+        raise ValueError(f'{path}: not a PBM/PGM file')
+    return width, height, rows
+
+
+def to_pages(width: int, height: int, rows: List[List[int]]) -> Frame:
+    """
+    Transposes rows of pixels into page format, padding the last page.
+    """
+    pages = []
+    for page in range((height + 7) // 8):
+        columns = bytearray(width)
+        for bit in range(8):
+            y = page * 8 + bit
+            if y < height:
+                for x, v in enumerate(rows[y]):
+                    columns[x] |= v << bit
+        pages.append(bytes(columns))
+    return pages
+
+
+def rle(data: bytes) -> bytes:
+    """
+    Control c < 0x80: c + 1 literal bytes follow; c >= 0x80: the next byte repeats c - 0x7E times.
+    """
+    out = bytearray()
+    literal = bytearray()
+
+    def flush_literal():
+        while literal:
+            chunk = literal[:128]
+            out.append(len(chunk) - 1)
+            out.extend(chunk)
+            del literal[:128]
+
+    i = 0
+    while i < len(data):
+        n = 1
+        while i + n < len(data) and n < 129 and data[i + n] == data[i]:
+            n += 1
+        # A pair is only worth a repeat when it does not split a literal
+        if n >= 3 or (n == 2 and not literal):
+            flush_literal()
+            out += bytes([0x7E + n, data[i]])
+            i += n
+        else:
+            literal.append(data[i])
+            i += 1
+    flush_literal()
+    return bytes(out)
+
+
+WINDOW_COST = 8                 # approximate wire bytes of setting up one window
+
+
+def wire_cost(runs: List[Tuple[int, int, bytes]]) -> int:
+    """
+    Bytes the player sends for these runs; the file stores them compressed,
+    but the panel receives every column.
+    """
+    return sum(WINDOW_COST + len(data) for _, _, data in runs)
+
+
+def encode_runs(runs: List[Tuple[int, int, bytes]]) -> bytes:
+    out = bytearray()
+    for page, column, data in runs:
+        out += bytes([page, column, len(data)]) + rle(data)
+    out.append(ANIM_END_OF_FRAME)
+    return bytes(out)
+
+
+def keyframe(frame: Frame) -> List[Tuple[int, int, bytes]]:
+    return [(page, 0, columns) for page, columns in enumerate(frame)]
+
+
+def delta(prev: Frame, frame: Frame, gap: int) -> List[Tuple[int, int, bytes]]:
+    """
+    Runs of changed columns per page. Unchanged stretches of up to `gap`
+    columns are sent along rather than opening a new window, which costs
+    more than a few data bytes on the wire.
+    """
+    runs = []
+    for page, (was, now) in enumerate(zip(prev, frame)):
+        changed = [x for x in range(len(now)) if was[x] != now[x]]
+        start = None
+        for x in changed:
+            if start is None:
+                start = last = x
+            elif x - last - 1 <= gap:
+                last = x
+            else:
+                runs.append((page, start, now[start:last + 1]))
+                start = last = x
+        if start is not None:
+            runs.append((page, start, now[start:last + 1]))
+    return runs
+
+
+def write_anim(path: str, frames: List[Frame], delay_ms: int, keyframe_interval: int, gap: int):
+    header_size = 16
+    records = []
+    index = []
+    offset = header_size
+    for i, frame in enumerate(frames):
+        runs = keyframe(frame)
+        flags = ANIM_FLAG_KEYFRAME
+        if i > 0 and (keyframe_interval == 0 or i % keyframe_interval != 0):
+            d = delta(frames[i - 1], frame, gap)
+            if wire_cost(d) < wire_cost(runs):
+                runs, flags = d, 0
+        record = encode_runs(runs)
+        index.append(struct.pack('<IHBB', offset, delay_ms, flags, 0))
+        records.append(record)
+        offset += len(record)
+    offset += -offset % 4
+    with open(path, 'wb') as f:
+        f.write(struct.pack('<4sHBBII', ANIM_MAGIC, ANIM_VERSION, len(frames[0]), len(frames[0][0]),
+                            len(frames), offset))
+        for record in records:
+            f.write(record)
+        f.write(bytes(offset - f.tell()))
+        for entry in index:
+            f.write(entry)
+    raw = len(frames) * len(frames[0]) * len(frames[0][0])
+    keys = sum(1 for e in index if e[6] & ANIM_FLAG_KEYFRAME)
+    print(f'Generated {path}: {len(frames)} frames ({keys} keyframes), {offset + len(index) * 8} bytes '
+          f'({raw} bytes as full frames)')
+
+
+if __name__ == '__main__':
+    import argparse
+
+    parser = argparse.ArgumentParser(description='Build an SSD1306 delta animation from PBM/PGM frames')
+    parser.add_argument('--delay', type=int, default=100, help='frame delay in milliseconds')
+    parser.add_argument('--keyframe', type=int, default=32, help='keyframe interval in frames, 0: first frame only')
+    parser.add_argument('--gap', type=int, default=4, help='unchanged columns bridged inside one run')
+    parser.add_argument('output')
+    parser.add_argument('frames', nargs='+')
+    args = parser.parse_args()
+
+    frames = []
+    for path in args.frames:
+        width, height, rows = read_netpbm(path)
+        if width > 128 or height > 64:
+            parser.error(f'{path}: {width}x{height} is larger than the panel')
+        frames.append(to_pages(width, height, rows))
+        if len(frames[-1]) != len(frames[0]) or len(frames[-1][0]) != len(frames[0][0]):
+            parser.error(f'{path}: size differs from the first frame')
+    write_anim(args.output, frames, args.delay, args.keyframe, args.gap)